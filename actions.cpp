@@ -0,0 +1,805 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include "actions.h"
+#include "eventloop.h"
+#include "metrics.h"
+#include "probes.h"
+#include "supervise.h"
+#include "vclock.h"
+
+#define ACTION_TEXT_SIZE 256
+#define ACTION_ARGS 16
+
+enum {
+    KIND_EXEC,
+    KIND_WRITE,
+    KIND_HTTP,
+    KIND_MQTT,
+};
+
+static const char *kind_names[] = { "exec", "write", "http", "mqtt" };
+
+typedef struct _action {
+    int line;                       /* in the action file, names the action */
+    int offset;
+    int deadline;
+    unsigned int events;            /* mask of time IDs */
+    int kind;
+    char target[ACTION_TEXT_SIZE];
+    char host[128];                 /* http and mqtt */
+    char port[8];
+    char path[ACTION_TEXT_SIZE];    /* URL path or topic */
+    char text[ACTION_TEXT_SIZE];
+} action_t;
+
+typedef struct _job {
+    const action_t *action;
+    int time_id;
+    time_t epoch;
+    char time24[6];
+    int64_t due_ns;                 /* wall clock firing time */
+    int64_t started_ns;
+    int64_t finished_ns;
+    int error;                      /* errno value, 0 on success */
+    int status;                     /* HTTP status or MQTT return code */
+} job_t;
+
+static action_t actions[ACTIONS_MAX];
+static int actions_count = 0;
+static schedule_t *schedule = NULL;
+static time_t fired_through = -1;   /* firings up to here have been started */
+static time_t armed = -1;           /* next firing the timer waits for */
+static int latest_offset = 0;       /* largest offset, > 0 reaches into the next day */
+static schedule_day_t seen[SCHEDULE_DAYS];  /* schedule->days at the last look */
+static schedule_day_t yesterday;    /* the day before days[0], for late firings */
+static FILE *sim_trace = NULL;      /* --simulate: trace firings instead of running them */
+static event_source_t action_timer;
+static event_source_t done_event;
+static FILE *test_out = NULL;
+static int test_failures = 0;
+
+/* Worker pool, jobs and their results are only touched under the lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+static job_t pending[ACTIONS_QUEUE];
+static job_t done[ACTIONS_QUEUE];
+static int pending_head = 0, pending_count = 0;
+static int done_count = 0;
+static int in_flight = 0;           /* pending, running or not yet reported */
+
+/* ---------------------- Action File ----------------------- */
+
+static int parse_events(char *list, unsigned int *mask) {
+    *mask = 0;
+    for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        int i;
+
+        if (strcmp(name, "all") == 0) {
+            *mask |= (1 << PrayerTimes::TimesCount) - 1;
+            continue;
+        }
+        if (strcmp(name, "prayers") == 0) {
+            for (i = 0; i < PrayerTimes::TimesCount; i++)
+                if (schedule_is_prayer(i))
+                    *mask |= 1 << i;
+            continue;
+        }
+        for (i = 0; i < PrayerTimes::TimesCount; i++)
+            if (strcmp(name, TimeKey[i]) == 0)
+                break;
+        if (i == PrayerTimes::TimesCount)
+            return -1;
+        *mask |= 1 << i;
+    }
+    return *mask ? 0 : -1;
+}
+
+/* scheme://host[:port]/path */
+static int parse_url(action_t *action, const char *scheme, const char *default_port) {
+    size_t len = strlen(scheme);
+    const char *host = action->target + len, *slash, *colon;
+
+    if (strncmp(action->target, scheme, len) != 0)
+        return -1;
+    slash = strchr(host, '/');
+    if (slash == NULL || slash == host)
+        return -1;
+    colon = (const char *) memchr(host, ':', slash - host);
+    if ((size_t) ((colon ? colon : slash) - host) >= sizeof(action->host))
+        return -1;
+
+    snprintf(action->host, sizeof(action->host), "%.*s", (int) ((colon ? colon : slash) - host), host);
+    if (colon)
+        snprintf(action->port, sizeof(action->port), "%.*s", (int) (slash - colon - 1), colon + 1);
+    else
+        snprintf(action->port, sizeof(action->port), "%s", default_port);
+    /* MQTT topics have no leading slash */
+    snprintf(action->path, sizeof(action->path), "%s", action->kind == KIND_MQTT ? slash + 1 : slash);
+    return 0;
+}
+
+static int parse_line(char *line, action_t *action) {
+    char *fields[5], *rest = line, *events;
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        rest += strspn(rest, " \t");
+        if (*rest == '\0')
+            return -1;
+        fields[i] = rest;
+        rest += strcspn(rest, " \t");
+        if (*rest != '\0')
+            *rest++ = '\0';
+    }
+    rest += strspn(rest, " \t");
+
+    action->offset = atoi(fields[0]);
+    action->deadline = atoi(fields[1]);
+    events = fields[2];
+    for (action->kind = KIND_EXEC; action->kind <= KIND_MQTT; action->kind++)
+        if (strcmp(fields[3], kind_names[action->kind]) == 0)
+            break;
+    if (action->deadline < 1 || action->kind > KIND_MQTT || parse_events(events, &action->events) < 0
+            || strlen(fields[4]) >= sizeof(action->target) || strlen(rest) >= sizeof(action->text))
+        return -1;
+    strcpy(action->target, fields[4]);
+    strcpy(action->text, rest);
+
+    if (action->kind == KIND_HTTP)
+        return parse_url(action, "http://", "80");
+    if (action->kind == KIND_MQTT)
+        return parse_url(action, "mqtt://", "1883");
+    return 0;
+}
+
+static int load(const char *path) {
+    char buf[1024];
+    FILE *f = fopen(path, "r");
+    int line = 0;
+
+    if (f == NULL) {
+        syslog(LOG_ERR, "Unable to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(buf, sizeof(buf), f)) {
+        line++;
+        buf[strcspn(buf, "\r\n")] = '\0';
+        if (buf[strspn(buf, " \t")] == '\0' || buf[strspn(buf, " \t")] == '#')
+            continue;
+        if (actions_count == ACTIONS_MAX) {
+            syslog(LOG_ERR, "%s:%d: more than %d actions", path, line, ACTIONS_MAX);
+            fclose(f);
+            return -1;
+        }
+        actions[actions_count].line = line;
+        if (parse_line(buf, &actions[actions_count]) < 0) {
+            syslog(LOG_ERR, "%s:%d: invalid action", path, line);
+            fclose(f);
+            return -1;
+        }
+        if (actions[actions_count].offset > latest_offset)
+            latest_offset = actions[actions_count].offset;
+        actions_count++;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Substitute the event into the text of an action */
+static void expand(const char *text, const job_t *job, char *out, size_t size) {
+    size_t len = 0;
+
+    for (; *text && len + 1 < size; text++) {
+        int n = 0;
+
+        if (*text != '%' || text[1] == '\0') {
+            out[len++] = *text;
+            continue;
+        }
+        switch (*++text) {
+            case 'p': n = snprintf(out + len, size - len, "%s", TimeName[job->time_id]); break;
+            case 'k': n = snprintf(out + len, size - len, "%s", TimeKey[job->time_id]); break;
+            case 't': n = snprintf(out + len, size - len, "%s", job->time24); break;
+            case 'e': n = snprintf(out + len, size - len, "%ld", (long) job->epoch); break;
+            default: out[len++] = *text; break;
+        }
+        len += n;
+        if (len >= size)
+            len = size - 1;
+    }
+    out[len] = '\0';
+}
+
+static void payload(const job_t *job, char *out, size_t size) {
+    if (job->action->text[0])
+        expand(job->action->text, job, out, size);
+    else
+        expand("{\"event\":\"%k\",\"time\":\"%t\",\"epoch\":%e}", job, out, size);
+}
+
+/* ---------------------- Network Actions ----------------------- */
+
+static int remaining_ms(int64_t deadline_ns) {
+    int64_t left = deadline_ns - vclock_now_ns();
+    return left > 0 ? (int) ((left + 999999) / 1000000) : 0;
+}
+
+static int wait_fd(int fd, short events, int64_t deadline_ns) {
+    struct pollfd pfd = { fd, events, 0 };
+    int rc;
+
+    while ((rc = poll(&pfd, 1, remaining_ms(deadline_ns))) < 0 && errno == EINTR)
+        ;
+    if (rc == 0)
+        errno = ETIMEDOUT;
+    return rc > 0 ? 0 : -1;
+}
+
+static int connect_to(const char *host, const char *port, int64_t deadline_ns) {
+    struct addrinfo hints, *res, *ai;
+    int fd = -1, rc;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if ((rc = getaddrinfo(host, port, &hints, &res)) != 0) {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        if (errno == EINPROGRESS && wait_fd(fd, POLLOUT, deadline_ns) == 0
+                && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0) {
+            if (err == 0)
+                break;
+            errno = err;
+        }
+        err = errno;
+        close(fd);
+        fd = -1;
+        errno = err;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static int send_all(int fd, const char *buf, size_t len, int64_t deadline_ns) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EINTR)
+            return -1;
+        if (n < 0) {
+            if (wait_fd(fd, POLLOUT, deadline_ns) < 0)
+                return -1;
+            continue;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Read until want bytes or, with want 0, the end of the first line */
+static ssize_t recv_until(int fd, char *buf, size_t size, size_t want, int64_t deadline_ns) {
+    size_t len = 0;
+
+    while (len < size - 1) {
+        ssize_t n = recv(fd, buf + len, size - 1 - len, 0);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                return -1;
+            if (wait_fd(fd, POLLIN, deadline_ns) < 0)
+                return -1;
+            continue;
+        }
+        len += n;
+        buf[len] = '\0';
+        if (want ? len >= want : strchr(buf, '\n') != NULL)
+            break;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static int run_http(job_t *job, int64_t deadline_ns) {
+    const action_t *action = job->action;
+    char body[ACTION_TEXT_SIZE], request[1024], response[256];
+    int fd, len;
+
+    payload(job, body, sizeof(body));
+    len = snprintf(request, sizeof(request),
+        "POST %s HTTP/1.1\r\nHost: %s:%s\r\nContent-Type: application/json\r\n"
+        "Content-Length: %zu\r\nConnection: close\r\n\r\n%s",
+        action->path, action->host, action->port, strlen(body), body);
+
+    if ((fd = connect_to(action->host, action->port, deadline_ns)) < 0)
+        return errno;
+    if (send_all(fd, request, len, deadline_ns) < 0
+            || recv_until(fd, response, sizeof(response), 0, deadline_ns) < 0) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    close(fd);
+
+    if (sscanf(response, "HTTP/%*d.%*d %d", &job->status) != 1)
+        return EPROTO;
+    return (job->status >= 200 && job->status < 300) ? 0 : EPROTO;
+}
+
+/* MQTT 3.1.1 remaining length */
+static size_t mqtt_length(unsigned char *out, size_t value) {
+    size_t n = 0;
+
+    do {
+        out[n] = value % 128;
+        value /= 128;
+        if (value)
+            out[n] |= 0x80;
+        n++;
+    } while (value);
+    return n;
+}
+
+static size_t mqtt_string(unsigned char *out, const char *s, size_t len) {
+    out[0] = len >> 8;
+    out[1] = len & 0xff;
+    memcpy(out + 2, s, len);
+    return len + 2;
+}
+
+/* CONNECT, a QoS 0 PUBLISH and DISCONNECT on a clean session */
+static int run_mqtt(job_t *job, int64_t deadline_ns) {
+    const action_t *action = job->action;
+    unsigned char packet[1024], body[1024];
+    char message[ACTION_TEXT_SIZE], client[32], connack[8];
+    size_t n, len;
+    int fd;
+
+    payload(job, message, sizeof(message));
+    snprintf(client, sizeof(client), "ptimes-%d", (int) getpid());
+
+    if ((fd = connect_to(action->host, action->port, deadline_ns)) < 0)
+        return errno;
+
+    len = mqtt_string(body, "MQTT", 4);
+    body[len++] = 4;                /* protocol level 3.1.1 */
+    body[len++] = 0x02;             /* clean session */
+    body[len++] = 0;
+    body[len++] = 60;               /* keep alive */
+    len += mqtt_string(body + len, client, strlen(client));
+    packet[0] = 0x10;
+    n = 1 + mqtt_length(packet + 1, len);
+    memcpy(packet + n, body, len);
+    if (send_all(fd, (char *) packet, n + len, deadline_ns) < 0
+            || recv_until(fd, connack, sizeof(connack), 4, deadline_ns) < 4) {
+        int err = errno ? errno : EPROTO;
+        close(fd);
+        return err;
+    }
+    job->status = (unsigned char) connack[3];
+    if ((unsigned char) connack[0] != 0x20 || job->status != 0) {
+        close(fd);
+        return EPROTO;
+    }
+
+    len = mqtt_string(body, action->path, strlen(action->path));
+    memcpy(body + len, message, strlen(message));
+    len += strlen(message);
+    packet[0] = 0x30;
+    n = 1 + mqtt_length(packet + 1, len);
+    memcpy(packet + n, body, len);
+    packet[n + len] = 0xe0;         /* DISCONNECT */
+    packet[n + len + 1] = 0;
+    if (send_all(fd, (char *) packet, n + len + 2, deadline_ns) < 0) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    close(fd);
+    return 0;
+}
+
+static int run_write(job_t *job) {
+    char text[ACTION_TEXT_SIZE + 1];
+    int fd, rc = 0;
+
+    expand(job->action->text, job, text, sizeof(text) - 1);
+    strcat(text, "\n");
+    /* Devices and FIFOs without a reader must not hold up the worker */
+    fd = open(job->action->target, O_WRONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0)
+        return errno;
+    if (write(fd, text, strlen(text)) != (ssize_t) strlen(text))
+        rc = errno ? errno : EIO;
+    close(fd);
+    return rc;
+}
+
+/* ---------------------- Worker Pool ----------------------- */
+
+static void *worker(void *arg) {
+    for (;;) {
+        job_t job;
+
+        pthread_mutex_lock(&lock);
+        while (pending_count == 0)
+            pthread_cond_wait(&queued, &lock);
+        job = pending[pending_head];
+        pending_head = (pending_head + 1) % ACTIONS_QUEUE;
+        pending_count--;
+        pthread_mutex_unlock(&lock);
+
+        int64_t deadline_ns = job.due_ns + (int64_t) job.action->deadline * 1000000000;
+        job.started_ns = vclock_now_ns();
+        errno = 0;
+        switch (job.action->kind) {
+            case KIND_WRITE: job.error = run_write(&job); break;
+            case KIND_HTTP: job.error = run_http(&job, deadline_ns); break;
+            case KIND_MQTT: job.error = run_mqtt(&job, deadline_ns); break;
+        }
+        job.finished_ns = vclock_now_ns();
+        if (job.error == 0 && job.finished_ns > deadline_ns)
+            job.error = ETIMEDOUT;
+
+        pthread_mutex_lock(&lock);
+        done[done_count++] = job;
+        pthread_mutex_unlock(&lock);
+
+        uint64_t one = 1;
+        (void) !write(done_event.fd, &one, sizeof(one));
+    }
+    return NULL;
+}
+
+static void report(const job_t *job) {
+    const action_t *action = job->action;
+    double start = (job->started_ns - job->due_ns) / 1e9;
+    double run = (job->finished_ns - job->started_ns) / 1e9;
+
+    PTIMES_PROBE(pipeline_done, action->line, job->error, job->finished_ns - job->started_ns);
+    metrics_record(METRIC_PIPELINE_DELAY, job->started_ns - job->due_ns);
+    if (action->kind != KIND_EXEC)
+        metrics_record(METRIC_PIPELINE_RUN, job->finished_ns - job->started_ns);
+    metrics_count(METRIC_PIPELINE_RUNS);
+
+    if (job->error) {
+        metrics_count(METRIC_PIPELINE_MISSES);
+        if (job->status)
+            syslog(LOG_WARNING, "Action at line %d (%s %s) for %s failed with status %d",
+                action->line, kind_names[action->kind], action->target, TimeName[job->time_id],
+                job->status);
+        else
+            syslog(LOG_WARNING, "Action at line %d (%s %s) for %s failed: %s", action->line,
+                kind_names[action->kind], action->target, TimeName[job->time_id],
+                strerror(job->error));
+    } else {
+        syslog(LOG_DEBUG, "Action at line %d for %s started after %.3f s, took %.3f s",
+            action->line, TimeName[job->time_id], start, run);
+    }
+
+    if (test_out) {
+        fprintf(test_out, "line %d %s %s: %s", action->line, kind_names[action->kind],
+            action->target, job->error ? strerror(job->error) : "ok");
+        if (job->status)
+            fprintf(test_out, " (status %d)", job->status);
+        fprintf(test_out, ", started after %.3f s, took %.3f s\n", start, run);
+        if (job->error)
+            test_failures++;
+    }
+}
+
+static void done_callback(event_source_t *source, uint32_t events) {
+    job_t finished[ACTIONS_QUEUE];
+    uint64_t count;
+    int n;
+
+    (void) !read(source->fd, &count, sizeof(count));
+
+    pthread_mutex_lock(&lock);
+    n = done_count;
+    memcpy(finished, done, n * sizeof(job_t));
+    done_count = 0;
+    in_flight -= n;
+    pthread_mutex_unlock(&lock);
+
+    for (int i = 0; i < n; i++)
+        report(&finished[i]);
+}
+
+/* ---------------------- Firing ----------------------- */
+
+static void run_exec(job_t *job) {
+    const action_t *action = job->action;
+    char text[ACTION_TEXT_SIZE], tag[16], *argv[ACTION_ARGS + 2];
+    int argc = 0;
+
+    expand(action->text, job, text, sizeof(text));
+    argv[argc++] = (char *) action->target;
+    for (char *arg = strtok(text, " \t"); arg && argc <= ACTION_ARGS; arg = strtok(NULL, " \t"))
+        argv[argc++] = arg;
+    argv[argc] = NULL;
+
+    /* One tag per action, so a run overlapping the next is stopped */
+    snprintf(tag, sizeof(tag), "action %d", action->line);
+    job->started_ns = vclock_now_ns();
+    job->error = supervise_spawn(tag, action->target, argv, action->deadline) < 0 ? ECHILD : 0;
+    job->finished_ns = job->started_ns;
+    report(job);
+}
+
+static void fire(const action_t *action, const schedule_day_t *day, int time_id, int64_t due_ns) {
+    job_t job;
+
+    memset(&job, 0, sizeof(job));
+    job.action = action;
+    job.time_id = time_id;
+    job.epoch = day->epoch[time_id];
+    memcpy(job.time24, day->time24[time_id], sizeof(job.time24));
+    job.due_ns = due_ns;
+    PTIMES_PROBE(pipeline_start, action->line, time_id, vclock_now_ns() - due_ns);
+
+    if (sim_trace) {
+        time_t when = due_ns / 1000000000;
+        char local[32];
+
+        strftime(local, sizeof(local), "%Y-%m-%dT%H:%M:%S%z", localtime(&when));
+        fprintf(sim_trace, "%s,%s action %d,%ld\n", local, TimeName[time_id], action->line,
+            (long) when);
+        return;
+    }
+
+    if (action->kind == KIND_EXEC) {
+        run_exec(&job);
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    if (in_flight == ACTIONS_QUEUE) {
+        pthread_mutex_unlock(&lock);
+        syslog(LOG_WARNING, "Action queue full, dropping line %d for %s", action->line,
+            TimeName[time_id]);
+        metrics_count(METRIC_PIPELINE_DROPS);
+        return;
+    }
+    pending[(pending_head + pending_count) % ACTIONS_QUEUE] = job;
+    pending_count++;
+    in_flight++;
+    pthread_cond_signal(&queued);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * The days whose events can still have firings ahead. A positive offset
+ * past midnight belongs to an event of yesterday, which schedule_update()
+ * has already rotated out of schedule->days by then.
+ */
+static int firing_days(time_t now, const schedule_day_t *days[]) {
+    int count = 0;
+
+    schedule_update(schedule, now);
+    if (latest_offset > 0) {
+        long wanted = schedule->days[0].day - 1;
+        int d;
+
+        if (yesterday.day != wanted) {
+            for (d = 0; d < SCHEDULE_DAYS && seen[d].day != wanted; d++)
+                ;
+            if (d < SCHEDULE_DAYS)
+                yesterday = seen[d];
+            else
+                schedule_fetch_day(schedule, wanted, &yesterday);
+        }
+        memcpy(seen, schedule->days, sizeof(seen));
+        days[count++] = &yesterday;
+    }
+    for (int d = 0; d < SCHEDULE_DAYS; d++)
+        days[count++] = &schedule->days[d];
+    return count;
+}
+
+/* Start everything due in (fired_through, now] */
+static void fire_due(time_t now) {
+    const schedule_day_t *days[SCHEDULE_DAYS + 1];
+    int count = firing_days(now, days);
+
+    for (int d = 0; d < count; d++) {
+        const schedule_day_t *day = days[d];
+        for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+            if (day->epoch[i] < 0)
+                continue;
+            for (int a = 0; a < actions_count; a++) {
+                time_t when = day->epoch[i] + actions[a].offset;
+                if ((actions[a].events & (1 << i)) && when > fired_through && when <= now)
+                    fire(&actions[a], day, i, (int64_t) when * 1000000000);
+            }
+        }
+    }
+    fired_through = now;
+}
+
+static void timer_callback(event_source_t *source, uint32_t events) {
+    uint64_t expirations;
+    time_t now = vclock_now();
+
+    if (read(source->fd, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED) {
+        /* The clock was set, go on from the new time without catching up */
+        fired_through = now;
+    } else {
+        fire_due(now);
+    }
+    actions_rearm(now);
+}
+
+void actions_rearm(time_t now) {
+    const schedule_day_t *days[SCHEDULE_DAYS + 1];
+    struct itimerspec its;
+    time_t next = -1;
+    int count;
+
+    if (actions_count == 0)
+        return;
+
+    count = firing_days(now, days);
+    for (int d = 0; d < count; d++) {
+        const schedule_day_t *day = days[d];
+        for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+            if (day->epoch[i] < 0)
+                continue;
+            for (int a = 0; a < actions_count; a++) {
+                time_t when = day->epoch[i] + actions[a].offset;
+                if ((actions[a].events & (1 << i)) && when > fired_through && (next < 0 || when < next))
+                    next = when;
+            }
+        }
+    }
+
+    /* Nothing within today and tomorrow, look again later */
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next >= 0 ? next : now + 3600;
+    armed = its.it_value.tv_sec;
+    if (sim_trace)
+        return;
+    if (timerfd_settime(action_timer.fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL) < 0)
+        syslog(LOG_ERR, "Unable to arm action timer: %s", strerror(errno));
+}
+
+/* ---------------------- Interface ----------------------- */
+
+static void reset_days(void) {
+    for (int d = 0; d < SCHEDULE_DAYS; d++)
+        seen[d].day = -1;
+    yesterday.day = -1;
+}
+
+int actions_init(const char *path, int workers, schedule_t *sched) {
+    sigset_t all, saved;
+
+    if (workers < 1) {
+        syslog(LOG_ERR, "At least one action worker is needed");
+        return -1;
+    }
+    if (load(path) < 0)
+        return -1;
+    schedule = sched;
+    fired_through = vclock_now();
+    reset_days();
+
+    action_timer.fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    action_timer.callback = timer_callback;
+    action_timer.data = NULL;
+    done_event.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    done_event.callback = done_callback;
+    done_event.data = NULL;
+    if (action_timer.fd < 0 || done_event.fd < 0 || event_loop_add(&action_timer, EPOLLIN) < 0
+            || event_loop_add(&done_event, EPOLLIN) < 0) {
+        syslog(LOG_ERR, "Unable to set up the action pipeline: %s", strerror(errno));
+        return -1;
+    }
+
+    /* Signals are for the event loop thread only */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    for (int i = 0; i < workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker, NULL) != 0) {
+            syslog(LOG_ERR, "Unable to start action workers");
+            pthread_sigmask(SIG_SETMASK, &saved, NULL);
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    syslog(LOG_INFO, "Loaded %d actions from %s", actions_count, path);
+    return 0;
+}
+
+void actions_reset(time_t now) {
+    reset_days();
+    fired_through = now;
+}
+
+int actions_simulate(const char *path, schedule_t *sched, FILE *trace) {
+    if (load(path) < 0)
+        return -1;
+    schedule = sched;
+    fired_through = vclock_now();
+    reset_days();
+    sim_trace = trace;
+    return 0;
+}
+
+time_t actions_deadline(void) {
+    return actions_count > 0 ? armed : -1;
+}
+
+void actions_expire(time_t now) {
+    fire_due(now);
+    actions_rearm(now);
+}
+
+int actions_test(int time_id, time_t epoch, const char *time24, FILE *out) {
+    schedule_day_t day;
+    int64_t now = vclock_now_ns(), longest = 0;
+
+    memset(&day, 0, sizeof(day));
+    day.epoch[time_id] = epoch;
+    snprintf(day.time24[time_id], sizeof(day.time24[time_id]), "%s", time24);
+
+    test_out = out;
+    for (int a = 0; a < actions_count; a++) {
+        fire(&actions[a], &day, time_id, now);
+        if (actions[a].deadline > longest)
+            longest = actions[a].deadline;
+    }
+
+    /* Wait for the workers and for the commands, a little past the deadlines */
+    int64_t end = now + (longest + 1) * 1000000000;
+    while (vclock_now_ns() < end) {
+        pthread_mutex_lock(&lock);
+        int busy = in_flight;
+        pthread_mutex_unlock(&lock);
+        if (busy == 0 && supervise_running() == 0)
+            break;
+        event_loop_run_once(100);
+    }
+    test_out = NULL;
+    return test_failures ? -1 : 0;
+}
@@ -0,0 +1,79 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ACTIONS_H
+#define ACTIONS_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "schedule.h"
+
+/*
+ * Alert action pipeline. --actions names a file with one action per line,
+ * run at every matching event besides the azan:
+ *
+ *   offset deadline events kind target [text]
+ *
+ *   offset    seconds from the event, negative to fire before it
+ *   deadline  seconds after the firing time by which the action must end
+ *   events    comma separated names (fajr, sunrise, dhuhr, asr, sunset,
+ *             maghrib, isha), "prayers" or "all"
+ *   kind      exec   run target with text as its arguments
+ *             write  write text and a newline to the file target, e.g. a
+ *                    GPIO value or an LED display
+ *             http   POST text to target, http://host[:port]/path
+ *             mqtt   publish text to target, mqtt://host[:port]/topic
+ *
+ * In text, %p stands for the event name, %k for its lower case key, %t for
+ * the local time (HH:MM), %e for the epoch and %% for %; http and mqtt
+ * send a JSON object when text is empty. exec actions go through the
+ * supervisor, the others run on a bounded pool of worker threads; their
+ * results come back to the event loop for logging and metrics.
+ */
+
+#define ACTIONS_MAX 32
+#define ACTIONS_QUEUE 64        /* actions waiting for or running on a worker */
+
+/* Load the action file and start the worker threads, returns -1 on errors */
+int actions_init(const char *path, int workers, schedule_t *schedule);
+
+/* Arm the timer for the next firing, actions up to now have been handled */
+void actions_rearm(time_t now);
+
+/* Forget the days seen so far after the schedule was replaced, e.g. on reload */
+void actions_reset(time_t now);
+
+/*
+ * --simulate: take the actions of path, but write each firing to trace as
+ * a CSV line instead of running it. The caller drives the virtual clock
+ * to actions_deadline() and then calls actions_expire().
+ */
+int actions_simulate(const char *path, schedule_t *schedule, FILE *trace);
+
+/* The armed firing time, -1 without actions */
+time_t actions_deadline(void);
+
+/* What the timer does on expiry: start what is due and rearm */
+void actions_expire(time_t now);
+
+/*
+ * Run every action once, now, for the event time_id at epoch, wait for
+ * them to finish and write a line per action to out. Returns -1 if any
+ * of them failed.
+ */
+int actions_test(int time_id, time_t epoch, const char *time24, FILE *out);
+
+#endif /* ACTIONS_H */
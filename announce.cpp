@@ -0,0 +1,415 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include "announce.h"
+#include "eventloop.h"
+#include "ptimes_announce.h"
+#include "shmpub.h"
+
+static_assert(PTIMES_ANNOUNCE_DAYS == SCHEDULE_DAYS, "announcement layout out of sync");
+static_assert(PTIMES_ANNOUNCE_TIMES == PrayerTimes::TimesCount, "announcement layout out of sync");
+
+#define KEY_MIN 16
+#define KEY_MAX 256
+
+static unsigned char key[KEY_MAX];
+static size_t key_size = 0;
+static struct sockaddr_in group;
+
+static event_source_t sock;
+static event_source_t heartbeat;
+static struct ptimes_announce last;     /* sender: last datagram, listener: last accepted */
+static int have_last = 0;
+static int sending = 0;
+static time_t epochs[PTIMES_ANNOUNCE_DAYS][PTIMES_ANNOUNCE_TIMES];   /* sender: absolute times */
+static time_t next_epoch_sent;
+static uint32_t seq = 0;
+
+/* ---------------------- HMAC-SHA256 ----------------------- */
+
+typedef struct _sha256 {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t used;
+} sha256_t;
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(sha256_t *ctx, const unsigned char *p) {
+    uint32_t w[64], s[8];
+
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t) p[4 * i] << 24 | (uint32_t) p[4 * i + 1] << 16 | p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 64; i++)
+        w[i] = w[i - 16] + (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3))
+            + w[i - 7] + (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+    memcpy(s, ctx->state, sizeof(s));
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = s[7] + (ROTR(s[4], 6) ^ ROTR(s[4], 11) ^ ROTR(s[4], 25))
+            + ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR(s[0], 2) ^ ROTR(s[0], 13) ^ ROTR(s[0], 22))
+            + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(s + 1, s, 7 * sizeof(uint32_t));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++)
+        ctx->state[i] += s[i];
+}
+
+static void sha256_init(sha256_t *ctx) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void sha256_update(sha256_t *ctx, const void *data, size_t size) {
+    const unsigned char *p = (const unsigned char *) data;
+
+    ctx->length += size;
+    while (size > 0) {
+        size_t n = 64 - ctx->used < size ? 64 - ctx->used : size;
+        memcpy(ctx->block + ctx->used, p, n);
+        ctx->used += n;
+        p += n;
+        size -= n;
+        if (ctx->used == 64) {
+            sha256_block(ctx, ctx->block);
+            ctx->used = 0;
+        }
+    }
+}
+
+static void sha256_final(sha256_t *ctx, unsigned char digest[32]) {
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad = 0x80, zero = 0, length[8];
+
+    sha256_update(ctx, &pad, 1);
+    while (ctx->used != 56)
+        sha256_update(ctx, &zero, 1);
+    for (int i = 0; i < 8; i++)
+        length[i] = bits >> (56 - 8 * i);
+    sha256_update(ctx, length, 8);
+    for (int i = 0; i < 32; i++)
+        digest[i] = ctx->state[i / 4] >> (24 - 8 * (i % 4));
+}
+
+static void hmac_sha256(const void *data, size_t size, unsigned char mac[32]) {
+    unsigned char block[64], inner[32];
+    sha256_t ctx;
+
+    /* Longer keys are hashed first */
+    memset(block, 0, sizeof(block));
+    if (key_size > sizeof(block)) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, key, key_size);
+        sha256_final(&ctx, block);
+    } else {
+        memcpy(block, key, key_size);
+    }
+
+    for (int i = 0; i < 64; i++)
+        block[i] ^= 0x36;
+    sha256_init(&ctx);
+    sha256_update(&ctx, block, sizeof(block));
+    sha256_update(&ctx, data, size);
+    sha256_final(&ctx, inner);
+
+    for (int i = 0; i < 64; i++)
+        block[i] ^= 0x36 ^ 0x5c;
+    sha256_init(&ctx);
+    sha256_update(&ctx, block, sizeof(block));
+    sha256_update(&ctx, inner, sizeof(inner));
+    sha256_final(&ctx, mac);
+}
+
+static void sign(struct ptimes_announce *packet, unsigned char tag[PTIMES_ANNOUNCE_TAG_SIZE]) {
+    unsigned char mac[32];
+
+    hmac_sha256(packet, offsetof(struct ptimes_announce, tag), mac);
+    memcpy(tag, mac, PTIMES_ANNOUNCE_TAG_SIZE);
+}
+
+/* ---------------------- Setup ----------------------- */
+
+static int load_key(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    ssize_t n;
+
+    if (fd < 0) {
+        syslog(LOG_ERR, "Unable to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    n = read(fd, key, sizeof(key));
+    close(fd);
+    if (n < KEY_MIN) {
+        syslog(LOG_ERR, "%s must hold at least %d bytes of key", path, KEY_MIN);
+        return -1;
+    }
+    key_size = n;
+    return 0;
+}
+
+/* GROUP:PORT */
+static int parse_address(const char *address) {
+    char host[INET_ADDRSTRLEN];
+    const char *colon = strrchr(address, ':');
+    int port;
+
+    memset(&group, 0, sizeof(group));
+    if (colon == NULL || (size_t) (colon - address) >= sizeof(host)
+            || (port = atoi(colon + 1)) < 1 || port > 65535) {
+        syslog(LOG_ERR, "Invalid announce address %s, expected GROUP:PORT", address);
+        return -1;
+    }
+    snprintf(host, sizeof(host), "%.*s", (int) (colon - address), address);
+    group.sin_family = AF_INET;
+    group.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &group.sin_addr) != 1) {
+        syslog(LOG_ERR, "Invalid announce address %s, expected GROUP:PORT", address);
+        return -1;
+    }
+    return 0;
+}
+
+/* ---------------------- Sender ----------------------- */
+
+/* Times are relative to the sending time, so every resend rebases them */
+static void send_last(void) {
+    time_t now = time(NULL);
+
+    for (int d = 0; d < PTIMES_ANNOUNCE_DAYS; d++)
+        for (int i = 0; i < PTIMES_ANNOUNCE_TIMES; i++)
+            last.times[d][i] = htole32(epochs[d][i] < 0 ? PTIMES_ANNOUNCE_UNDEFINED
+                : (int32_t) (epochs[d][i] - now));
+    last.next = htole32(next_epoch_sent < 0 ? PTIMES_ANNOUNCE_UNDEFINED
+        : (int32_t) (next_epoch_sent - now));
+    last.seq = htole32(seq++);
+    last.sent = htole64((int64_t) now);
+    sign(&last, last.tag);
+    if (send(sock.fd, &last, sizeof(last), 0) < 0)
+        syslog(LOG_WARNING, "Unable to send announcement: %s", strerror(errno));
+}
+
+static void heartbeat_callback(event_source_t *source, uint32_t events) {
+    uint64_t expirations;
+
+    if (read(source->fd, &expirations, sizeof(expirations)) > 0 && have_last)
+        send_last();
+}
+
+int announce_init(const char *address, const char *key_path, int interval) {
+    unsigned char ttl = 1, loop = 1;
+    struct itimerspec its;
+
+    if (interval < 1 || interval > 65535) {
+        syslog(LOG_ERR, "Announce interval must be between 1 and 65535 seconds");
+        return -1;
+    }
+    if (parse_address(address) < 0 || load_key(key_path) < 0)
+        return -1;
+
+    /* One hop keeps the datagrams in the building, loop lets local listeners and tests see them */
+    sock.fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock.fd < 0 || setsockopt(sock.fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0
+            || setsockopt(sock.fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0
+            || connect(sock.fd, (struct sockaddr *) &group, sizeof(group)) < 0) {
+        syslog(LOG_ERR, "Unable to announce to %s: %s", address, strerror(errno));
+        return -1;
+    }
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = interval;
+    its.it_interval.tv_sec = interval;
+    heartbeat.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    heartbeat.callback = heartbeat_callback;
+    heartbeat.data = NULL;
+    if (heartbeat.fd < 0 || timerfd_settime(heartbeat.fd, 0, &its, NULL) < 0
+            || event_loop_add(&heartbeat, EPOLLIN) < 0) {
+        syslog(LOG_ERR, "Unable to create announce timer: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&last, 0, sizeof(last));
+    last.magic = htole32(PTIMES_ANNOUNCE_MAGIC);
+    last.version = PTIMES_ANNOUNCE_VERSION;
+    last.interval = htole16(interval);
+    sending = 1;
+    syslog(LOG_INFO, "Announcing the schedule to %s", address);
+    return 0;
+}
+
+void announce_publish(const schedule_t *schedule, int next_id, time_t next_epoch,
+        uint64_t config_hash) {
+    if (!sending)
+        return;
+
+    last.next_id = next_epoch >= 0 ? next_id : PTIMES_ANNOUNCE_NO_NEXT;
+    last.config_hash = htole64(config_hash);
+    last.first_day = htole32((int32_t) schedule->days[0].day);
+    for (int d = 0; d < PTIMES_ANNOUNCE_DAYS; d++)
+        for (int i = 0; i < PTIMES_ANNOUNCE_TIMES; i++)
+            epochs[d][i] = schedule->days[d].epoch[i];
+    next_epoch_sent = next_epoch;
+    have_last = 1;
+    send_last();
+}
+
+/* ---------------------- Listener ----------------------- */
+
+static int verify(const struct ptimes_announce *packet, ssize_t size) {
+    unsigned char tag[PTIMES_ANNOUNCE_TAG_SIZE], diff = 0;
+    struct ptimes_announce copy;
+
+    if (size != (ssize_t) sizeof(*packet) || le32toh(packet->magic) != PTIMES_ANNOUNCE_MAGIC
+            || packet->version != PTIMES_ANNOUNCE_VERSION)
+        return 0;
+    if (packet->next_id != PTIMES_ANNOUNCE_NO_NEXT && packet->next_id >= PTIMES_ANNOUNCE_TIMES)
+        return 0;
+
+    /* Constant time, the tag must not leak byte by byte */
+    memcpy(&copy, packet, sizeof(copy));
+    sign(&copy, tag);
+    for (int i = 0; i < PTIMES_ANNOUNCE_TAG_SIZE; i++)
+        diff |= tag[i] ^ packet->tag[i];
+    if (diff != 0)
+        return 0;
+
+    if (have_last) {
+        int64_t sent = (int64_t) le64toh(packet->sent), last_sent = (int64_t) le64toh(last.sent);
+        if (sent < last_sent || (sent == last_sent && le32toh(packet->seq) <= le32toh(last.seq)))
+            return 0;
+    }
+    return 1;
+}
+
+static void receive(const struct ptimes_announce *packet) {
+    static schedule_t received;
+    time_t sent = (time_t) (int64_t) le64toh(packet->sent);
+    int32_t next = (int32_t) le32toh(packet->next);
+    int next_id = packet->next_id == PTIMES_ANNOUNCE_NO_NEXT ? -1 : packet->next_id;
+    time_t next_epoch = next_id >= 0 && next != PTIMES_ANNOUNCE_UNDEFINED ? sent + next : -1;
+    int changed = !have_last || packet->next_id != last.next_id
+        || next_epoch != (time_t) (int64_t) le64toh(last.sent) + (int32_t) le32toh(last.next);
+
+    for (int d = 0; d < PTIMES_ANNOUNCE_DAYS; d++) {
+        schedule_day_t *day = &received.days[d];
+        day->day = (int32_t) le32toh(packet->first_day) + d;
+        for (int i = 0; i < PTIMES_ANNOUNCE_TIMES; i++) {
+            int32_t offset = (int32_t) le32toh(packet->times[d][i]);
+            struct tm tm;
+
+            day->time24[i][0] = 0;
+            day->epoch[i] = offset == PTIMES_ANNOUNCE_UNDEFINED ? -1 : sent + offset;
+            if (day->epoch[i] >= 0 && localtime_r(&day->epoch[i], &tm) != NULL)
+                strftime(day->time24[i], sizeof(day->time24[i]), "%H:%M", &tm);
+        }
+    }
+
+    memcpy(&last, packet, sizeof(last));
+    have_last = 1;
+    shmpub_publish(&received, next_id, next_epoch);
+
+    if (changed && next_epoch >= 0) {
+        char time24[6] = "";
+        struct tm tm;
+
+        if (localtime_r(&next_epoch, &tm) != NULL)
+            strftime(time24, sizeof(time24), "%H:%M", &tm);
+        printf("%s %s %ld\n", TimeName[next_id], time24, (long) next_epoch);
+        fflush(stdout);
+    }
+}
+
+static void listen_callback(event_source_t *source, uint32_t events) {
+    struct ptimes_announce packet;
+    ssize_t n;
+
+    while ((n = recv(source->fd, &packet, sizeof(packet), MSG_TRUNC)) >= 0) {
+        if (verify(&packet, n))
+            receive(&packet);
+        else
+            syslog(LOG_WARNING, "Dropped an invalid or replayed announcement");
+    }
+}
+
+int announce_listen(const char *address, const char *key_path) {
+    struct sockaddr_in local;
+    int reuse = 1;
+
+    if (parse_address(address) < 0 || load_key(key_path) < 0)
+        return -1;
+
+    /* Bind the port only, several listeners may share a host */
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = group.sin_port;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    sock.fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock.fd < 0 || setsockopt(sock.fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0
+            || bind(sock.fd, (struct sockaddr *) &local, sizeof(local)) < 0) {
+        syslog(LOG_ERR, "Unable to listen on %s: %s", address, strerror(errno));
+        return -1;
+    }
+    if (IN_MULTICAST(ntohl(group.sin_addr.s_addr))) {
+        struct ip_mreq mreq;
+
+        mreq.imr_multiaddr = group.sin_addr;
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(sock.fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+            syslog(LOG_ERR, "Unable to join %s: %s", address, strerror(errno));
+            return -1;
+        }
+    }
+
+    sock.callback = listen_callback;
+    sock.data = NULL;
+    if (event_loop_add(&sock, EPOLLIN) < 0) {
+        syslog(LOG_ERR, "Unable to watch %s: %s", address, strerror(errno));
+        return -1;
+    }
+    syslog(LOG_INFO, "Listening for announcements on %s", address);
+    return 0;
+}
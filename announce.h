@@ -0,0 +1,43 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANNOUNCE_H
+#define ANNOUNCE_H
+
+#include <stdint.h>
+
+#include "schedule.h"
+
+/*
+ * Signed UDP multicast of the schedule (ptimes_announce.h), so that one
+ * authoritative daemon serves the displays of a whole building. address
+ * is GROUP:PORT, e.g. 239.255.42.1:5454; key_path holds the shared key.
+ */
+
+/* Send every interval seconds and at each announce_publish() */
+int announce_init(const char *address, const char *key_path, int interval);
+
+/* Announce a new schedule or next prayer, a no-op without announce_init() */
+void announce_publish(const schedule_t *schedule, int next_id, time_t next_epoch,
+    uint64_t config_hash);
+
+/*
+ * Join the group and consume announcements: every verified one that
+ * changes the next prayer is printed to stdout and published through
+ * shmpub, without computing anything locally.
+ */
+int announce_listen(const char *address, const char *key_path);
+
+#endif /* ANNOUNCE_H */
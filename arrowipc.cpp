@@ -0,0 +1,455 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "arrowipc.h"
+#include "cmdline.h"
+#include "schedule.h"
+
+/*
+ * The IPC stream format is a sequence of encapsulated messages:
+ *
+ *   0xFFFFFFFF, int32 metadata size, flatbuffer Message, padding, body
+ *
+ * terminated by 0xFFFFFFFF 0x00000000. The flatbuffers are small and
+ * always have the same shape, so they are laid out by hand front to back,
+ * patching forward offsets once their targets are placed.
+ */
+
+#define FB_SIZE 4096
+#define FB_REF 0xff             /* field size of an offset to a later object */
+#define MAX_METHOD_NAME 16
+#define COLUMN_COUNT (4 + PrayerTimes::TimesCount)
+#define BUFFER_COUNT (3 * 2 + 3 + PrayerTimes::TimesCount * 2)
+
+enum {
+    METADATA_V5 = 4,
+    HEADER_SCHEMA = 1,
+    HEADER_RECORD_BATCH = 3,
+    TYPE_INT = 2,
+    TYPE_FLOATING_POINT = 3,
+    TYPE_UTF8 = 5,
+    TYPE_DATE = 8,
+    TYPE_TIME = 9,
+    PRECISION_DOUBLE = 2,
+    DATE_DAY = 0,
+    TIME_SECOND = 0,
+};
+
+typedef struct _fb {
+    size_t len;
+    uint8_t data[FB_SIZE];
+} fb_t;
+
+typedef struct _fb_field {
+    uint8_t size;               /* 0 if absent, 1, 2, 4, 8 or FB_REF */
+    uint64_t value;
+} fb_field_t;
+
+typedef struct _column {
+    const char *name;
+    uint8_t type;
+    int16_t unit;               /* precision or time unit */
+} column_t;
+
+static const uint8_t zeros[8] = { 0 };
+
+/* ---------------------- Flatbuffers ----------------------- */
+
+/* Pad until len + extra is a multiple of align */
+static void fb_align(fb_t *fb, size_t align, size_t extra) {
+    while ((fb->len + extra) % align)
+        fb->data[fb->len++] = 0;
+}
+
+static size_t fb_put(fb_t *fb, const void *data, size_t len) {
+    size_t at = fb->len;
+    if (len > 0)
+        memcpy(fb->data + fb->len, data, len);
+    fb->len += len;
+    return at;
+}
+
+static size_t fb_put32(fb_t *fb, uint32_t value) {
+    return fb_put(fb, &value, sizeof(value));
+}
+
+/* Point the offset field at `at` to the object at target */
+static void fb_patch(fb_t *fb, size_t at, size_t target) {
+    uint32_t offset = target - at;
+    memcpy(fb->data + at, &offset, sizeof(offset));
+}
+
+/*
+ * Vtable followed by its table. Fields are placed by decreasing size so
+ * that everything is naturally aligned; the positions of FB_REF fields
+ * are stored in refs for fb_patch.
+ */
+static size_t fb_table(fb_t *fb, const fb_field_t *fields, int count, size_t *refs) {
+    uint16_t vtable[2 + 8];
+    uint16_t size = 4;
+
+    for (int width = 8; width >= 1; width /= 2)
+        for (int i = 0; i < count; i++) {
+            int field_width = fields[i].size == FB_REF ? 4 : fields[i].size;
+            if (field_width != width)
+                continue;
+            vtable[2 + i] = size;
+            size += width;
+        }
+    for (int i = 0; i < count; i++)
+        if (fields[i].size == 0)
+            vtable[2 + i] = 0;
+    vtable[0] = (2 + count) * sizeof(uint16_t);
+    vtable[1] = size;
+
+    fb_align(fb, 2, 0);
+    size_t vtable_at = fb_put(fb, vtable, vtable[0]);
+    /* The soffset is followed by the 8 byte fields */
+    fb_align(fb, 8, 4);
+    size_t table = fb->len;
+    fb_put32(fb, table - vtable_at);
+    memset(fb->data + fb->len, 0, size - 4);
+    for (int i = 0; i < count; i++) {
+        if (fields[i].size == 0)
+            continue;
+        size_t at = table + vtable[2 + i];
+        if (fields[i].size == FB_REF)
+            refs[i] = at;
+        else
+            memcpy(fb->data + at, &fields[i].value, fields[i].size);
+    }
+    fb->len += size - 4;
+    return table;
+}
+
+static size_t fb_string(fb_t *fb, const char *s) {
+    size_t len = strlen(s);
+
+    fb_align(fb, 4, 0);
+    size_t at = fb_put32(fb, len);
+    fb_put(fb, s, len + 1);
+    return at;
+}
+
+/* Vector of count elements of size bytes, aligned for 8 byte members */
+static size_t fb_vector(fb_t *fb, const void *elements, uint32_t count, size_t size) {
+    fb_align(fb, 8, 4);
+    size_t at = fb_put32(fb, count);
+    fb_put(fb, elements, count * size);
+    return at;
+}
+
+/* Root offset and Message table, returns the position of the header offset */
+static size_t fb_message(fb_t *fb, uint8_t header_type, int64_t body_length) {
+    fb_field_t message[] = {
+        { 2, METADATA_V5 },
+        { 1, header_type },
+        { FB_REF, 0 },
+        { 8, (uint64_t) body_length },
+    };
+    size_t refs[4];
+
+    fb->len = 0;
+    fb_put32(fb, 0);
+    size_t table = fb_table(fb, message, 4, refs);
+    fb_patch(fb, 0, table);
+    return refs[2];
+}
+
+/* ---------------------- Schema ----------------------- */
+
+static const column_t columns[COLUMN_COUNT] = {
+    { "date", TYPE_DATE, DATE_DAY },
+    { "latitude", TYPE_FLOATING_POINT, PRECISION_DOUBLE },
+    { "longitude", TYPE_FLOATING_POINT, PRECISION_DOUBLE },
+    { "method", TYPE_UTF8, 0 },
+    { TimeKey[PrayerTimes::Fajr], TYPE_TIME, TIME_SECOND },
+    { TimeKey[PrayerTimes::Sunrise], TYPE_TIME, TIME_SECOND },
+    { TimeKey[PrayerTimes::Dhuhr], TYPE_TIME, TIME_SECOND },
+    { TimeKey[PrayerTimes::Asr], TYPE_TIME, TIME_SECOND },
+    { TimeKey[PrayerTimes::Sunset], TYPE_TIME, TIME_SECOND },
+    { TimeKey[PrayerTimes::Maghrib], TYPE_TIME, TIME_SECOND },
+    { TimeKey[PrayerTimes::Isha], TYPE_TIME, TIME_SECOND },
+};
+
+static size_t fb_type(fb_t *fb, const column_t *column) {
+    fb_field_t fields[2] = {
+        { 2, (uint64_t) column->unit },
+        { 4, 32 },
+    };
+    int count = 0;
+
+    if (column->type == TYPE_DATE || column->type == TYPE_FLOATING_POINT)
+        count = 1;
+    else if (column->type == TYPE_TIME)
+        count = 2;
+    return fb_table(fb, fields, count, NULL);
+}
+
+static void build_schema(fb_t *fb) {
+    uint32_t offsets[COLUMN_COUNT];
+    size_t refs[6];
+
+    size_t header = fb_message(fb, HEADER_SCHEMA, 0);
+    fb_field_t schema[] = {
+        { 0, 0 },               /* endianness, little by default */
+        { FB_REF, 0 },
+    };
+    size_t table = fb_table(fb, schema, 2, refs);
+    fb_patch(fb, header, table);
+
+    memset(offsets, 0, sizeof(offsets));
+    size_t vector = fb_vector(fb, offsets, COLUMN_COUNT, sizeof(uint32_t));
+    fb_patch(fb, refs[1], vector);
+
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        fb_field_t field[] = {
+            { FB_REF, 0 },      /* name */
+            { 1, 1 },           /* nullable */
+            { 1, columns[i].type },
+            { FB_REF, 0 },      /* type */
+            { 0, 0 },           /* dictionary */
+            { FB_REF, 0 },      /* children, readers insist on the vector */
+        };
+        size_t at = fb_table(fb, field, 6, refs);
+        fb_patch(fb, vector + 4 + i * 4, at);
+        fb_patch(fb, refs[0], fb_string(fb, columns[i].name));
+        fb_patch(fb, refs[3], fb_type(fb, &columns[i]));
+        fb_patch(fb, refs[5], fb_vector(fb, NULL, 0, 0));
+    }
+}
+
+/* ---------------------- Output ----------------------- */
+
+static int write_iov(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/* Continuation marker and size in front of the flatbuffer, padded to 8 */
+static void frame_message(fb_t *fb, uint32_t prefix[2]) {
+    fb_align(fb, 8, 0);
+    prefix[0] = 0xffffffff;
+    prefix[1] = fb->len;
+}
+
+int arrow_write_schema(int fd) {
+    static fb_t fb;
+    uint32_t prefix[2];
+
+    build_schema(&fb);
+    frame_message(&fb, prefix);
+
+    struct iovec iov[2] = {
+        { prefix, sizeof(prefix) },
+        { fb.data, fb.len },
+    };
+    return write_iov(fd, iov, 2);
+}
+
+int arrow_write_end(int fd) {
+    uint32_t eos[2] = { 0xffffffff, 0 };
+    struct iovec iov = { eos, sizeof(eos) };
+
+    return write_iov(fd, &iov, 1);
+}
+
+int arrow_write_batch(int fd, const arrow_columns_t *c) {
+    fb_t fb;
+    uint32_t prefix[2];
+    struct iovec iov[2 + BUFFER_COUNT * 2];
+    int64_t nodes[COLUMN_COUNT][2];
+    int64_t buffers[BUFFER_COUNT][2];
+    int64_t body = 0;
+    int iov_count = 2, buffer_count = 0;
+    int64_t rows = c->length;
+    int64_t bitmap = (rows + 7) / 8;
+
+    /* Body buffers in schema order, the iovecs point into the columns */
+#define ADD_BUFFER(data, len) do { \
+        int64_t size = (len); \
+        buffers[buffer_count][0] = body; \
+        buffers[buffer_count++][1] = size; \
+        if (size > 0) { \
+            iov[iov_count].iov_base = (void *) (data); \
+            iov[iov_count++].iov_len = size; \
+        } \
+        if (size % 8) { \
+            iov[iov_count].iov_base = (void *) zeros; \
+            iov[iov_count++].iov_len = 8 - size % 8; \
+        } \
+        body += (size + 7) / 8 * 8; \
+    } while (0)
+#define ADD_NODE(column, nulls, valid) do { \
+        nodes[column][0] = rows; \
+        nodes[column][1] = (nulls); \
+        ADD_BUFFER(valid, (nulls) ? bitmap : 0); \
+    } while (0)
+
+    ADD_NODE(0, c->invalid, c->row_valid);
+    ADD_BUFFER(c->date, rows * sizeof(int32_t));
+    ADD_NODE(1, c->invalid, c->row_valid);
+    ADD_BUFFER(c->latitude, rows * sizeof(double));
+    ADD_NODE(2, c->invalid, c->row_valid);
+    ADD_BUFFER(c->longitude, rows * sizeof(double));
+    ADD_NODE(3, c->invalid, c->row_valid);
+    ADD_BUFFER(c->method_offsets, (rows + 1) * sizeof(int32_t));
+    ADD_BUFFER(c->method_data, c->method_offsets[rows]);
+    for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+        ADD_NODE(4 + i, c->null_count[i], c->time_valid[i]);
+        ADD_BUFFER(c->seconds[i], rows * sizeof(int32_t));
+    }
+#undef ADD_NODE
+#undef ADD_BUFFER
+
+    size_t refs[3];
+    size_t header = fb_message(&fb, HEADER_RECORD_BATCH, body);
+    fb_field_t batch[] = {
+        { 8, (uint64_t) rows },
+        { FB_REF, 0 },          /* nodes */
+        { FB_REF, 0 },          /* buffers */
+    };
+    size_t table = fb_table(&fb, batch, 3, refs);
+    fb_patch(&fb, header, table);
+    fb_patch(&fb, refs[1], fb_vector(&fb, nodes, COLUMN_COUNT, sizeof(nodes[0])));
+    fb_patch(&fb, refs[2], fb_vector(&fb, buffers, buffer_count, sizeof(buffers[0])));
+    frame_message(&fb, prefix);
+
+    iov[0].iov_base = prefix;
+    iov[0].iov_len = sizeof(prefix);
+    iov[1].iov_base = fb.data;
+    iov[1].iov_len = fb.len;
+    return write_iov(fd, iov, iov_count);
+}
+
+/* ---------------------- Columns ----------------------- */
+
+int arrow_columns_init(arrow_columns_t *c, int64_t capacity) {
+    size_t bitmap = (capacity + 7) / 8;
+    int ok;
+
+    memset(c, 0, sizeof(*c));
+    c->capacity = capacity;
+    c->row_valid = (uint8_t *) malloc(bitmap);
+    c->date = (int32_t *) malloc(capacity * sizeof(int32_t));
+    c->latitude = (double *) malloc(capacity * sizeof(double));
+    c->longitude = (double *) malloc(capacity * sizeof(double));
+    c->method_offsets = (int32_t *) malloc((capacity + 1) * sizeof(int32_t));
+    c->method_data = (char *) malloc(capacity * MAX_METHOD_NAME);
+    ok = c->row_valid && c->date && c->latitude && c->longitude
+        && c->method_offsets && c->method_data;
+    for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+        c->time_valid[i] = (uint8_t *) malloc(bitmap);
+        c->seconds[i] = (int32_t *) malloc(capacity * sizeof(int32_t));
+        ok = ok && c->time_valid[i] && c->seconds[i];
+    }
+    if (!ok) {
+        arrow_columns_free(c);
+        return -1;
+    }
+    arrow_columns_clear(c);
+    return 0;
+}
+
+void arrow_columns_free(arrow_columns_t *c) {
+    free(c->row_valid);
+    free(c->date);
+    free(c->latitude);
+    free(c->longitude);
+    free(c->method_offsets);
+    free(c->method_data);
+    for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+        free(c->time_valid[i]);
+        free(c->seconds[i]);
+    }
+    memset(c, 0, sizeof(*c));
+}
+
+void arrow_columns_clear(arrow_columns_t *c) {
+    size_t bitmap = (c->capacity + 7) / 8;
+
+    c->length = 0;
+    c->invalid = 0;
+    c->method_offsets[0] = 0;
+    memset(c->row_valid, 0, bitmap);
+    for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+        c->null_count[i] = 0;
+        memset(c->time_valid[i], 0, bitmap);
+    }
+}
+
+void arrow_columns_append(arrow_columns_t *c, long day, double latitude,
+        double longitude, int method, const double *times) {
+    int64_t row = c->length++;
+    uint8_t bit = 1 << (row % 8);
+    int32_t offset = c->method_offsets[row];
+
+    /* Null slots still need defined contents */
+    c->date[row] = 0;
+    c->latitude[row] = 0;
+    c->longitude[row] = 0;
+    if (times == NULL) {
+        c->invalid++;
+        c->method_offsets[row + 1] = offset;
+        for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+            c->seconds[i][row] = 0;
+            c->null_count[i]++;
+        }
+        return;
+    }
+
+    const char *name = cmdline_parser_calc_method_values[method];
+    size_t len = strnlen(name, MAX_METHOD_NAME);
+    memcpy(c->method_data + offset, name, len);
+    c->method_offsets[row + 1] = offset + len;
+
+    c->row_valid[row / 8] |= bit;
+    c->date[row] = day;
+    c->latitude[row] = latitude;
+    c->longitude[row] = longitude;
+    for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+        int hours, minutes;
+        if (std::isnan(times[i])) {
+            c->seconds[i][row] = 0;
+            c->null_count[i]++;
+            continue;
+        }
+        PrayerTimes::get_float_time_parts(times[i], hours, minutes);
+        c->seconds[i][row] = (hours * 60 + minutes) * 60;
+        c->time_valid[i][row / 8] |= bit;
+    }
+}
@@ -0,0 +1,62 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ARROWIPC_H
+#define ARROWIPC_H
+
+#include <stdint.h>
+
+#include "prayertimes.hpp"
+
+/*
+ * Minimal Arrow IPC stream writer for timetables, without the Arrow
+ * library. Every row has the columns
+ *
+ *   date (date32), latitude, longitude (float64), method (utf8),
+ *   fajr ... isha (time32[s], seconds since local midnight)
+ *
+ * with nulls for times undefined at the latitude and for invalid input
+ * records. Rows are appended to column arrays (SoA) and each record batch
+ * is written straight from those arrays with writev.
+ */
+
+typedef struct _arrow_columns {
+    int64_t length;
+    int64_t capacity;
+    int64_t invalid;                /* rows that are null in every column */
+    int64_t null_count[PrayerTimes::TimesCount];
+    uint8_t *row_valid;             /* validity bitmaps, LSB first */
+    uint8_t *time_valid[PrayerTimes::TimesCount];
+    int32_t *date;                  /* days since 1970-01-01 */
+    double *latitude;
+    double *longitude;
+    int32_t *method_offsets;        /* length + 1 offsets into method_data */
+    char *method_data;
+    int32_t *seconds[PrayerTimes::TimesCount];
+} arrow_columns_t;
+
+int arrow_columns_init(arrow_columns_t *columns, int64_t capacity);
+void arrow_columns_free(arrow_columns_t *columns);
+void arrow_columns_clear(arrow_columns_t *columns);
+
+/* Add a row, times is NULL for an invalid record */
+void arrow_columns_append(arrow_columns_t *columns, long day, double latitude,
+    double longitude, int method, const double *times);
+
+int arrow_write_schema(int fd);
+int arrow_write_batch(int fd, const arrow_columns_t *columns);
+int arrow_write_end(int fd);
+
+#endif /* ARROWIPC_H */
@@ -0,0 +1,385 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <syslog.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "audio.h"
+#include "probes.h"
+
+#define AUDIO_CHUNK_FRAMES 1024
+#define AUDIO_LATENCY_US 100000
+#define AUDIO_RT_PRIORITY 10
+
+typedef struct _audio_format {
+    unsigned int rate;
+    unsigned int channels;
+    unsigned int bits;
+    unsigned int frame_size;
+} audio_format_t;
+
+typedef struct _audio_sink {
+    const char *name;
+    int (*open)(const audio_format_t *format, const char *device);
+    long (*write)(const uint8_t *frames, unsigned long count);
+    void (*close)(void);
+} audio_sink_t;
+
+enum {
+    AUDIO_IDLE,
+    AUDIO_PREPARE,
+    AUDIO_PLAY,
+};
+
+static const audio_sink_t *sink = NULL;
+static const char *sink_device = NULL;
+static audio_format_t format;
+static uint8_t *pcm = NULL;
+static size_t pcm_frames = 0;
+
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+static int request = AUDIO_IDLE;
+static int64_t requested_ns = 0;
+static int64_t started_ns = 0;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* ---------------------- Null Sink ----------------------- */
+
+static int null_open(const audio_format_t *format, const char *device) {
+    return 0;
+}
+
+static long null_write(const uint8_t *frames, unsigned long count) {
+    return count;
+}
+
+static void null_close(void) {
+}
+
+/* ---------------------- File Sink ----------------------- */
+
+static int file_fd = -1;
+
+static int file_open(const audio_format_t *format, const char *device) {
+    file_fd = open(device, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    return (file_fd < 0) ? -1 : 0;
+}
+
+/* Whole frames only, a pipe or FIFO reader must never see a split one */
+static long file_write(const uint8_t *frames, unsigned long count) {
+    size_t size = count * format.frame_size, done = 0;
+
+    while (done < size) {
+        ssize_t n = write(file_fd, frames + done, size - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        done += n;
+    }
+    return count;
+}
+
+static void file_close(void) {
+    close(file_fd);
+    file_fd = -1;
+}
+
+/* ---------------------- ALSA Sink ----------------------- */
+
+/* The few libasound entry points we need, values are part of its ABI */
+#define SND_PCM_STREAM_PLAYBACK 0
+#define SND_PCM_ACCESS_RW_INTERLEAVED 3
+#define SND_PCM_FORMAT_U8 1
+#define SND_PCM_FORMAT_S16_LE 2
+#define SND_PCM_FORMAT_S24_3LE 32
+#define SND_PCM_FORMAT_S32_LE 10
+
+static struct {
+    void *handle;
+    void *pcm;
+    int (*pcm_open)(void **pcm, const char *name, int stream, int mode);
+    int (*pcm_set_params)(void *pcm, int format, int access, unsigned int channels,
+        unsigned int rate, int soft_resample, unsigned int latency);
+    long (*pcm_writei)(void *pcm, const void *buffer, unsigned long size);
+    int (*pcm_recover)(void *pcm, int err, int silent);
+    int (*pcm_drain)(void *pcm);
+    int (*pcm_close)(void *pcm);
+    const char *(*strerror)(int errnum);
+} alsa;
+
+static int alsa_load(void) {
+    alsa.handle = dlopen("libasound.so.2", RTLD_NOW | RTLD_LOCAL);
+    if (alsa.handle == NULL) {
+        syslog(LOG_ERR, "Unable to load libasound: %s", dlerror());
+        return -1;
+    }
+
+    *(void **) &alsa.pcm_open = dlsym(alsa.handle, "snd_pcm_open");
+    *(void **) &alsa.pcm_set_params = dlsym(alsa.handle, "snd_pcm_set_params");
+    *(void **) &alsa.pcm_writei = dlsym(alsa.handle, "snd_pcm_writei");
+    *(void **) &alsa.pcm_recover = dlsym(alsa.handle, "snd_pcm_recover");
+    *(void **) &alsa.pcm_drain = dlsym(alsa.handle, "snd_pcm_drain");
+    *(void **) &alsa.pcm_close = dlsym(alsa.handle, "snd_pcm_close");
+    *(void **) &alsa.strerror = dlsym(alsa.handle, "snd_strerror");
+
+    if (!alsa.pcm_open || !alsa.pcm_set_params || !alsa.pcm_writei || !alsa.pcm_recover
+            || !alsa.pcm_drain || !alsa.pcm_close || !alsa.strerror) {
+        syslog(LOG_ERR, "libasound lacks the PCM interface");
+        return -1;
+    }
+    return 0;
+}
+
+static int alsa_open(const audio_format_t *format, const char *device) {
+    int pcm_format, rc;
+
+    switch (format->bits) {
+        case 8:  pcm_format = SND_PCM_FORMAT_U8; break;
+        case 16: pcm_format = SND_PCM_FORMAT_S16_LE; break;
+        case 24: pcm_format = SND_PCM_FORMAT_S24_3LE; break;
+        default: pcm_format = SND_PCM_FORMAT_S32_LE; break;
+    }
+
+    if ((rc = alsa.pcm_open(&alsa.pcm, device, SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
+        syslog(LOG_ERR, "Unable to open audio device %s: %s", device, alsa.strerror(rc));
+        return -1;
+    }
+    rc = alsa.pcm_set_params(alsa.pcm, pcm_format, SND_PCM_ACCESS_RW_INTERLEAVED,
+        format->channels, format->rate, 1, AUDIO_LATENCY_US);
+    if (rc < 0) {
+        syslog(LOG_ERR, "Unable to configure audio device %s: %s", device, alsa.strerror(rc));
+        alsa.pcm_close(alsa.pcm);
+        return -1;
+    }
+    return 0;
+}
+
+static long alsa_write(const uint8_t *frames, unsigned long count) {
+    long n = alsa.pcm_writei(alsa.pcm, frames, count);
+    if (n < 0)
+        n = alsa.pcm_recover(alsa.pcm, (int) n, 1);     /* underrun, try once more */
+    return (n < 0) ? -1 : n;
+}
+
+static void alsa_close(void) {
+    alsa.pcm_drain(alsa.pcm);
+    alsa.pcm_close(alsa.pcm);
+}
+
+static const audio_sink_t sinks[] = {
+    { "alsa", alsa_open, alsa_write, alsa_close },
+    { "file", file_open, file_write, file_close },
+    { "null", null_open, null_write, null_close },
+};
+
+/* ---------------------- WAV Decoding ----------------------- */
+
+static uint32_t le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+/* Load the PCM samples of a RIFF/WAVE file into a locked buffer */
+static int load_wav(const char *path) {
+    uint8_t *file = NULL;
+    struct stat st;
+    size_t pos = 12;
+    int fd, have_format = 0;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < 12) {
+        syslog(LOG_ERR, "Unable to read %s", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    file = (uint8_t *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED)
+        return -1;
+
+    if (memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0)
+        goto invalid;
+
+    while (pos + 8 <= (size_t) st.st_size) {
+        uint32_t size = le32(file + pos + 4);
+        const uint8_t *chunk = file + pos + 8;
+
+        if (size > st.st_size - pos - 8)
+            size = st.st_size - pos - 8;
+
+        if (memcmp(file + pos, "fmt ", 4) == 0 && size >= 16) {
+            /* Only uncompressed PCM (1) or its extensible form (0xfffe) */
+            if (le16(chunk) != 1 && le16(chunk) != 0xfffe)
+                goto invalid;
+            format.channels = le16(chunk + 2);
+            format.rate = le32(chunk + 4);
+            format.bits = le16(chunk + 14);
+            format.frame_size = format.channels * ((format.bits + 7) / 8);
+            have_format = (format.frame_size > 0);
+        } else if (memcmp(file + pos, "data", 4) == 0 && have_format) {
+            pcm_frames = size / format.frame_size;
+            pcm = (uint8_t *) malloc(pcm_frames * format.frame_size);
+            if (pcm == NULL)
+                break;
+            memcpy(pcm, chunk, pcm_frames * format.frame_size);
+            /* Keep the samples resident, playback must never page fault */
+            mlock(pcm, pcm_frames * format.frame_size);
+            munmap(file, st.st_size);
+            return 0;
+        }
+        pos += 8 + size + (size & 1);
+    }
+
+invalid:
+    syslog(LOG_ERR, "%s is not a PCM WAV file", path);
+    munmap(file, st.st_size);
+    return -1;
+}
+
+/* ---------------------- Playback Thread ----------------------- */
+
+static void *playback_thread(void *arg) {
+    int opened = 0;
+
+    pthread_mutex_lock(&lock);
+    while (true) {
+        while (request == AUDIO_IDLE)
+            pthread_cond_wait(&wakeup, &lock);
+
+        int what = request;
+        if (what == AUDIO_PREPARE)
+            request = AUDIO_IDLE;
+        pthread_mutex_unlock(&lock);
+
+        if (!opened)
+            opened = (sink->open(&format, sink_device) == 0);
+
+        if (what == AUDIO_PLAY && opened) {
+            size_t frame = 0;
+
+            while (frame < pcm_frames) {
+                unsigned long count = pcm_frames - frame;
+                if (count > AUDIO_CHUNK_FRAMES)
+                    count = AUDIO_CHUNK_FRAMES;
+                long n = sink->write(pcm + frame * format.frame_size, count);
+                if (n <= 0)
+                    break;
+                if (frame == 0) {
+                    __atomic_store_n(&started_ns, now_ns(), __ATOMIC_RELAXED);
+                    PTIMES_PROBE(audio_start, pcm_frames);
+                }
+                frame += n;
+            }
+            sink->close();
+            opened = 0;
+            PTIMES_PROBE(audio_done, frame);
+        }
+
+        pthread_mutex_lock(&lock);
+        if (what == AUDIO_PLAY)
+            request = AUDIO_IDLE;
+    }
+    return NULL;
+}
+
+static void audio_request(int what) {
+    pthread_mutex_lock(&lock);
+    if (request != AUDIO_PLAY) {
+        if (what == AUDIO_PLAY) {
+            requested_ns = now_ns();
+            __atomic_store_n(&started_ns, 0, __ATOMIC_RELAXED);
+        }
+        request = what;
+        pthread_cond_signal(&wakeup);
+    } else if (what == AUDIO_PLAY) {
+        syslog(LOG_INFO, "Azan is still playing, not starting it again");
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void audio_prepare(void) {
+    audio_request(AUDIO_PREPARE);
+}
+
+void audio_play(void) {
+    audio_request(AUDIO_PLAY);
+}
+
+void audio_last_start(int64_t *requested, int64_t *started) {
+    pthread_mutex_lock(&lock);
+    *requested = requested_ns;
+    pthread_mutex_unlock(&lock);
+    *started = __atomic_load_n(&started_ns, __ATOMIC_RELAXED);
+}
+
+int audio_init(const char *sink_name, const char *wav_path, const char *device) {
+    pthread_attr_t attr;
+    struct sched_param param;
+
+    for (size_t i = 0; i < sizeof(sinks) / sizeof(sinks[0]); i++)
+        if (strcmp(sinks[i].name, sink_name) == 0)
+            sink = &sinks[i];
+    if (sink == NULL) {
+        syslog(LOG_ERR, "Unknown audio sink %s", sink_name);
+        return -1;
+    }
+    if (sink->open == alsa_open && alsa_load() < 0)
+        return -1;
+    if (load_wav(wav_path) < 0)
+        return -1;
+    sink_device = device;
+
+    /* Prefer a real-time thread, fall back to a normal one without privileges */
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    param.sched_priority = AUDIO_RT_PRIORITY;
+    pthread_attr_setschedparam(&attr, &param);
+    if (pthread_create(&thread, &attr, playback_thread, NULL) != 0) {
+        if (pthread_create(&thread, NULL, playback_thread, NULL) != 0) {
+            pthread_attr_destroy(&attr);
+            return -1;
+        }
+        syslog(LOG_INFO, "Audio thread runs without real-time priority");
+    }
+    pthread_attr_destroy(&attr);
+
+    syslog(LOG_INFO, "Loaded %s: %u Hz, %u channels, %u bits, %zu frames (%s sink)",
+        wav_path, format.rate, format.channels, format.bits, pcm_frames, sink->name);
+    return 0;
+}
@@ -0,0 +1,44 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdint.h>
+
+/*
+ * In-process azan playback. The WAV file is decoded once into a locked PCM
+ * buffer and streamed by a dedicated real-time thread to one of the sinks:
+ *
+ *   alsa   ALSA PCM device (libasound is loaded at run time)
+ *   file   raw PCM written to a file, e.g. to measure start latency
+ *   null   discards the samples, for testing without hardware
+ */
+
+int audio_init(const char *sink, const char *wav_path, const char *device);
+
+/* Open the sink ahead of the event so that playback starts without delay */
+void audio_prepare(void);
+
+/* Start playback, returns immediately */
+void audio_play(void);
+
+/*
+ * Wall clock time in nanoseconds when the last playback was requested and
+ * when its first samples were handed to the sink, 0 if not yet known.
+ */
+void audio_last_start(int64_t *requested_ns, int64_t *started_ns);
+
+#endif /* AUDIO_H */
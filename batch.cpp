@@ -0,0 +1,781 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arrowipc.h"
+#include "batch.h"
+#include "citydb.h"
+#include "cmdline.h"
+#include "ptimes_batch.h"
+#include "schedule.h"
+#include "tzmap.h"
+
+#define CHUNK_BYTES (1 << 20)
+#define SLOTS_PER_THREAD 2      /* chunks in flight per worker */
+#define MAX_THREADS 256
+#define TZ_CACHE_SIZE 1024      /* must be a power of two */
+#define HOST_ZONE 0xffffffffu
+#define MAX_TEXT_TIMES (PrayerTimes::TimesCount * 6)
+#define CITY_CHUNK 4096         /* cities per chunk */
+#define MAX_CITY_LINE (CHUNK_BYTES / CITY_CHUNK)
+
+enum {
+    SLOT_FREE,
+    SLOT_READY,
+    SLOT_BUSY,
+    SLOT_DONE,
+};
+
+typedef struct _batch_record {
+    double latitude;
+    double longitude;
+    double timezone;            /* NAN: host time zone */
+    long day;
+    int method;
+    int valid;
+    const char *line;           /* text input only */
+    size_t line_len;
+} batch_record_t;
+
+/*
+ * A chunk of input and everything computed from it. The slots form the
+ * reorder buffer: chunk n always uses slot n % slot_count, so the reader
+ * cannot get more than slot_count chunks ahead of the writer.
+ */
+typedef struct _batch_slot {
+    int state;
+    long seq;
+    const char *data;
+    size_t len;
+    uint32_t first_city;        /* city source: cities first_city .. first_city + len */
+    char *buffer;               /* owned input when reading a stream */
+    batch_record_t *records;
+    size_t *order;
+    double *times;
+    size_t capacity;
+    char *out;
+    size_t out_len;
+    size_t out_capacity;
+    arrow_columns_t columns;    /* results of --batch-output=arrow */
+    long invalid;
+} batch_slot_t;
+
+typedef struct _tz_entry {
+    long day;
+    uint32_t zone;
+    double timezone;
+} tz_entry_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+static batch_slot_t *slots;
+static int slot_count;
+static long next_compute = 0;
+static long total = -1;         /* number of chunks, -1 until the input ended */
+static int failed = 0;
+static long invalid = 0;
+
+static pthread_mutex_t tz_lock = PTHREAD_MUTEX_INITIALIZER;
+static tz_entry_t tz_cache[TZ_CACHE_SIZE];
+static const tzmap_t *zones;    /* --auto-timezone, NULL for the host's zone */
+static uint32_t current_zone = HOST_ZONE;
+
+static const PrayerTimes *config;
+static uint32_t configs[PrayerTimes::CalculationMethodsCount];     /* config ids by method */
+static int binary;
+static int arrow;
+
+static const citydb_t *cities;  /* records come from the database instead of input */
+static uint32_t city_count;
+static uint32_t next_city;
+static long city_day;
+
+/* ---------------------- Records ----------------------- */
+
+/*
+ * localtime is not reentrant and days repeat a lot, so share the answers.
+ * With a time zone map TZ is switched under the lock as well; nothing else
+ * reads it while a batch runs.
+ */
+static double zone_timezone(uint32_t zone, long day) {
+    tz_entry_t *entry = &tz_cache[(day * 31 + zone) & (TZ_CACHE_SIZE - 1)];
+    double timezone;
+
+    pthread_mutex_lock(&tz_lock);
+    if (entry->day != day || entry->zone != zone) {
+        if (zone != current_zone) {
+            setenv("TZ", tzmap_name(zones, zone), 1);
+            tzset();
+            current_zone = zone;
+        }
+        entry->day = day;
+        entry->zone = zone;
+        entry->timezone = schedule_day_timezone(day);
+    }
+    timezone = entry->timezone;
+    pthread_mutex_unlock(&tz_lock);
+    return timezone;
+}
+
+static int parse_method(const char *s, size_t len) {
+    for (int i = 0; cmdline_parser_calc_method_values[i]; i++)
+        if (strlen(cmdline_parser_calc_method_values[i]) == len
+                && strncmp(s, cmdline_parser_calc_method_values[i], len) == 0)
+            return i;
+    return -2;
+}
+
+/* lat,lon,YYYY-MM-DD[,method[,tz]] */
+static void parse_line(batch_record_t *r) {
+    char field[5][32];
+    int fields = 0, year, month, mday;
+    const char *p = r->line, *end = r->line + r->line_len;
+    char *tail;
+
+    r->valid = 0;
+    for (;;) {
+        const char *comma = (const char *) memchr(p, ',', end - p);
+        size_t len = (comma ? comma : end) - p;
+        if (fields == 5 || len >= sizeof(field[0]))
+            return;
+        memcpy(field[fields], p, len);
+        field[fields++][len] = '\0';
+        if (comma == NULL)
+            break;
+        p = comma + 1;
+    }
+    if (fields < 3)
+        return;
+
+    r->latitude = strtod(field[0], &tail);
+    if (*tail || tail == field[0] || fabs(r->latitude) > 90)
+        return;
+    r->longitude = strtod(field[1], &tail);
+    if (*tail || tail == field[1] || fabs(r->longitude) > 180)
+        return;
+    if (sscanf(field[2], "%4d-%2d-%2d", &year, &month, &mday) != 3
+            || !PrayerTimes::is_valid_date(year, month, mday))
+        return;
+    r->day = PrayerTimes::days_from_civil(year, month, mday);
+
+    r->method = PTIMES_BATCH_DEFAULT_METHOD;
+    if (fields > 3 && field[3][0] && (r->method = parse_method(field[3], strlen(field[3]))) < 0)
+        return;
+
+    r->timezone = NAN;
+    if (fields > 4 && field[4][0]) {
+        r->timezone = strtod(field[4], &tail);
+        if (*tail || fabs(r->timezone) > 14)
+            return;
+    }
+    r->valid = 1;
+}
+
+static void parse_binary(batch_record_t *r, const struct ptimes_batch_record *in) {
+    r->latitude = in->latitude;
+    r->longitude = in->longitude;
+    r->day = in->day;
+    r->method = in->method;
+    r->timezone = in->tz_minutes == PTIMES_BATCH_HOST_TZ ? NAN : in->tz_minutes / 60.0;
+    r->valid = fabs(r->latitude) <= 90 && fabs(r->longitude) <= 180
+        && r->method >= PTIMES_BATCH_DEFAULT_METHOD && r->method < PrayerTimes::CalculationMethodsCount
+        && (std::isnan(r->timezone) || fabs(r->timezone) <= 14);
+}
+
+/* Order that puts records sharing a calculator setup and day next to each other */
+static int compare_records(const void *a, const void *b, void *arg) {
+    const batch_record_t *records = (const batch_record_t *) arg;
+    const batch_record_t *x = &records[*(const size_t *) a];
+    const batch_record_t *y = &records[*(const size_t *) b];
+
+    if (x->day != y->day)
+        return x->day < y->day ? -1 : 1;
+    if (x->method != y->method)
+        return x->method < y->method ? -1 : 1;
+    if (x->latitude != y->latitude)
+        return x->latitude < y->latitude ? -1 : 1;
+    if (x->longitude != y->longitude)
+        return x->longitude < y->longitude ? -1 : 1;
+    if (std::isnan(x->timezone) != std::isnan(y->timezone))
+        return std::isnan(x->timezone) ? -1 : 1;
+    if (x->timezone != y->timezone && !std::isnan(x->timezone))
+        return x->timezone < y->timezone ? -1 : 1;
+    return 0;
+}
+
+static int same_key(const batch_record_t *x, const batch_record_t *y) {
+    return x->day == y->day && x->method == y->method && x->latitude == y->latitude
+        && x->longitude == y->longitude
+        && (x->timezone == y->timezone || (std::isnan(x->timezone) && std::isnan(y->timezone)));
+}
+
+/* ---------------------- Chunks ----------------------- */
+
+static int reserve_records(batch_slot_t *slot, size_t count) {
+    if (count <= slot->capacity)
+        return 0;
+
+    size_t capacity = count + count / 2;
+    batch_record_t *records = (batch_record_t *) realloc(slot->records, capacity * sizeof(*records));
+    if (records)
+        slot->records = records;
+    size_t *order = (size_t *) realloc(slot->order, capacity * sizeof(*order));
+    if (order)
+        slot->order = order;
+    double *times = (double *) realloc(slot->times, capacity * PrayerTimes::TimesCount * sizeof(*times));
+    if (times)
+        slot->times = times;
+    if (!records || !order || !times)
+        return -1;
+    slot->capacity = capacity;
+    return 0;
+}
+
+static int reserve_out(batch_slot_t *slot, size_t len) {
+    if (len <= slot->out_capacity)
+        return 0;
+
+    char *out = (char *) realloc(slot->out, len);
+    if (out == NULL)
+        return -1;
+    slot->out = out;
+    slot->out_capacity = len;
+    return 0;
+}
+
+/* Records straight from the city table, the echoed line names the city */
+static size_t city_records(batch_slot_t *slot) {
+    size_t count = slot->len;
+    char *p = slot->buffer;
+
+    if (reserve_records(slot, count) < 0)
+        return (size_t) -1;
+    for (size_t i = 0; i < count; i++) {
+        const citydb_city_t *city = &cities->cities[slot->first_city + i];
+        batch_record_t *r = &slot->records[i];
+
+        r->latitude = city->latitude;
+        r->longitude = city->longitude;
+        r->day = city_day;
+        r->method = PTIMES_BATCH_DEFAULT_METHOD;
+        r->timezone = NAN;
+        r->valid = 1;
+        r->line = p;
+        r->line_len = snprintf(p, MAX_CITY_LINE, "%.*s,%.2s", MAX_CITY_LINE - 4,
+            citydb_name(cities, city), city->country);
+        if (r->line_len >= MAX_CITY_LINE)
+            r->line_len = MAX_CITY_LINE - 1;
+        p += r->line_len;
+    }
+    return count;
+}
+
+static size_t split_records(batch_slot_t *slot) {
+    size_t count = 0;
+
+    if (cities)
+        return city_records(slot);
+
+    if (binary) {
+        const struct ptimes_batch_record *in = (const struct ptimes_batch_record *) slot->data;
+        count = slot->len / sizeof(*in);
+        if (reserve_records(slot, count) < 0)
+            return (size_t) -1;
+        for (size_t i = 0; i < count; i++)
+            parse_binary(&slot->records[i], &in[i]);
+        return count;
+    }
+
+    for (const char *p = slot->data, *end = p + slot->len; p < end; ) {
+        const char *newline = (const char *) memchr(p, '\n', end - p);
+        const char *line_end = newline ? newline : end;
+        size_t len = line_end - p;
+
+        if (len > 0 && p[len - 1] == '\r')
+            len--;
+        if (len > 0) {
+            if (count == slot->capacity && reserve_records(slot, count + 1) < 0)
+                return (size_t) -1;
+            slot->records[count].line = p;
+            slot->records[count].line_len = len;
+            parse_line(&slot->records[count]);
+            count++;
+        }
+        p = line_end + 1;
+    }
+    return count;
+}
+
+static void compute_records(batch_slot_t *slot, size_t count) {
+    size_t valid = 0;
+    int default_method = config->get_calc_method();
+    long tz_day = -1;
+    uint32_t tz_zone = HOST_ZONE;
+    double local_tz = 0;
+    const batch_record_t *previous = NULL;
+
+    for (size_t i = 0; i < count; i++)
+        if (slot->records[i].valid)
+            slot->order[valid++] = i;
+    slot->invalid = count - valid;
+
+    qsort_r(slot->order, valid, sizeof(size_t), compare_records, slot->records);
+
+    for (size_t i = 0; i < valid; i++) {
+        size_t index = slot->order[i];
+        const batch_record_t *r = &slot->records[index];
+        double *times = &slot->times[index * PrayerTimes::TimesCount];
+
+        /* Duplicates are common in user tables, e.g. everybody in one city */
+        if (previous && same_key(previous, r)) {
+            memcpy(times, &slot->times[(previous - slot->records) * PrayerTimes::TimesCount],
+                PrayerTimes::TimesCount * sizeof(double));
+            continue;
+        }
+
+        int method = r->method == PTIMES_BATCH_DEFAULT_METHOD ? default_method : r->method;
+        PrayerTimes prayer_times = PrayerTimes::from_config_id(configs[method]);
+
+        double timezone = r->timezone;
+        if (std::isnan(timezone)) {
+            uint32_t zone = zones ? tzmap_zone(zones, r->latitude, r->longitude) : HOST_ZONE;
+            if (r->day != tz_day || zone != tz_zone) {
+                tz_day = r->day;
+                tz_zone = zone;
+                local_tz = zone_timezone(zone, r->day);
+            }
+            timezone = local_tz;
+        }
+
+        prayer_times.get_prayer_times_range(r->day, 1, r->latitude, r->longitude, timezone, times);
+        previous = r;
+    }
+}
+
+/* The SoA columns are the record batch, the writer sends them as they are */
+static int fill_columns(batch_slot_t *slot, size_t count) {
+    arrow_columns_t *columns = &slot->columns;
+    int default_method = config->get_calc_method();
+
+    if ((size_t) columns->capacity < count) {
+        arrow_columns_free(columns);
+        if (arrow_columns_init(columns, count + count / 2) < 0)
+            return -1;
+    }
+    arrow_columns_clear(columns);
+
+    for (size_t i = 0; i < count; i++) {
+        const batch_record_t *r = &slot->records[i];
+        int method = r->method == PTIMES_BATCH_DEFAULT_METHOD ? default_method : r->method;
+        arrow_columns_append(columns, r->day, r->latitude, r->longitude, method,
+            r->valid ? &slot->times[i * PrayerTimes::TimesCount] : NULL);
+    }
+    return 0;
+}
+
+static int format_records(batch_slot_t *slot, size_t count) {
+    if (arrow)
+        return fill_columns(slot, count);
+    if (binary) {
+        if (reserve_out(slot, count * sizeof(struct ptimes_batch_result)) < 0)
+            return -1;
+
+        struct ptimes_batch_result *out = (struct ptimes_batch_result *) slot->out;
+        for (size_t i = 0; i < count; i++) {
+            const double *times = &slot->times[i * PrayerTimes::TimesCount];
+            memset(&out[i], 0, sizeof(out[i]));
+            out[i].status = slot->records[i].valid ? PTIMES_BATCH_OK : PTIMES_BATCH_INVALID;
+            for (int t = 0; t < PrayerTimes::TimesCount; t++) {
+                int hours, minutes;
+                if (!slot->records[i].valid || std::isnan(times[t])) {
+                    out[i].minutes[t] = -1;
+                    continue;
+                }
+                PrayerTimes::get_float_time_parts(times[t], hours, minutes);
+                out[i].minutes[t] = hours * 60 + minutes;
+            }
+        }
+        slot->out_len = count * sizeof(struct ptimes_batch_result);
+        return 0;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; i < count; i++)
+        len += slot->records[i].line_len + MAX_TEXT_TIMES + 1;
+    if (reserve_out(slot, len) < 0)
+        return -1;
+
+    char *p = slot->out;
+    for (size_t i = 0; i < count; i++) {
+        const batch_record_t *r = &slot->records[i];
+        const double *times = &slot->times[i * PrayerTimes::TimesCount];
+
+        memcpy(p, r->line, r->line_len);
+        p += r->line_len;
+        for (int t = 0; t < PrayerTimes::TimesCount; t++) {
+            char time24[6];
+            *p++ = ',';
+            if (!r->valid)
+                continue;
+            PrayerTimes::float_time_to_time24(times[t], time24);
+            memcpy(p, time24, 5);
+            p += time24[0] ? 5 : 0;
+        }
+        *p++ = '\n';
+    }
+    slot->out_len = p - slot->out;
+    return 0;
+}
+
+static int process_slot(batch_slot_t *slot) {
+    size_t count = split_records(slot);
+
+    if (count == (size_t) -1)
+        return -1;
+    compute_records(slot, count);
+    return format_records(slot, count);
+}
+
+/* ---------------------- Threads ----------------------- */
+
+static void *worker_thread(void *arg) {
+    pthread_mutex_lock(&lock);
+    while (!failed && (total < 0 || next_compute < total)) {
+        batch_slot_t *slot = &slots[next_compute % slot_count];
+
+        if (slot->state != SLOT_READY || slot->seq != next_compute) {
+            pthread_cond_wait(&changed, &lock);
+            continue;
+        }
+        slot->state = SLOT_BUSY;
+        next_compute++;
+        pthread_mutex_unlock(&lock);
+
+        int rc = process_slot(slot);
+
+        pthread_mutex_lock(&lock);
+        if (rc < 0) {
+            perror("ERROR");
+            failed = 1;
+        }
+        slot->state = SLOT_DONE;
+        pthread_cond_broadcast(&changed);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+static int write_all(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Writes the chunks strictly in input order and hands their slots back */
+static void *writer_thread(void *arg) {
+    for (long seq = 0; ; seq++) {
+        batch_slot_t *slot = &slots[seq % slot_count];
+
+        pthread_mutex_lock(&lock);
+        while (!failed && !(total >= 0 && seq >= total)
+                && !(slot->state == SLOT_DONE && slot->seq == seq))
+            pthread_cond_wait(&changed, &lock);
+        if (failed || (total >= 0 && seq >= total)) {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        pthread_mutex_unlock(&lock);
+
+        int rc;
+        if (arrow)
+            rc = slot->columns.length > 0 ? arrow_write_batch(STDOUT_FILENO, &slot->columns) : 0;
+        else
+            rc = write_all(slot->out, slot->out_len);
+
+        pthread_mutex_lock(&lock);
+        if (rc < 0) {
+            perror("ERROR");
+            failed = 1;
+        }
+        invalid += slot->invalid;
+        slot->state = SLOT_FREE;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+/* ---------------------- Input ----------------------- */
+
+typedef struct _batch_source {
+    int fd;
+    const char *map;            /* whole input when it could be mapped */
+    size_t map_len;
+    size_t pos;
+    char carry[CHUNK_BYTES];    /* partial line or record left by the last read */
+    size_t carry_len;
+    int eof;
+} batch_source_t;
+
+static size_t chunk_limit(void) {
+    return binary ? CHUNK_BYTES / sizeof(struct ptimes_batch_record)
+        * sizeof(struct ptimes_batch_record) : CHUNK_BYTES;
+}
+
+/* Complete records at the start of data, the rest belongs to the next chunk */
+static size_t complete_part(const char *data, size_t len, int last) {
+    if (binary)
+        return len / sizeof(struct ptimes_batch_record) * sizeof(struct ptimes_batch_record);
+    if (last)
+        return len;
+
+    const char *newline = (const char *) memrchr(data, '\n', len);
+    return newline ? newline - data + 1 : 0;
+}
+
+/* Point slot at the next chunk, returns 0 at the end of the input */
+static int read_chunk(batch_source_t *src, batch_slot_t *slot) {
+    size_t limit = chunk_limit();
+
+    if (cities) {
+        if (next_city == city_count)
+            return 0;
+        if (slot->buffer == NULL && (slot->buffer = (char *) malloc(CHUNK_BYTES)) == NULL) {
+            perror("ERROR");
+            return -1;
+        }
+        slot->first_city = next_city;
+        slot->len = city_count - next_city < CITY_CHUNK ? city_count - next_city : CITY_CHUNK;
+        next_city += slot->len;
+        return 1;
+    }
+
+    if (src->map) {
+        size_t len = src->map_len - src->pos;
+        int last = len <= limit;
+
+        if (len == 0)
+            return 0;
+        if (!last)
+            len = complete_part(src->map + src->pos, limit, 0);
+        if (len == 0) {
+            fprintf(stderr, "%s: input line longer than %d bytes\n", CMDLINE_PARSER_PACKAGE, CHUNK_BYTES);
+            return -1;
+        }
+        slot->data = src->map + src->pos;
+        slot->len = len;
+        src->pos += len;
+        return 1;
+    }
+
+    if (slot->buffer == NULL && (slot->buffer = (char *) malloc(CHUNK_BYTES)) == NULL) {
+        perror("ERROR");
+        return -1;
+    }
+
+    size_t len = src->carry_len;
+    memcpy(slot->buffer, src->carry, len);
+    while (!src->eof && len < limit) {
+        ssize_t n = read(src->fd, slot->buffer + len, limit - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            perror("ERROR");
+            return -1;
+        }
+        if (n == 0)
+            src->eof = 1;
+        len += n;
+    }
+    if (len == 0)
+        return 0;
+
+    size_t complete = complete_part(slot->buffer, len, src->eof);
+    if (complete == 0) {
+        fprintf(stderr, "%s: %s\n", CMDLINE_PARSER_PACKAGE, binary ?
+            "truncated record at the end of the input" : "input line too long");
+        return -1;
+    }
+    src->carry_len = len - complete;
+    memcpy(src->carry, slot->buffer + complete, src->carry_len);
+    slot->data = slot->buffer;
+    slot->len = complete;
+    return 1;
+}
+
+static int open_source(batch_source_t *src, const char *path) {
+    struct stat st;
+
+    src->map = NULL;
+    src->pos = 0;
+    src->carry_len = 0;
+    src->eof = 0;
+    src->fd = path ? open(path, O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+    if (src->fd < 0)
+        return -1;
+
+    /* Regular files are mapped, pipes are read chunk by chunk */
+    if (fstat(src->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, src->fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            src->map = (const char *) map;
+            src->map_len = st.st_size;
+        }
+    }
+    return 0;
+}
+
+static int run(const char *path, int threads) {
+    static batch_source_t src;
+    pthread_t workers[MAX_THREADS], writer;
+    long seq;
+    int rc = 0;
+
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    if (threads < 1)
+        threads = 1;
+
+    for (int i = 0; i < TZ_CACHE_SIZE; i++)
+        tz_cache[i].day = -1;
+    current_zone = HOST_ZONE;
+
+    /* Records switch methods freely, the workers only pick the interned views */
+    for (int i = 0; i < PrayerTimes::CalculationMethodsCount; i++) {
+        PrayerTimes variant = *config;
+        variant.set_calc_method((PrayerTimes::CalculationMethod) i);
+        configs[i] = variant.get_config_id();
+    }
+
+    if (!cities && open_source(&src, path) < 0) {
+        perror(path);
+        return -1;
+    }
+
+    slot_count = threads * SLOTS_PER_THREAD;
+    slots = (batch_slot_t *) calloc(slot_count, sizeof(batch_slot_t));
+    if (slots == NULL)
+        return -1;
+
+    if (arrow && arrow_write_schema(STDOUT_FILENO) < 0) {
+        perror("ERROR");
+        free(slots);
+        return -1;
+    }
+
+    pthread_create(&writer, NULL, writer_thread, NULL);
+    for (int i = 0; i < threads; i++)
+        pthread_create(&workers[i], NULL, worker_thread, NULL);
+
+    for (seq = 0; ; seq++) {
+        batch_slot_t *slot = &slots[seq % slot_count];
+
+        pthread_mutex_lock(&lock);
+        while (!failed && slot->state != SLOT_FREE)
+            pthread_cond_wait(&changed, &lock);
+        pthread_mutex_unlock(&lock);
+        if (failed)
+            break;
+
+        int more = read_chunk(&src, slot);
+
+        pthread_mutex_lock(&lock);
+        if (more <= 0) {
+            if (more < 0)
+                failed = 1;
+            total = seq;
+            pthread_cond_broadcast(&changed);
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        slot->seq = seq;
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+    }
+
+    for (int i = 0; i < threads; i++)
+        pthread_join(workers[i], NULL);
+    pthread_join(writer, NULL);
+
+    if (!failed && arrow && arrow_write_end(STDOUT_FILENO) < 0) {
+        perror("ERROR");
+        failed = 1;
+    }
+    if (failed)
+        rc = -1;
+    if (invalid > 0)
+        fprintf(stderr, "%s: %ld invalid records\n", CMDLINE_PARSER_PACKAGE, invalid);
+
+    for (int i = 0; i < slot_count; i++) {
+        free(slots[i].buffer);
+        free(slots[i].records);
+        free(slots[i].order);
+        free(slots[i].times);
+        free(slots[i].out);
+        arrow_columns_free(&slots[i].columns);
+    }
+    free(slots);
+    if (src.map)
+        munmap((void *) src.map, src.map_len);
+    if (path)
+        close(src.fd);
+    return rc;
+}
+
+int batch_run(const PrayerTimes *prayer_times, const char *path, int binary_records, int arrow_output,
+        int threads) {
+    config = prayer_times;
+    binary = binary_records;
+    arrow = arrow_output;
+    cities = NULL;
+    return run(path, threads);
+}
+
+int batch_run_cities(const PrayerTimes *prayer_times, const citydb_t *db, uint32_t min_population,
+        long day, int arrow_output, int threads) {
+    config = prayer_times;
+    binary = 0;
+    arrow = arrow_output;
+    cities = db;
+    city_count = citydb_count_over(db, min_population);
+    next_city = 0;
+    city_day = day;
+    return run(NULL, threads);
+}
+
+void batch_use_tzmap(const tzmap_t *map) {
+    zones = map;
+}
@@ -0,0 +1,46 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "citydb.h"
+#include "prayertimes.hpp"
+#include "tzmap.h"
+
+/*
+ * Bulk mode of --batch: records from path (stdin when NULL) are split into
+ * chunks, computed by threads workers and written to stdout in input
+ * order. At most a fixed number of chunks is in flight, so memory use does
+ * not depend on the input size. See ptimes_batch.h for the formats; with
+ * arrow the results are an Arrow IPC stream, one record batch per chunk.
+ */
+int batch_run(const PrayerTimes *prayer_times, const char *path, int binary, int arrow,
+    int threads);
+
+/*
+ * Same for every city of db with at least min_population people, on day in
+ * the host's time zone. Text lines start with "Name,CC".
+ */
+int batch_run_cities(const PrayerTimes *prayer_times, const citydb_t *db, uint32_t min_population,
+    long day, int arrow, int threads);
+
+/*
+ * Records without a UTC offset use the zone of their location instead of
+ * the host's. TZ is left at the last zone used.
+ */
+void batch_use_tzmap(const tzmap_t *map);
+
+#endif /* BATCH_H */
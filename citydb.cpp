@@ -0,0 +1,587 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "citydb.h"
+#include "schedcache.h"
+
+#define EARTH_RADIUS_KM 6371.0088
+#define MAX_KEY 256
+#define KEYS_PER_BUCKET 4
+#define MAX_SEED 100000         /* give up instead of spinning on a bad dump */
+#define DUMP_FIELDS 19
+
+/* GeoNames dump columns */
+enum {
+    DUMP_NAME = 1,
+    DUMP_ASCII_NAME = 2,
+    DUMP_LATITUDE = 4,
+    DUMP_LONGITUDE = 5,
+    DUMP_FEATURE_CLASS = 6,
+    DUMP_COUNTRY = 8,
+    DUMP_POPULATION = 14,
+};
+
+typedef struct _buffer {
+    char *data;
+    size_t len;
+    size_t capacity;
+} buffer_t;
+
+typedef struct _key {
+    uint64_t hash;
+    uint32_t text;              /* offset into the key buffer */
+    uint32_t city;
+    uint32_t bucket;
+} key_t_;
+
+/* ---------------------- Hashing ----------------------- */
+
+static uint64_t key_hash(const char *key) {
+    return schedcache_hash(SCHEDCACHE_HASH_INIT, key, strlen(key));
+}
+
+/* splitmix64 finalizer, displaces a key within the table */
+static uint32_t slot_of(uint64_t hash, uint32_t seed, uint32_t slots) {
+    uint64_t x = hash ^ (seed * 0x9e3779b97f4a7c15ull);
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x % slots;
+}
+
+/* Lower case copy for the name index, spaces after the comma dropped */
+static void normalize(char *key, const char *name, size_t size) {
+    size_t len = 0;
+
+    for (const char *p = name; *p && len + 1 < size; p++) {
+        if (*p == ' ' && len > 0 && key[len - 1] == ',')
+            continue;
+        key[len++] = tolower((unsigned char) *p);
+    }
+    key[len] = '\0';
+}
+
+static void unit_vector(double latitude, double longitude, float v[3]) {
+    double lat = latitude * M_PI / 180, lon = longitude * M_PI / 180;
+
+    v[0] = cos(lat) * cos(lon);
+    v[1] = cos(lat) * sin(lon);
+    v[2] = sin(lat);
+}
+
+/* ---------------------- Building ----------------------- */
+
+static int buffer_add(buffer_t *b, const void *data, size_t len) {
+    if (b->len + len > b->capacity) {
+        size_t capacity = (b->len + len) * 2;
+        char *grown = (char *) realloc(b->data, capacity);
+        if (grown == NULL)
+            return -1;
+        b->data = grown;
+        b->capacity = capacity;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+static int buffer_add_string(buffer_t *b, const char *s, uint32_t *offset) {
+    *offset = b->len;
+    return buffer_add(b, s, strlen(s) + 1);
+}
+
+/*
+ * Append a populated place of the dump to cities. Its name and ascii name
+ * go to names, city.name points there until the strings are laid out.
+ */
+static int parse_dump_line(char *line, buffer_t *cities, buffer_t *names) {
+    char *field[DUMP_FIELDS];
+    int count = 0;
+    citydb_city_t city;
+    uint32_t ascii;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    for (char *p = line; count < DUMP_FIELDS; ) {
+        field[count++] = p;
+        p = strchr(p, '\t');
+        if (p == NULL)
+            break;
+        *p++ = '\0';
+    }
+    if (count <= DUMP_POPULATION || strcmp(field[DUMP_FEATURE_CLASS], "P") != 0)
+        return 0;
+
+    memset(&city, 0, sizeof(city));
+    city.latitude = strtod(field[DUMP_LATITUDE], NULL);
+    city.longitude = strtod(field[DUMP_LONGITUDE], NULL);
+    city.population = strtoul(field[DUMP_POPULATION], NULL, 10);
+    memcpy(city.country, field[DUMP_COUNTRY], strnlen(field[DUMP_COUNTRY], 2));
+    if (!field[DUMP_NAME][0] || fabs(city.latitude) > 90 || fabs(city.longitude) > 180)
+        return 0;
+
+    if (buffer_add_string(names, field[DUMP_NAME], &city.name) < 0
+            || buffer_add_string(names, field[DUMP_ASCII_NAME], &ascii) < 0
+            || buffer_add(cities, &city, sizeof(city)) < 0)
+        return -1;
+    return 1;
+}
+
+static const citydb_city_t *sort_cities;
+
+static int compare_population(const void *a, const void *b) {
+    const citydb_city_t *x = &sort_cities[*(const uint32_t *) a];
+    const citydb_city_t *y = &sort_cities[*(const uint32_t *) b];
+
+    if (x->population != y->population)
+        return x->population > y->population ? -1 : 1;
+    return *(const uint32_t *) a < *(const uint32_t *) b ? -1 : 1;
+}
+
+static const char *sort_text;
+
+static int compare_keys(const void *a, const void *b) {
+    const key_t_ *x = (const key_t_ *) a, *y = (const key_t_ *) b;
+
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    int rc = strcmp(sort_text + x->text, sort_text + y->text);
+    if (rc != 0)
+        return rc;
+    return x->city < y->city ? -1 : x->city > y->city;
+}
+
+static int compare_buckets(const void *a, const void *b) {
+    const key_t_ *x = (const key_t_ *) a, *y = (const key_t_ *) b;
+    return x->bucket < y->bucket ? -1 : x->bucket > y->bucket;
+}
+
+/* Implicit k-d tree: the middle of each range splits it on depth % 3 */
+static void build_tree(citydb_node_t *nodes, uint32_t lo, uint32_t hi, int depth) {
+    if (hi - lo <= 1)
+        return;
+
+    uint32_t mid = lo + (hi - lo) / 2;
+    int axis = depth % 3;
+    std::nth_element(nodes + lo, nodes + mid, nodes + hi,
+        [axis](const citydb_node_t &a, const citydb_node_t &b) {
+            return (&a.x)[axis] < (&b.x)[axis];
+        });
+    build_tree(nodes, lo, mid, depth + 1);
+    build_tree(nodes, mid + 1, hi, depth + 1);
+}
+
+/*
+ * Hash and displace: buckets are placed largest first, each trying seeds
+ * until all of its keys land on free slots.
+ */
+static int build_index(key_t_ *keys, uint32_t count, uint32_t buckets, uint32_t slots,
+        uint32_t *seeds, citydb_slot_t *table) {
+    uint32_t *order = (uint32_t *) malloc((buckets + 1) * sizeof(uint32_t));
+    uint32_t *start = (uint32_t *) calloc(buckets + 1, sizeof(uint32_t));
+    uint32_t wanted[MAX_KEY];
+    int rc = -1;
+
+    if (order == NULL || start == NULL)
+        goto out;
+
+    for (uint32_t i = 0; i < count; i++)
+        keys[i].bucket = keys[i].hash % buckets;
+    qsort(keys, count, sizeof(*keys), compare_buckets);
+    for (uint32_t i = 0; i < count; i++)
+        start[keys[i].bucket + 1]++;
+    for (uint32_t b = 0; b < buckets; b++) {
+        start[b + 1] += start[b];
+        order[b] = b;
+    }
+    std::sort(order, order + buckets, [start](uint32_t a, uint32_t b) {
+        uint32_t size_a = start[a + 1] - start[a], size_b = start[b + 1] - start[b];
+        return size_a != size_b ? size_a > size_b : a < b;
+    });
+
+    for (uint32_t s = 0; s < slots; s++)
+        table[s].city = CITYDB_NONE;
+    memset(seeds, 0, buckets * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < buckets; i++) {
+        uint32_t b = order[i], size = start[b + 1] - start[b];
+        uint32_t seed;
+
+        if (size == 0)
+            break;
+        if (size > MAX_KEY)
+            goto out;
+        for (seed = 0; seed < MAX_SEED; seed++) {
+            uint32_t k;
+            for (k = 0; k < size; k++) {
+                wanted[k] = slot_of(keys[start[b] + k].hash, seed, slots);
+                if (table[wanted[k]].city != CITYDB_NONE
+                        || std::find(wanted, wanted + k, wanted[k]) != wanted + k)
+                    break;
+            }
+            if (k == size)
+                break;
+        }
+        if (seed == MAX_SEED)
+            goto out;
+        seeds[b] = seed;
+        for (uint32_t k = 0; k < size; k++) {
+            table[wanted[k]].key = keys[start[b] + k].text;
+            table[wanted[k]].city = keys[start[b] + k].city;
+        }
+    }
+    rc = 0;
+out:
+    free(order);
+    free(start);
+    return rc;
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = (const char *) data;
+
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t) 7;
+}
+
+/* Sections at their header offsets, replaces path atomically */
+static int write_file(const char *path, citydb_header_t *header, const citydb_city_t *cities,
+        const citydb_node_t *tree, const uint32_t *seeds, const citydb_slot_t *slots,
+        const char *strings) {
+    struct {
+        uint64_t offset;
+        const void *data;
+        size_t len;
+    } sections[] = {
+        { 0, header, sizeof(*header) },
+        { header->cities_offset, cities, header->count * sizeof(*cities) },
+        { header->tree_offset, tree, header->count * sizeof(*tree) },
+        { header->seeds_offset, seeds, header->buckets * sizeof(*seeds) },
+        { header->slots_offset, slots, header->slots * sizeof(*slots) },
+        { header->strings_offset, strings, header->strings_size },
+    };
+    static const char zeros[8] = { 0 };
+    char tmp[PATH_MAX];
+    uint64_t written = 0;
+    int fd, ok = 1;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    for (size_t i = 0; ok && i < sizeof(sections) / sizeof(sections[0]); i++) {
+        ok = write_all(fd, zeros, sections[i].offset - written) == 0
+            && write_all(fd, sections[i].data, sections[i].len) == 0;
+        written = sections[i].offset + sections[i].len;
+    }
+    if (close(fd) != 0 || !ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+long citydb_build(const char *dump, const char *path) {
+    buffer_t cities = { 0 }, names = { 0 }, text = { 0 }, strings = { 0 };
+    citydb_header_t header;
+    citydb_city_t *sorted = NULL;
+    citydb_node_t *tree = NULL;
+    uint32_t *order = NULL, *seeds = NULL;
+    citydb_slot_t *slots = NULL;
+    key_t_ *keys = NULL;
+    uint32_t count, key_count = 0, unique = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    long rc = -1;
+    FILE *in;
+
+    if ((in = fopen(dump, "r")) == NULL) {
+        perror(dump);
+        return -1;
+    }
+    while (getline(&line, &line_size, in) > 0)
+        if (parse_dump_line(line, &cities, &names) < 0)
+            goto nomem;
+    free(line);
+    fclose(in);
+
+    count = cities.len / sizeof(citydb_city_t);
+    if (count == 0) {
+        fprintf(stderr, "%s: no populated places found\n", dump);
+        goto out;
+    }
+
+    order = (uint32_t *) malloc(count * sizeof(uint32_t));
+    sorted = (citydb_city_t *) malloc(count * sizeof(citydb_city_t));
+    keys = (key_t_ *) malloc(count * 4 * sizeof(key_t_));
+    tree = (citydb_node_t *) malloc(count * sizeof(citydb_node_t));
+    if (!order || !sorted || !keys || !tree)
+        goto nomem;
+
+    for (uint32_t i = 0; i < count; i++)
+        order[i] = i;
+    sort_cities = (const citydb_city_t *) cities.data;
+    qsort(order, count, sizeof(uint32_t), compare_population);
+
+    /* Display names first, every city is known by up to four keys */
+    for (uint32_t i = 0; i < count; i++) {
+        sorted[i] = sort_cities[order[i]];
+        const char *name = names.data + sorted[i].name;
+        const char *ascii = name + strlen(name) + 1;
+        char key[MAX_KEY];
+
+        if (buffer_add_string(&strings, name, &sorted[i].name) < 0)
+            goto nomem;
+        for (int k = 0; k < 4; k++) {
+            char full[MAX_KEY];
+            snprintf(full, sizeof(full), k < 2 ? "%s" : "%s,%.2s", k % 2 ? ascii : name,
+                sorted[i].country);
+            normalize(key, full, sizeof(key));
+            if (!key[0])
+                continue;
+            keys[key_count].hash = key_hash(key);
+            keys[key_count].city = i;
+            if (buffer_add_string(&text, key, &keys[key_count].text) < 0)
+                goto nomem;
+            key_count++;
+        }
+    }
+
+    /* The largest city keeps a shared key */
+    sort_text = text.data;
+    qsort(keys, key_count, sizeof(key_t_), compare_keys);
+    for (uint32_t i = 0; i < key_count; i++) {
+        if (unique > 0 && keys[unique - 1].hash == keys[i].hash
+                && strcmp(text.data + keys[i].text, strings.data + keys[unique - 1].text) == 0)
+            continue;
+        keys[unique] = keys[i];
+        if (buffer_add_string(&strings, text.data + keys[i].text, &keys[unique].text) < 0)
+            goto nomem;
+        unique++;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = CITYDB_MAGIC;
+    header.version = CITYDB_VERSION;
+    header.count = count;
+    header.buckets = unique / KEYS_PER_BUCKET + 1;
+    header.slots = unique + unique / 4 + 1;
+    header.strings_size = strings.len;
+    header.cities_offset = align8(sizeof(header));
+    header.tree_offset = align8(header.cities_offset + count * sizeof(citydb_city_t));
+    header.seeds_offset = align8(header.tree_offset + count * sizeof(citydb_node_t));
+    header.slots_offset = align8(header.seeds_offset + header.buckets * sizeof(uint32_t));
+    header.strings_offset = align8(header.slots_offset + header.slots * sizeof(citydb_slot_t));
+
+    seeds = (uint32_t *) malloc(header.buckets * sizeof(uint32_t));
+    slots = (citydb_slot_t *) malloc(header.slots * sizeof(citydb_slot_t));
+    if (!seeds || !slots)
+        goto nomem;
+    if (build_index(keys, unique, header.buckets, header.slots, seeds, slots) < 0) {
+        fprintf(stderr, "%s: unable to build the name index\n", dump);
+        goto out;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        unit_vector(sorted[i].latitude, sorted[i].longitude, &tree[i].x);
+        tree[i].city = i;
+    }
+    build_tree(tree, 0, count, 0);
+
+    if (write_file(path, &header, sorted, tree, seeds, slots, strings.data) < 0) {
+        perror(path);
+        goto out;
+    }
+    rc = count;
+    goto out;
+
+nomem:
+    perror("ERROR");
+out:
+    free(cities.data);
+    free(names.data);
+    free(text.data);
+    free(strings.data);
+    free(order);
+    free(sorted);
+    free(keys);
+    free(tree);
+    free(seeds);
+    free(slots);
+    return rc;
+}
+
+/* ---------------------- Lookups ----------------------- */
+
+int citydb_open(citydb_t *db, const char *path) {
+    struct stat st;
+    int fd;
+
+    memset(db, 0, sizeof(*db));
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(citydb_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    const citydb_header_t *h = (const citydb_header_t *) map;
+    uint64_t size = st.st_size;
+    const char *base = (const char *) map;
+
+    /* Sections must lie inside the file, strings must end in a NUL */
+    if (h->magic != CITYDB_MAGIC || h->version != CITYDB_VERSION || h->count == 0
+            || h->buckets == 0 || h->slots == 0 || h->strings_size == 0
+            || h->cities_offset + (uint64_t) h->count * sizeof(citydb_city_t) > size
+            || h->tree_offset + (uint64_t) h->count * sizeof(citydb_node_t) > size
+            || h->seeds_offset + (uint64_t) h->buckets * sizeof(uint32_t) > size
+            || h->slots_offset + (uint64_t) h->slots * sizeof(citydb_slot_t) > size
+            || h->strings_offset + h->strings_size > size
+            || base[h->strings_offset + h->strings_size - 1] != '\0'
+            || (h->cities_offset | h->tree_offset | h->seeds_offset | h->slots_offset) % 8) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    db->map = map;
+    db->size = st.st_size;
+    db->header = h;
+    db->cities = (const citydb_city_t *) (base + h->cities_offset);
+    db->tree = (const citydb_node_t *) (base + h->tree_offset);
+    db->seeds = (const uint32_t *) (base + h->seeds_offset);
+    db->slots = (const citydb_slot_t *) (base + h->slots_offset);
+    db->strings = base + h->strings_offset;
+    return 0;
+}
+
+void citydb_close(citydb_t *db) {
+    if (db->map)
+        munmap((void *) db->map, db->size);
+    memset(db, 0, sizeof(*db));
+}
+
+const char *citydb_name(const citydb_t *db, const citydb_city_t *city) {
+    return city->name < db->header->strings_size ? db->strings + city->name : "";
+}
+
+const citydb_city_t *citydb_find(const citydb_t *db, const char *name) {
+    char key[MAX_KEY];
+
+    normalize(key, name, sizeof(key));
+    uint64_t hash = key_hash(key);
+    uint32_t seed = db->seeds[hash % db->header->buckets];
+    const citydb_slot_t *slot = &db->slots[slot_of(hash, seed, db->header->slots)];
+
+    if (slot->city >= db->header->count || slot->key >= db->header->strings_size
+            || strcmp(db->strings + slot->key, key) != 0)
+        return NULL;
+    return &db->cities[slot->city];
+}
+
+typedef struct _nearest {
+    float point[3];
+    float best;                 /* squared chord length */
+    uint32_t city;
+} nearest_t;
+
+static void search_tree(const citydb_node_t *nodes, uint32_t lo, uint32_t hi, int depth,
+        nearest_t *n) {
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const citydb_node_t *node = &nodes[mid];
+        float dx = n->point[0] - node->x, dy = n->point[1] - node->y, dz = n->point[2] - node->z;
+        float d2 = dx * dx + dy * dy + dz * dz;
+        int axis = depth % 3;
+        float diff = n->point[axis] - (&node->x)[axis];
+
+        if (d2 < n->best) {
+            n->best = d2;
+            n->city = node->city;
+        }
+        /* Near side first, the far side only when the splitting plane is closer */
+        if (diff < 0) {
+            search_tree(nodes, lo, mid, depth + 1, n);
+            if (diff * diff >= n->best)
+                return;
+            lo = mid + 1;
+        } else {
+            search_tree(nodes, mid + 1, hi, depth + 1, n);
+            if (diff * diff >= n->best)
+                return;
+            hi = mid;
+        }
+        depth++;
+    }
+}
+
+const citydb_city_t *citydb_nearest(const citydb_t *db, double latitude, double longitude,
+        double *distance) {
+    nearest_t n;
+
+    unit_vector(latitude, longitude, n.point);
+    n.best = INFINITY;
+    n.city = CITYDB_NONE;
+    search_tree(db->tree, 0, db->header->count, 0, &n);
+    if (n.city >= db->header->count)
+        return NULL;
+    if (distance)
+        *distance = 2 * asin(fmin(sqrt(n.best) / 2, 1)) * EARTH_RADIUS_KM;
+    return &db->cities[n.city];
+}
+
+uint32_t citydb_count_over(const citydb_t *db, uint32_t population) {
+    uint32_t lo = 0, hi = db->header->count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (db->cities[mid].population >= population)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
@@ -0,0 +1,104 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CITYDB_H
+#define CITYDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * City database (--citydb), built once from a GeoNames dump such as
+ * cities15000.txt and then used straight from a read-only mapping:
+ *
+ *   header
+ *   cities      sorted by population, largest first
+ *   tree        implicit k-d tree over unit vectors, for nearest lookups
+ *   seeds       hash-and-displace seed per bucket of the name index
+ *   slots       perfect hash table, one slot per name key
+ *   strings     display names and lower case name keys
+ *
+ * Every city is found by its lower case name and ascii name, with or
+ * without ",CC" appended. When several cities share a key the largest
+ * one owns it.
+ */
+
+#define CITYDB_MAGIC 0x44435450         /* "PTCD" */
+#define CITYDB_VERSION 1
+#define CITYDB_NONE 0xffffffffu
+
+typedef struct _citydb_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t buckets;
+    uint32_t slots;
+    uint32_t strings_size;
+    uint64_t cities_offset;
+    uint64_t tree_offset;
+    uint64_t seeds_offset;
+    uint64_t slots_offset;
+    uint64_t strings_offset;
+} citydb_header_t;
+
+typedef struct _citydb_city {
+    float latitude;
+    float longitude;
+    uint32_t population;
+    uint32_t name;                      /* offset into strings */
+    char country[2];                    /* ISO 3166 code */
+    uint16_t reserved;
+} citydb_city_t;
+
+typedef struct _citydb_node {
+    float x, y, z;
+    uint32_t city;
+} citydb_node_t;
+
+typedef struct _citydb_slot {
+    uint32_t key;                       /* offset into strings */
+    uint32_t city;                      /* CITYDB_NONE when unused */
+} citydb_slot_t;
+
+typedef struct _citydb {
+    const void *map;
+    size_t size;
+    const citydb_header_t *header;
+    const citydb_city_t *cities;
+    const citydb_node_t *tree;
+    const uint32_t *seeds;
+    const citydb_slot_t *slots;
+    const char *strings;
+} citydb_t;
+
+/* Build path from a GeoNames dump, returns the number of cities or -1 */
+long citydb_build(const char *dump, const char *path);
+
+int citydb_open(citydb_t *db, const char *path);
+void citydb_close(citydb_t *db);
+
+/* Case insensitive (ASCII) lookup of "Name" or "Name,CC", NULL if unknown */
+const citydb_city_t *citydb_find(const citydb_t *db, const char *name);
+
+/* City closest to the point on the sphere, distance in km if not NULL */
+const citydb_city_t *citydb_nearest(const citydb_t *db, double latitude, double longitude,
+    double *distance);
+
+/* Number of cities with at least population people, they come first */
+uint32_t citydb_count_over(const citydb_t *db, uint32_t population);
+
+const char *citydb_name(const citydb_t *db, const citydb_city_t *city);
+
+#endif /* CITYDB_H */
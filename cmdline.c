@@ -45,6 +45,46 @@ const char *gengetopt_args_info_help[] = {
   "      --fajr-angle=INT          angle for calculating Fajr prayer time",
   "      --maghrib-angle=INT       angle for calculating Maghrib prayer time",
   "      --isha-angle=INT          angle for calculating Isha prayer time",
+  "      --serve                   answer prayer time queries over HTTP",
+  "      --http-address=STRING     address the HTTP server listens on  \n                                  (default=`127.0.0.1')",
+  "      --http-port=INT           port the HTTP server listens on  \n                                  (default=`8080')",
+  "      --query-socket=PATH       answer local queries on this Unix domain socket",
+  "      --query-allow-uids=UIDS   comma separated uids allowed to query besides \n                                  root and the daemon user",
+  "      --shm-file=PATH           publish the schedule in this shared memory \n                                  file, e.g. /dev/shm/ptimes",
+  "      --audio-sink=STRING       how to play the azan  (possible values=\"aplay\", \n                                  \"alsa\", \"file\", \"null\" default=`aplay')",
+  "      --azan-file=PATH          WAV file played at prayer time  \n                                  (default=`/usr/share/sounds/ptimes/azan.wav')",
+  "      --audio-device=NAME       ALSA device, or output file of the file sink  \n                                  (default=`default')",
+  "      --metrics-file=PATH       write alert latency metrics to a node_exporter \n                                  textfile",
+  "      --metrics-interval=SECONDS\n                                seconds between metrics textfile updates  \n                                  (default=`60')",
+  "      --cache-file=PATH         keep the upcoming schedule in this file for \n                                  fast restarts",
+  "      --print                   print a timetable to stdout and exit",
+  "      --from=YYYY-MM-DD         first day of the timetable (default today)",
+  "      --days=N                  number of days in the timetable  (default=`1')",
+  "      --format=STRING           timetable format  (possible values=\"csv\", \n                                  \"json\", \"tsv\", \"arrow\" default=`csv')",
+  "      --batch                   compute the records read from --input or stdin \n                                  and exit",
+  "      --input=PATH              input file of --batch",
+  "      --batch-format=STRING     record format of --batch  (possible \n                                  values=\"text\", \"binary\" default=`text')",
+  "      --threads=N               worker threads of --batch, 0 for one per CPU  \n                                  (default=`0')",
+  "      --batch-output=STRING     output of --batch, results in the record format \n                                  or an Arrow IPC stream  (possible \n                                  values=\"records\", \"arrow\" default=`records')",
+  "      --city=NAME               take latitude and longitude from the city \n                                  database, NAME or NAME,CC",
+  "      --citydb=PATH             city database of --city  \n                                  (default=`/usr/share/ptimes/cities.db')",
+  "      --build-citydb=PATH       build --citydb from a GeoNames dump (e.g. \n                                  cities15000.txt) and exit",
+  "      --nearest-city            print the city closest to the location and exit",
+  "      --min-population=N        with --batch, compute every city of at least N \n                                  people on --from instead of reading records",
+  "      --auto-timezone           use the time zone of the location from --tzmap \n                                  instead of the host time zone",
+  "      --tzmap=PATH              time zone map of --auto-timezone  \n                                  (default=`/usr/share/ptimes/tzmap.db')",
+  "      --build-tzmap=PATH        build --tzmap from zone polygons in WKT CSV and \n                                  exit",
+  "      --simulate                run the daemon on a simulated clock over --from \n                                  and --days, print every fired event and exit",
+  "      --trace=PATH              write the events of --simulate to this file \n                                  instead of stdout",
+  "      --action-timeout=SECONDS  kill an alert action still running after this \n                                  many seconds, 0 for no limit  (default=`900')",
+  "      --max-actions=N           alert actions allowed to run at the same time  \n                                  (default=`2')",
+  "      --actions=PATH            run the alert actions of this file around each \n                                  event (see README)",
+  "      --action-workers=N        threads running the write, http and mqtt \n                                  actions of --actions  (default=`4')",
+  "      --test-actions            run every action of --actions once for the next \n                                  prayer, report and exit",
+  "      --announce=GROUP:PORT     multicast the schedule to this group, e.g. \n                                  239.255.42.1:5454",
+  "      --announce-key=PATH       shared key file signing the announcements  \n                                  (default=`/etc/ptimes/announce.key')",
+  "      --announce-interval=SECONDS\n                                seconds between repeated announcements  \n                                  (default=`60')",
+  "      --listen=GROUP:PORT       only consume the announcements of this group \n                                  and publish them",
     0
 };
 
@@ -93,6 +133,10 @@ free_cmd_list(void)
 const char *cmdline_parser_calc_method_values[] = {"jafari", "karachi", "isna", "mwl", "makkah", "egypt", "custom", 0}; /*< Possible values for calc-method. */
 const char *cmdline_parser_asr_juristic_method_values[] = {"shafii", "hanafi", 0}; /*< Possible values for asr-juristic-method. */
 const char *cmdline_parser_high_lats_method_values[] = {"none", "midnight", "oneseventh", "anglebased", 0}; /*< Possible values for high-lats-method. */
+const char *cmdline_parser_audio_sink_values[] = {"aplay", "alsa", "file", "null", 0}; /*< Possible values for audio-sink. */
+const char *cmdline_parser_format_values[] = {"csv", "json", "tsv", "arrow", 0}; /*< Possible values for format. */
+const char *cmdline_parser_batch_format_values[] = {"text", "binary", 0}; /*< Possible values for batch-format. */
+const char *cmdline_parser_batch_output_values[] = {"records", "arrow", 0}; /*< Possible values for batch-output. */
 
 static char *
 gengetopt_strdup (const char *s);
@@ -113,6 +157,46 @@ void clear_given (struct gengetopt_args_info *args_info)
   args_info->fajr_angle_given = 0 ;
   args_info->maghrib_angle_given = 0 ;
   args_info->isha_angle_given = 0 ;
+  args_info->serve_given = 0 ;
+  args_info->http_address_given = 0 ;
+  args_info->http_port_given = 0 ;
+  args_info->query_socket_given = 0 ;
+  args_info->query_allow_uids_given = 0 ;
+  args_info->shm_file_given = 0 ;
+  args_info->audio_sink_given = 0 ;
+  args_info->azan_file_given = 0 ;
+  args_info->audio_device_given = 0 ;
+  args_info->metrics_file_given = 0 ;
+  args_info->metrics_interval_given = 0 ;
+  args_info->cache_file_given = 0 ;
+  args_info->print_given = 0 ;
+  args_info->from_given = 0 ;
+  args_info->days_given = 0 ;
+  args_info->format_given = 0 ;
+  args_info->batch_given = 0 ;
+  args_info->input_given = 0 ;
+  args_info->batch_format_given = 0 ;
+  args_info->threads_given = 0 ;
+  args_info->batch_output_given = 0 ;
+  args_info->city_given = 0 ;
+  args_info->citydb_given = 0 ;
+  args_info->build_citydb_given = 0 ;
+  args_info->nearest_city_given = 0 ;
+  args_info->min_population_given = 0 ;
+  args_info->auto_timezone_given = 0 ;
+  args_info->tzmap_given = 0 ;
+  args_info->build_tzmap_given = 0 ;
+  args_info->simulate_given = 0 ;
+  args_info->trace_given = 0 ;
+  args_info->action_timeout_given = 0 ;
+  args_info->max_actions_given = 0 ;
+  args_info->actions_given = 0 ;
+  args_info->action_workers_given = 0 ;
+  args_info->test_actions_given = 0 ;
+  args_info->announce_given = 0 ;
+  args_info->announce_key_given = 0 ;
+  args_info->announce_interval_given = 0 ;
+  args_info->listen_given = 0 ;
 }
 
 static
@@ -133,6 +217,71 @@ void clear_args (struct gengetopt_args_info *args_info)
   args_info->fajr_angle_orig = NULL;
   args_info->maghrib_angle_orig = NULL;
   args_info->isha_angle_orig = NULL;
+  args_info->http_address_arg = gengetopt_strdup ("127.0.0.1");
+  args_info->http_address_orig = NULL;
+  args_info->http_port_arg = 8080;
+  args_info->http_port_orig = NULL;
+  args_info->query_socket_arg = NULL;
+  args_info->query_socket_orig = NULL;
+  args_info->query_allow_uids_arg = NULL;
+  args_info->query_allow_uids_orig = NULL;
+  args_info->shm_file_arg = NULL;
+  args_info->shm_file_orig = NULL;
+  args_info->audio_sink_arg = gengetopt_strdup ("aplay");
+  args_info->audio_sink_orig = NULL;
+  args_info->azan_file_arg = gengetopt_strdup ("/usr/share/sounds/ptimes/azan.wav");
+  args_info->azan_file_orig = NULL;
+  args_info->audio_device_arg = gengetopt_strdup ("default");
+  args_info->audio_device_orig = NULL;
+  args_info->metrics_file_arg = NULL;
+  args_info->metrics_file_orig = NULL;
+  args_info->metrics_interval_arg = 60;
+  args_info->metrics_interval_orig = NULL;
+  args_info->cache_file_arg = NULL;
+  args_info->cache_file_orig = NULL;
+  args_info->from_arg = NULL;
+  args_info->from_orig = NULL;
+  args_info->days_arg = 1;
+  args_info->days_orig = NULL;
+  args_info->format_arg = gengetopt_strdup ("csv");
+  args_info->format_orig = NULL;
+  args_info->input_arg = NULL;
+  args_info->input_orig = NULL;
+  args_info->batch_format_arg = gengetopt_strdup ("text");
+  args_info->batch_format_orig = NULL;
+  args_info->threads_arg = 0;
+  args_info->threads_orig = NULL;
+  args_info->batch_output_arg = gengetopt_strdup ("records");
+  args_info->batch_output_orig = NULL;
+  args_info->city_arg = NULL;
+  args_info->city_orig = NULL;
+  args_info->citydb_arg = gengetopt_strdup ("/usr/share/ptimes/cities.db");
+  args_info->citydb_orig = NULL;
+  args_info->build_citydb_arg = NULL;
+  args_info->build_citydb_orig = NULL;
+  args_info->min_population_orig = NULL;
+  args_info->tzmap_arg = gengetopt_strdup ("/usr/share/ptimes/tzmap.db");
+  args_info->tzmap_orig = NULL;
+  args_info->build_tzmap_arg = NULL;
+  args_info->build_tzmap_orig = NULL;
+  args_info->trace_arg = NULL;
+  args_info->trace_orig = NULL;
+  args_info->action_timeout_arg = 900;
+  args_info->action_timeout_orig = NULL;
+  args_info->max_actions_arg = 2;
+  args_info->max_actions_orig = NULL;
+  args_info->actions_arg = NULL;
+  args_info->actions_orig = NULL;
+  args_info->action_workers_arg = 4;
+  args_info->action_workers_orig = NULL;
+  args_info->announce_arg = NULL;
+  args_info->announce_orig = NULL;
+  args_info->announce_key_arg = gengetopt_strdup ("/etc/ptimes/announce.key");
+  args_info->announce_key_orig = NULL;
+  args_info->announce_interval_arg = 60;
+  args_info->announce_interval_orig = NULL;
+  args_info->listen_arg = NULL;
+  args_info->listen_orig = NULL;
   
 }
 
@@ -154,6 +303,46 @@ void init_args_info(struct gengetopt_args_info *args_info)
   args_info->fajr_angle_help = gengetopt_args_info_help[10] ;
   args_info->maghrib_angle_help = gengetopt_args_info_help[11] ;
   args_info->isha_angle_help = gengetopt_args_info_help[12] ;
+  args_info->serve_help = gengetopt_args_info_help[13] ;
+  args_info->http_address_help = gengetopt_args_info_help[14] ;
+  args_info->http_port_help = gengetopt_args_info_help[15] ;
+  args_info->query_socket_help = gengetopt_args_info_help[16] ;
+  args_info->query_allow_uids_help = gengetopt_args_info_help[17] ;
+  args_info->shm_file_help = gengetopt_args_info_help[18] ;
+  args_info->audio_sink_help = gengetopt_args_info_help[19] ;
+  args_info->azan_file_help = gengetopt_args_info_help[20] ;
+  args_info->audio_device_help = gengetopt_args_info_help[21] ;
+  args_info->metrics_file_help = gengetopt_args_info_help[22] ;
+  args_info->metrics_interval_help = gengetopt_args_info_help[23] ;
+  args_info->cache_file_help = gengetopt_args_info_help[24] ;
+  args_info->print_help = gengetopt_args_info_help[25] ;
+  args_info->from_help = gengetopt_args_info_help[26] ;
+  args_info->days_help = gengetopt_args_info_help[27] ;
+  args_info->format_help = gengetopt_args_info_help[28] ;
+  args_info->batch_help = gengetopt_args_info_help[29] ;
+  args_info->input_help = gengetopt_args_info_help[30] ;
+  args_info->batch_format_help = gengetopt_args_info_help[31] ;
+  args_info->threads_help = gengetopt_args_info_help[32] ;
+  args_info->batch_output_help = gengetopt_args_info_help[33] ;
+  args_info->city_help = gengetopt_args_info_help[34] ;
+  args_info->citydb_help = gengetopt_args_info_help[35] ;
+  args_info->build_citydb_help = gengetopt_args_info_help[36] ;
+  args_info->nearest_city_help = gengetopt_args_info_help[37] ;
+  args_info->min_population_help = gengetopt_args_info_help[38] ;
+  args_info->auto_timezone_help = gengetopt_args_info_help[39] ;
+  args_info->tzmap_help = gengetopt_args_info_help[40] ;
+  args_info->build_tzmap_help = gengetopt_args_info_help[41] ;
+  args_info->simulate_help = gengetopt_args_info_help[42] ;
+  args_info->trace_help = gengetopt_args_info_help[43] ;
+  args_info->action_timeout_help = gengetopt_args_info_help[44] ;
+  args_info->max_actions_help = gengetopt_args_info_help[45] ;
+  args_info->actions_help = gengetopt_args_info_help[46] ;
+  args_info->action_workers_help = gengetopt_args_info_help[47] ;
+  args_info->test_actions_help = gengetopt_args_info_help[48] ;
+  args_info->announce_help = gengetopt_args_info_help[49] ;
+  args_info->announce_key_help = gengetopt_args_info_help[50] ;
+  args_info->announce_interval_help = gengetopt_args_info_help[51] ;
+  args_info->listen_help = gengetopt_args_info_help[52] ;
   
 }
 
@@ -251,6 +440,63 @@ cmdline_parser_release (struct gengetopt_args_info *args_info)
   free_string_field (&(args_info->fajr_angle_orig));
   free_string_field (&(args_info->maghrib_angle_orig));
   free_string_field (&(args_info->isha_angle_orig));
+  free_string_field (&(args_info->http_address_arg));
+  free_string_field (&(args_info->http_address_orig));
+  free_string_field (&(args_info->http_port_orig));
+  free_string_field (&(args_info->query_socket_arg));
+  free_string_field (&(args_info->query_socket_orig));
+  free_string_field (&(args_info->query_allow_uids_arg));
+  free_string_field (&(args_info->query_allow_uids_orig));
+  free_string_field (&(args_info->shm_file_arg));
+  free_string_field (&(args_info->shm_file_orig));
+  free_string_field (&(args_info->audio_sink_arg));
+  free_string_field (&(args_info->audio_sink_orig));
+  free_string_field (&(args_info->azan_file_arg));
+  free_string_field (&(args_info->azan_file_orig));
+  free_string_field (&(args_info->audio_device_arg));
+  free_string_field (&(args_info->audio_device_orig));
+  free_string_field (&(args_info->metrics_file_arg));
+  free_string_field (&(args_info->metrics_file_orig));
+  free_string_field (&(args_info->metrics_interval_orig));
+  free_string_field (&(args_info->cache_file_arg));
+  free_string_field (&(args_info->cache_file_orig));
+  free_string_field (&(args_info->from_arg));
+  free_string_field (&(args_info->from_orig));
+  free_string_field (&(args_info->days_orig));
+  free_string_field (&(args_info->format_arg));
+  free_string_field (&(args_info->format_orig));
+  free_string_field (&(args_info->input_arg));
+  free_string_field (&(args_info->input_orig));
+  free_string_field (&(args_info->batch_format_arg));
+  free_string_field (&(args_info->batch_format_orig));
+  free_string_field (&(args_info->threads_orig));
+  free_string_field (&(args_info->batch_output_arg));
+  free_string_field (&(args_info->batch_output_orig));
+  free_string_field (&(args_info->city_arg));
+  free_string_field (&(args_info->city_orig));
+  free_string_field (&(args_info->citydb_arg));
+  free_string_field (&(args_info->citydb_orig));
+  free_string_field (&(args_info->build_citydb_arg));
+  free_string_field (&(args_info->build_citydb_orig));
+  free_string_field (&(args_info->min_population_orig));
+  free_string_field (&(args_info->tzmap_arg));
+  free_string_field (&(args_info->tzmap_orig));
+  free_string_field (&(args_info->build_tzmap_arg));
+  free_string_field (&(args_info->build_tzmap_orig));
+  free_string_field (&(args_info->trace_arg));
+  free_string_field (&(args_info->trace_orig));
+  free_string_field (&(args_info->action_timeout_orig));
+  free_string_field (&(args_info->max_actions_orig));
+  free_string_field (&(args_info->actions_arg));
+  free_string_field (&(args_info->actions_orig));
+  free_string_field (&(args_info->action_workers_orig));
+  free_string_field (&(args_info->announce_arg));
+  free_string_field (&(args_info->announce_orig));
+  free_string_field (&(args_info->announce_key_arg));
+  free_string_field (&(args_info->announce_key_orig));
+  free_string_field (&(args_info->announce_interval_orig));
+  free_string_field (&(args_info->listen_arg));
+  free_string_field (&(args_info->listen_orig));
   
   
   for (i = 0; i < args_info->inputs_num; ++i)
@@ -353,6 +599,86 @@ cmdline_parser_dump(FILE *outfile, struct gengetopt_args_info *args_info)
     write_into_file(outfile, "maghrib-angle", args_info->maghrib_angle_orig, 0);
   if (args_info->isha_angle_given)
     write_into_file(outfile, "isha-angle", args_info->isha_angle_orig, 0);
+  if (args_info->serve_given)
+    write_into_file(outfile, "serve", 0, 0 );
+  if (args_info->http_address_given)
+    write_into_file(outfile, "http-address", args_info->http_address_orig, 0);
+  if (args_info->http_port_given)
+    write_into_file(outfile, "http-port", args_info->http_port_orig, 0);
+  if (args_info->query_socket_given)
+    write_into_file(outfile, "query-socket", args_info->query_socket_orig, 0);
+  if (args_info->query_allow_uids_given)
+    write_into_file(outfile, "query-allow-uids", args_info->query_allow_uids_orig, 0);
+  if (args_info->shm_file_given)
+    write_into_file(outfile, "shm-file", args_info->shm_file_orig, 0);
+  if (args_info->audio_sink_given)
+    write_into_file(outfile, "audio-sink", args_info->audio_sink_orig, cmdline_parser_audio_sink_values);
+  if (args_info->azan_file_given)
+    write_into_file(outfile, "azan-file", args_info->azan_file_orig, 0);
+  if (args_info->audio_device_given)
+    write_into_file(outfile, "audio-device", args_info->audio_device_orig, 0);
+  if (args_info->metrics_file_given)
+    write_into_file(outfile, "metrics-file", args_info->metrics_file_orig, 0);
+  if (args_info->metrics_interval_given)
+    write_into_file(outfile, "metrics-interval", args_info->metrics_interval_orig, 0);
+  if (args_info->cache_file_given)
+    write_into_file(outfile, "cache-file", args_info->cache_file_orig, 0);
+  if (args_info->print_given)
+    write_into_file(outfile, "print", 0, 0 );
+  if (args_info->from_given)
+    write_into_file(outfile, "from", args_info->from_orig, 0);
+  if (args_info->days_given)
+    write_into_file(outfile, "days", args_info->days_orig, 0);
+  if (args_info->format_given)
+    write_into_file(outfile, "format", args_info->format_orig, cmdline_parser_format_values);
+  if (args_info->batch_given)
+    write_into_file(outfile, "batch", 0, 0 );
+  if (args_info->input_given)
+    write_into_file(outfile, "input", args_info->input_orig, 0);
+  if (args_info->batch_format_given)
+    write_into_file(outfile, "batch-format", args_info->batch_format_orig, cmdline_parser_batch_format_values);
+  if (args_info->threads_given)
+    write_into_file(outfile, "threads", args_info->threads_orig, 0);
+  if (args_info->batch_output_given)
+    write_into_file(outfile, "batch-output", args_info->batch_output_orig, cmdline_parser_batch_output_values);
+  if (args_info->city_given)
+    write_into_file(outfile, "city", args_info->city_orig, 0);
+  if (args_info->citydb_given)
+    write_into_file(outfile, "citydb", args_info->citydb_orig, 0);
+  if (args_info->build_citydb_given)
+    write_into_file(outfile, "build-citydb", args_info->build_citydb_orig, 0);
+  if (args_info->nearest_city_given)
+    write_into_file(outfile, "nearest-city", 0, 0 );
+  if (args_info->min_population_given)
+    write_into_file(outfile, "min-population", args_info->min_population_orig, 0);
+  if (args_info->auto_timezone_given)
+    write_into_file(outfile, "auto-timezone", 0, 0 );
+  if (args_info->tzmap_given)
+    write_into_file(outfile, "tzmap", args_info->tzmap_orig, 0);
+  if (args_info->build_tzmap_given)
+    write_into_file(outfile, "build-tzmap", args_info->build_tzmap_orig, 0);
+  if (args_info->simulate_given)
+    write_into_file(outfile, "simulate", 0, 0 );
+  if (args_info->trace_given)
+    write_into_file(outfile, "trace", args_info->trace_orig, 0);
+  if (args_info->action_timeout_given)
+    write_into_file(outfile, "action-timeout", args_info->action_timeout_orig, 0);
+  if (args_info->max_actions_given)
+    write_into_file(outfile, "max-actions", args_info->max_actions_orig, 0);
+  if (args_info->actions_given)
+    write_into_file(outfile, "actions", args_info->actions_orig, 0);
+  if (args_info->action_workers_given)
+    write_into_file(outfile, "action-workers", args_info->action_workers_orig, 0);
+  if (args_info->test_actions_given)
+    write_into_file(outfile, "test-actions", 0, 0 );
+  if (args_info->announce_given)
+    write_into_file(outfile, "announce", args_info->announce_orig, 0);
+  if (args_info->announce_key_given)
+    write_into_file(outfile, "announce-key", args_info->announce_key_orig, 0);
+  if (args_info->announce_interval_given)
+    write_into_file(outfile, "announce-interval", args_info->announce_interval_orig, 0);
+  if (args_info->listen_given)
+    write_into_file(outfile, "listen", args_info->listen_orig, 0);
   
 
   i = EXIT_SUCCESS;
@@ -469,18 +795,6 @@ cmdline_parser_required2 (struct gengetopt_args_info *args_info, const char *pro
   FIX_UNUSED (additional_error);
 
   /* checks for required options */
-  if (! args_info->latitude_given)
-    {
-      fprintf (stderr, "%s: '--latitude' ('-l') option required%s\n", prog_name, (additional_error ? additional_error : ""));
-      error = 1;
-    }
-  
-  if (! args_info->longitude_given)
-    {
-      fprintf (stderr, "%s: '--longitude' ('-n') option required%s\n", prog_name, (additional_error ? additional_error : ""));
-      error = 1;
-    }
-  
   
   /* checks for dependences among options */
 
@@ -665,6 +979,46 @@ cmdline_parser_internal (
         { "fajr-angle",	1, NULL, 0 },
         { "maghrib-angle",	1, NULL, 0 },
         { "isha-angle",	1, NULL, 0 },
+        { "serve",	0, NULL, 0 },
+        { "http-address",	1, NULL, 0 },
+        { "http-port",	1, NULL, 0 },
+        { "query-socket",	1, NULL, 0 },
+        { "query-allow-uids",	1, NULL, 0 },
+        { "shm-file",	1, NULL, 0 },
+        { "audio-sink",	1, NULL, 0 },
+        { "azan-file",	1, NULL, 0 },
+        { "audio-device",	1, NULL, 0 },
+        { "metrics-file",	1, NULL, 0 },
+        { "metrics-interval",	1, NULL, 0 },
+        { "cache-file",	1, NULL, 0 },
+        { "print",	0, NULL, 0 },
+        { "from",	1, NULL, 0 },
+        { "days",	1, NULL, 0 },
+        { "format",	1, NULL, 0 },
+        { "batch",	0, NULL, 0 },
+        { "input",	1, NULL, 0 },
+        { "batch-format",	1, NULL, 0 },
+        { "threads",	1, NULL, 0 },
+        { "batch-output",	1, NULL, 0 },
+        { "city",	1, NULL, 0 },
+        { "citydb",	1, NULL, 0 },
+        { "build-citydb",	1, NULL, 0 },
+        { "nearest-city",	0, NULL, 0 },
+        { "min-population",	1, NULL, 0 },
+        { "auto-timezone",	0, NULL, 0 },
+        { "tzmap",	1, NULL, 0 },
+        { "build-tzmap",	1, NULL, 0 },
+        { "simulate",	0, NULL, 0 },
+        { "trace",	1, NULL, 0 },
+        { "action-timeout",	1, NULL, 0 },
+        { "max-actions",	1, NULL, 0 },
+        { "actions",	1, NULL, 0 },
+        { "action-workers",	1, NULL, 0 },
+        { "test-actions",	0, NULL, 0 },
+        { "announce",	1, NULL, 0 },
+        { "announce-key",	1, NULL, 0 },
+        { "announce-interval",	1, NULL, 0 },
+        { "listen",	1, NULL, 0 },
         { 0,  0, 0, 0 }
       };
 
@@ -829,6 +1183,566 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* answer prayer time queries over HTTP.  */
+          else if (strcmp (long_options[option_index].name, "serve") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->serve_given),
+                &(local_args_info.serve_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "serve", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* address the HTTP server listens on.  */
+          else if (strcmp (long_options[option_index].name, "http-address") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->http_address_arg), 
+                 &(args_info->http_address_orig), &(args_info->http_address_given),
+                &(local_args_info.http_address_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "http-address", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* port the HTTP server listens on.  */
+          else if (strcmp (long_options[option_index].name, "http-port") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->http_port_arg), 
+                 &(args_info->http_port_orig), &(args_info->http_port_given),
+                &(local_args_info.http_port_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "http-port", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* answer local queries on this Unix domain socket.  */
+          else if (strcmp (long_options[option_index].name, "query-socket") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->query_socket_arg), 
+                 &(args_info->query_socket_orig), &(args_info->query_socket_given),
+                &(local_args_info.query_socket_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "query-socket", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* comma separated uids allowed to query besides root and the daemon user.  */
+          else if (strcmp (long_options[option_index].name, "query-allow-uids") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->query_allow_uids_arg), 
+                 &(args_info->query_allow_uids_orig), &(args_info->query_allow_uids_given),
+                &(local_args_info.query_allow_uids_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "query-allow-uids", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* publish the schedule in this shared memory file, e.g. /dev/shm/ptimes.  */
+          else if (strcmp (long_options[option_index].name, "shm-file") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->shm_file_arg), 
+                 &(args_info->shm_file_orig), &(args_info->shm_file_given),
+                &(local_args_info.shm_file_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "shm-file", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* how to play the azan.  */
+          else if (strcmp (long_options[option_index].name, "audio-sink") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->audio_sink_arg), 
+                 &(args_info->audio_sink_orig), &(args_info->audio_sink_given),
+                &(local_args_info.audio_sink_given), optarg, cmdline_parser_audio_sink_values, "aplay", ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "audio-sink", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* WAV file played at prayer time.  */
+          else if (strcmp (long_options[option_index].name, "azan-file") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->azan_file_arg), 
+                 &(args_info->azan_file_orig), &(args_info->azan_file_given),
+                &(local_args_info.azan_file_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "azan-file", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* ALSA device, or output file of the file sink.  */
+          else if (strcmp (long_options[option_index].name, "audio-device") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->audio_device_arg), 
+                 &(args_info->audio_device_orig), &(args_info->audio_device_given),
+                &(local_args_info.audio_device_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "audio-device", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* write alert latency metrics to a node_exporter textfile.  */
+          else if (strcmp (long_options[option_index].name, "metrics-file") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->metrics_file_arg), 
+                 &(args_info->metrics_file_orig), &(args_info->metrics_file_given),
+                &(local_args_info.metrics_file_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "metrics-file", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* seconds between metrics textfile updates.  */
+          else if (strcmp (long_options[option_index].name, "metrics-interval") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->metrics_interval_arg), 
+                 &(args_info->metrics_interval_orig), &(args_info->metrics_interval_given),
+                &(local_args_info.metrics_interval_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "metrics-interval", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* keep the upcoming schedule in this file for fast restarts.  */
+          else if (strcmp (long_options[option_index].name, "cache-file") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->cache_file_arg), 
+                 &(args_info->cache_file_orig), &(args_info->cache_file_given),
+                &(local_args_info.cache_file_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "cache-file", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* print a timetable to stdout and exit.  */
+          else if (strcmp (long_options[option_index].name, "print") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->print_given),
+                &(local_args_info.print_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "print", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* first day of the timetable (default today).  */
+          else if (strcmp (long_options[option_index].name, "from") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->from_arg), 
+                 &(args_info->from_orig), &(args_info->from_given),
+                &(local_args_info.from_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "from", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* number of days in the timetable.  */
+          else if (strcmp (long_options[option_index].name, "days") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->days_arg), 
+                 &(args_info->days_orig), &(args_info->days_given),
+                &(local_args_info.days_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "days", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* timetable format.  */
+          else if (strcmp (long_options[option_index].name, "format") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->format_arg), 
+                 &(args_info->format_orig), &(args_info->format_given),
+                &(local_args_info.format_given), optarg, cmdline_parser_format_values, "csv", ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "format", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* compute the records read from --input or stdin and exit.  */
+          else if (strcmp (long_options[option_index].name, "batch") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->batch_given),
+                &(local_args_info.batch_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "batch", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* input file of --batch.  */
+          else if (strcmp (long_options[option_index].name, "input") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->input_arg), 
+                 &(args_info->input_orig), &(args_info->input_given),
+                &(local_args_info.input_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "input", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* record format of --batch.  */
+          else if (strcmp (long_options[option_index].name, "batch-format") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->batch_format_arg), 
+                 &(args_info->batch_format_orig), &(args_info->batch_format_given),
+                &(local_args_info.batch_format_given), optarg, cmdline_parser_batch_format_values, "text", ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "batch-format", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* worker threads of --batch, 0 for one per CPU.  */
+          else if (strcmp (long_options[option_index].name, "threads") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->threads_arg), 
+                 &(args_info->threads_orig), &(args_info->threads_given),
+                &(local_args_info.threads_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "threads", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* output of --batch, results in the record format or an Arrow IPC stream.  */
+          else if (strcmp (long_options[option_index].name, "batch-output") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->batch_output_arg), 
+                 &(args_info->batch_output_orig), &(args_info->batch_output_given),
+                &(local_args_info.batch_output_given), optarg, cmdline_parser_batch_output_values, "records", ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "batch-output", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* take latitude and longitude from the city database, NAME or NAME,CC.  */
+          else if (strcmp (long_options[option_index].name, "city") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->city_arg), 
+                 &(args_info->city_orig), &(args_info->city_given),
+                &(local_args_info.city_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "city", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* city database of --city.  */
+          else if (strcmp (long_options[option_index].name, "citydb") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->citydb_arg), 
+                 &(args_info->citydb_orig), &(args_info->citydb_given),
+                &(local_args_info.citydb_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "citydb", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* build --citydb from a GeoNames dump (e.g. cities15000.txt) and exit.  */
+          else if (strcmp (long_options[option_index].name, "build-citydb") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->build_citydb_arg), 
+                 &(args_info->build_citydb_orig), &(args_info->build_citydb_given),
+                &(local_args_info.build_citydb_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "build-citydb", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* print the city closest to the location and exit.  */
+          else if (strcmp (long_options[option_index].name, "nearest-city") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->nearest_city_given),
+                &(local_args_info.nearest_city_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "nearest-city", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* with --batch, compute every city of at least N people on --from instead of reading records.  */
+          else if (strcmp (long_options[option_index].name, "min-population") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->min_population_arg), 
+                 &(args_info->min_population_orig), &(args_info->min_population_given),
+                &(local_args_info.min_population_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "min-population", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* use the time zone of the location from --tzmap instead of the host time zone.  */
+          else if (strcmp (long_options[option_index].name, "auto-timezone") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->auto_timezone_given),
+                &(local_args_info.auto_timezone_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "auto-timezone", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* time zone map of --auto-timezone.  */
+          else if (strcmp (long_options[option_index].name, "tzmap") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->tzmap_arg), 
+                 &(args_info->tzmap_orig), &(args_info->tzmap_given),
+                &(local_args_info.tzmap_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "tzmap", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* build --tzmap from zone polygons in WKT CSV and exit.  */
+          else if (strcmp (long_options[option_index].name, "build-tzmap") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->build_tzmap_arg), 
+                 &(args_info->build_tzmap_orig), &(args_info->build_tzmap_given),
+                &(local_args_info.build_tzmap_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "build-tzmap", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* run the daemon on a simulated clock over --from and --days, print every fired event and exit.  */
+          else if (strcmp (long_options[option_index].name, "simulate") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->simulate_given),
+                &(local_args_info.simulate_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "simulate", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* write the events of --simulate to this file instead of stdout.  */
+          else if (strcmp (long_options[option_index].name, "trace") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->trace_arg), 
+                 &(args_info->trace_orig), &(args_info->trace_given),
+                &(local_args_info.trace_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "trace", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* kill an alert action still running after this many seconds, 0 for no limit.  */
+          else if (strcmp (long_options[option_index].name, "action-timeout") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->action_timeout_arg), 
+                 &(args_info->action_timeout_orig), &(args_info->action_timeout_given),
+                &(local_args_info.action_timeout_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "action-timeout", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* alert actions allowed to run at the same time.  */
+          else if (strcmp (long_options[option_index].name, "max-actions") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->max_actions_arg), 
+                 &(args_info->max_actions_orig), &(args_info->max_actions_given),
+                &(local_args_info.max_actions_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "max-actions", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* run the alert actions of this file around each event (see README).  */
+          else if (strcmp (long_options[option_index].name, "actions") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->actions_arg), 
+                 &(args_info->actions_orig), &(args_info->actions_given),
+                &(local_args_info.actions_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "actions", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* threads running the write, http and mqtt actions of --actions.  */
+          else if (strcmp (long_options[option_index].name, "action-workers") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->action_workers_arg), 
+                 &(args_info->action_workers_orig), &(args_info->action_workers_given),
+                &(local_args_info.action_workers_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "action-workers", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* run every action of --actions once for the next prayer, report and exit.  */
+          else if (strcmp (long_options[option_index].name, "test-actions") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->test_actions_given),
+                &(local_args_info.test_actions_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "test-actions", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* multicast the schedule to this group, e.g. 239.255.42.1:5454.  */
+          else if (strcmp (long_options[option_index].name, "announce") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->announce_arg), 
+                 &(args_info->announce_orig), &(args_info->announce_given),
+                &(local_args_info.announce_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "announce", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* shared key file signing the announcements.  */
+          else if (strcmp (long_options[option_index].name, "announce-key") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->announce_key_arg), 
+                 &(args_info->announce_key_orig), &(args_info->announce_key_given),
+                &(local_args_info.announce_key_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "announce-key", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* seconds between repeated announcements.  */
+          else if (strcmp (long_options[option_index].name, "announce-interval") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->announce_interval_arg), 
+                 &(args_info->announce_interval_orig), &(args_info->announce_interval_given),
+                &(local_args_info.announce_interval_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "announce-interval", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* only consume the announcements of this group and publish them.  */
+          else if (strcmp (long_options[option_index].name, "listen") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->listen_arg), 
+                 &(args_info->listen_orig), &(args_info->listen_given),
+                &(local_args_info.listen_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "listen", '-',
+                additional_error))
+              goto failure;
+          
           }
           
           break;
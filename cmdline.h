@@ -72,6 +72,112 @@ struct gengetopt_args_info
   int isha_angle_arg;	/**< @brief angle for calculating Isha prayer time.  */
   char * isha_angle_orig;	/**< @brief angle for calculating Isha prayer time original value given at command line.  */
   const char *isha_angle_help; /**< @brief angle for calculating Isha prayer time help description.  */
+  const char *serve_help; /**< @brief answer prayer time queries over HTTP help description.  */
+  char * http_address_arg;	/**< @brief address the HTTP server listens on (default='127.0.0.1').  */
+  char * http_address_orig;	/**< @brief address the HTTP server listens on original value given at command line.  */
+  const char *http_address_help; /**< @brief address the HTTP server listens on help description.  */
+  int http_port_arg;	/**< @brief port the HTTP server listens on (default='8080').  */
+  char * http_port_orig;	/**< @brief port the HTTP server listens on original value given at command line.  */
+  const char *http_port_help; /**< @brief port the HTTP server listens on help description.  */
+  char * query_socket_arg;	/**< @brief answer local queries on this Unix domain socket.  */
+  char * query_socket_orig;	/**< @brief answer local queries on this Unix domain socket original value given at command line.  */
+  const char *query_socket_help; /**< @brief answer local queries on this Unix domain socket help description.  */
+  char * query_allow_uids_arg;	/**< @brief comma separated uids allowed to query besides root and the daemon user.  */
+  char * query_allow_uids_orig;	/**< @brief comma separated uids allowed to query besides root and the daemon user original value given at command line.  */
+  const char *query_allow_uids_help; /**< @brief comma separated uids allowed to query besides root and the daemon user help description.  */
+  char * shm_file_arg;	/**< @brief publish the schedule in this shared memory file, e.g. /dev/shm/ptimes.  */
+  char * shm_file_orig;	/**< @brief publish the schedule in this shared memory file, e.g. /dev/shm/ptimes original value given at command line.  */
+  const char *shm_file_help; /**< @brief publish the schedule in this shared memory file, e.g. /dev/shm/ptimes help description.  */
+  char * audio_sink_arg;	/**< @brief how to play the azan (default='aplay').  */
+  char * audio_sink_orig;	/**< @brief how to play the azan original value given at command line.  */
+  const char *audio_sink_help; /**< @brief how to play the azan help description.  */
+  char * azan_file_arg;	/**< @brief WAV file played at prayer time (default='/usr/share/sounds/ptimes/azan.wav').  */
+  char * azan_file_orig;	/**< @brief WAV file played at prayer time original value given at command line.  */
+  const char *azan_file_help; /**< @brief WAV file played at prayer time help description.  */
+  char * audio_device_arg;	/**< @brief ALSA device, or output file of the file sink (default='default').  */
+  char * audio_device_orig;	/**< @brief ALSA device, or output file of the file sink original value given at command line.  */
+  const char *audio_device_help; /**< @brief ALSA device, or output file of the file sink help description.  */
+  char * metrics_file_arg;	/**< @brief write alert latency metrics to a node_exporter textfile.  */
+  char * metrics_file_orig;	/**< @brief write alert latency metrics to a node_exporter textfile original value given at command line.  */
+  const char *metrics_file_help; /**< @brief write alert latency metrics to a node_exporter textfile help description.  */
+  int metrics_interval_arg;	/**< @brief seconds between metrics textfile updates (default='60').  */
+  char * metrics_interval_orig;	/**< @brief seconds between metrics textfile updates original value given at command line.  */
+  const char *metrics_interval_help; /**< @brief seconds between metrics textfile updates help description.  */
+  char * cache_file_arg;	/**< @brief keep the upcoming schedule in this file for fast restarts.  */
+  char * cache_file_orig;	/**< @brief keep the upcoming schedule in this file for fast restarts original value given at command line.  */
+  const char *cache_file_help; /**< @brief keep the upcoming schedule in this file for fast restarts help description.  */
+  const char *print_help; /**< @brief print a timetable to stdout and exit help description.  */
+  char * from_arg;	/**< @brief first day of the timetable (default today).  */
+  char * from_orig;	/**< @brief first day of the timetable (default today) original value given at command line.  */
+  const char *from_help; /**< @brief first day of the timetable (default today) help description.  */
+  int days_arg;	/**< @brief number of days in the timetable (default='1').  */
+  char * days_orig;	/**< @brief number of days in the timetable original value given at command line.  */
+  const char *days_help; /**< @brief number of days in the timetable help description.  */
+  char * format_arg;	/**< @brief timetable format (default='csv').  */
+  char * format_orig;	/**< @brief timetable format original value given at command line.  */
+  const char *format_help; /**< @brief timetable format help description.  */
+  const char *batch_help; /**< @brief compute the records read from --input or stdin and exit help description.  */
+  char * input_arg;	/**< @brief input file of --batch.  */
+  char * input_orig;	/**< @brief input file of --batch original value given at command line.  */
+  const char *input_help; /**< @brief input file of --batch help description.  */
+  char * batch_format_arg;	/**< @brief record format of --batch (default='text').  */
+  char * batch_format_orig;	/**< @brief record format of --batch original value given at command line.  */
+  const char *batch_format_help; /**< @brief record format of --batch help description.  */
+  int threads_arg;	/**< @brief worker threads of --batch, 0 for one per CPU (default='0').  */
+  char * threads_orig;	/**< @brief worker threads of --batch, 0 for one per CPU original value given at command line.  */
+  const char *threads_help; /**< @brief worker threads of --batch, 0 for one per CPU help description.  */
+  char * batch_output_arg;	/**< @brief output of --batch, results in the record format or an Arrow IPC stream (default='records').  */
+  char * batch_output_orig;	/**< @brief output of --batch, results in the record format or an Arrow IPC stream original value given at command line.  */
+  const char *batch_output_help; /**< @brief output of --batch, results in the record format or an Arrow IPC stream help description.  */
+  char * city_arg;	/**< @brief take latitude and longitude from the city database, NAME or NAME,CC.  */
+  char * city_orig;	/**< @brief take latitude and longitude from the city database, NAME or NAME,CC original value given at command line.  */
+  const char *city_help; /**< @brief take latitude and longitude from the city database, NAME or NAME,CC help description.  */
+  char * citydb_arg;	/**< @brief city database of --city (default='/usr/share/ptimes/cities.db').  */
+  char * citydb_orig;	/**< @brief city database of --city original value given at command line.  */
+  const char *citydb_help; /**< @brief city database of --city help description.  */
+  char * build_citydb_arg;	/**< @brief build --citydb from a GeoNames dump (e.g. cities15000.txt) and exit.  */
+  char * build_citydb_orig;	/**< @brief build --citydb from a GeoNames dump (e.g. cities15000.txt) and exit original value given at command line.  */
+  const char *build_citydb_help; /**< @brief build --citydb from a GeoNames dump (e.g. cities15000.txt) and exit help description.  */
+  const char *nearest_city_help; /**< @brief print the city closest to the location and exit help description.  */
+  int min_population_arg;	/**< @brief with --batch, compute every city of at least N people on --from instead of reading records.  */
+  char * min_population_orig;	/**< @brief with --batch, compute every city of at least N people on --from instead of reading records original value given at command line.  */
+  const char *min_population_help; /**< @brief with --batch, compute every city of at least N people on --from instead of reading records help description.  */
+  const char *auto_timezone_help; /**< @brief use the time zone of the location from --tzmap instead of the host time zone help description.  */
+  char * tzmap_arg;	/**< @brief time zone map of --auto-timezone (default='/usr/share/ptimes/tzmap.db').  */
+  char * tzmap_orig;	/**< @brief time zone map of --auto-timezone original value given at command line.  */
+  const char *tzmap_help; /**< @brief time zone map of --auto-timezone help description.  */
+  char * build_tzmap_arg;	/**< @brief build --tzmap from zone polygons in WKT CSV and exit.  */
+  char * build_tzmap_orig;	/**< @brief build --tzmap from zone polygons in WKT CSV and exit original value given at command line.  */
+  const char *build_tzmap_help; /**< @brief build --tzmap from zone polygons in WKT CSV and exit help description.  */
+  const char *simulate_help; /**< @brief run the daemon on a simulated clock over --from and --days, print every fired event and exit help description.  */
+  char * trace_arg;	/**< @brief write the events of --simulate to this file instead of stdout.  */
+  char * trace_orig;	/**< @brief write the events of --simulate to this file instead of stdout original value given at command line.  */
+  const char *trace_help; /**< @brief write the events of --simulate to this file instead of stdout help description.  */
+  int action_timeout_arg;	/**< @brief kill an alert action still running after this many seconds, 0 for no limit (default='900').  */
+  char * action_timeout_orig;	/**< @brief kill an alert action still running after this many seconds, 0 for no limit original value given at command line.  */
+  const char *action_timeout_help; /**< @brief kill an alert action still running after this many seconds, 0 for no limit help description.  */
+  int max_actions_arg;	/**< @brief alert actions allowed to run at the same time (default='2').  */
+  char * max_actions_orig;	/**< @brief alert actions allowed to run at the same time original value given at command line.  */
+  const char *max_actions_help; /**< @brief alert actions allowed to run at the same time help description.  */
+  char * actions_arg;	/**< @brief run the alert actions of this file around each event (see README).  */
+  char * actions_orig;	/**< @brief run the alert actions of this file around each event (see README) original value given at command line.  */
+  const char *actions_help; /**< @brief run the alert actions of this file around each event (see README) help description.  */
+  int action_workers_arg;	/**< @brief threads running the write, http and mqtt actions of --actions (default='4').  */
+  char * action_workers_orig;	/**< @brief threads running the write, http and mqtt actions of --actions original value given at command line.  */
+  const char *action_workers_help; /**< @brief threads running the write, http and mqtt actions of --actions help description.  */
+  const char *test_actions_help; /**< @brief run every action of --actions once for the next prayer, report and exit help description.  */
+  char * announce_arg;	/**< @brief multicast the schedule to this group, e.g. 239.255.42.1:5454.  */
+  char * announce_orig;	/**< @brief multicast the schedule to this group, e.g. 239.255.42.1:5454 original value given at command line.  */
+  const char *announce_help; /**< @brief multicast the schedule to this group, e.g. 239.255.42.1:5454 help description.  */
+  char * announce_key_arg;	/**< @brief shared key file signing the announcements (default='/etc/ptimes/announce.key').  */
+  char * announce_key_orig;	/**< @brief shared key file signing the announcements original value given at command line.  */
+  const char *announce_key_help; /**< @brief shared key file signing the announcements help description.  */
+  int announce_interval_arg;	/**< @brief seconds between repeated announcements (default='60').  */
+  char * announce_interval_orig;	/**< @brief seconds between repeated announcements original value given at command line.  */
+  const char *announce_interval_help; /**< @brief seconds between repeated announcements help description.  */
+  char * listen_arg;	/**< @brief only consume the announcements of this group and publish them.  */
+  char * listen_orig;	/**< @brief only consume the announcements of this group and publish them original value given at command line.  */
+  const char *listen_help; /**< @brief only consume the announcements of this group and publish them help description.  */
   
   unsigned int help_given ;	/**< @brief Whether help was given.  */
   unsigned int version_given ;	/**< @brief Whether version was given.  */
@@ -86,6 +192,46 @@ struct gengetopt_args_info
   unsigned int fajr_angle_given ;	/**< @brief Whether fajr-angle was given.  */
   unsigned int maghrib_angle_given ;	/**< @brief Whether maghrib-angle was given.  */
   unsigned int isha_angle_given ;	/**< @brief Whether isha-angle was given.  */
+  unsigned int serve_given ;	/**< @brief Whether serve was given.  */
+  unsigned int http_address_given ;	/**< @brief Whether http-address was given.  */
+  unsigned int http_port_given ;	/**< @brief Whether http-port was given.  */
+  unsigned int query_socket_given ;	/**< @brief Whether query-socket was given.  */
+  unsigned int query_allow_uids_given ;	/**< @brief Whether query-allow-uids was given.  */
+  unsigned int shm_file_given ;	/**< @brief Whether shm-file was given.  */
+  unsigned int audio_sink_given ;	/**< @brief Whether audio-sink was given.  */
+  unsigned int azan_file_given ;	/**< @brief Whether azan-file was given.  */
+  unsigned int audio_device_given ;	/**< @brief Whether audio-device was given.  */
+  unsigned int metrics_file_given ;	/**< @brief Whether metrics-file was given.  */
+  unsigned int metrics_interval_given ;	/**< @brief Whether metrics-interval was given.  */
+  unsigned int cache_file_given ;	/**< @brief Whether cache-file was given.  */
+  unsigned int print_given ;	/**< @brief Whether print was given.  */
+  unsigned int from_given ;	/**< @brief Whether from was given.  */
+  unsigned int days_given ;	/**< @brief Whether days was given.  */
+  unsigned int format_given ;	/**< @brief Whether format was given.  */
+  unsigned int batch_given ;	/**< @brief Whether batch was given.  */
+  unsigned int input_given ;	/**< @brief Whether input was given.  */
+  unsigned int batch_format_given ;	/**< @brief Whether batch-format was given.  */
+  unsigned int threads_given ;	/**< @brief Whether threads was given.  */
+  unsigned int batch_output_given ;	/**< @brief Whether batch-output was given.  */
+  unsigned int city_given ;	/**< @brief Whether city was given.  */
+  unsigned int citydb_given ;	/**< @brief Whether citydb was given.  */
+  unsigned int build_citydb_given ;	/**< @brief Whether build-citydb was given.  */
+  unsigned int nearest_city_given ;	/**< @brief Whether nearest-city was given.  */
+  unsigned int min_population_given ;	/**< @brief Whether min-population was given.  */
+  unsigned int auto_timezone_given ;	/**< @brief Whether auto-timezone was given.  */
+  unsigned int tzmap_given ;	/**< @brief Whether tzmap was given.  */
+  unsigned int build_tzmap_given ;	/**< @brief Whether build-tzmap was given.  */
+  unsigned int simulate_given ;	/**< @brief Whether simulate was given.  */
+  unsigned int trace_given ;	/**< @brief Whether trace was given.  */
+  unsigned int action_timeout_given ;	/**< @brief Whether action-timeout was given.  */
+  unsigned int max_actions_given ;	/**< @brief Whether max-actions was given.  */
+  unsigned int actions_given ;	/**< @brief Whether actions was given.  */
+  unsigned int action_workers_given ;	/**< @brief Whether action-workers was given.  */
+  unsigned int test_actions_given ;	/**< @brief Whether test-actions was given.  */
+  unsigned int announce_given ;	/**< @brief Whether announce was given.  */
+  unsigned int announce_key_given ;	/**< @brief Whether announce-key was given.  */
+  unsigned int announce_interval_given ;	/**< @brief Whether announce-interval was given.  */
+  unsigned int listen_given ;	/**< @brief Whether listen was given.  */
 
   char **inputs ; /**< @brief unamed options (options without names) */
   unsigned inputs_num ; /**< @brief unamed options number */
@@ -238,6 +384,10 @@ int cmdline_parser_required (struct gengetopt_args_info *args_info,
 extern const char *cmdline_parser_calc_method_values[];  /**< @brief Possible values for calc-method. */
 extern const char *cmdline_parser_asr_juristic_method_values[];  /**< @brief Possible values for asr-juristic-method. */
 extern const char *cmdline_parser_high_lats_method_values[];  /**< @brief Possible values for high-lats-method. */
+extern const char *cmdline_parser_audio_sink_values[];  /**< @brief Possible values for audio-sink. */
+extern const char *cmdline_parser_format_values[];  /**< @brief Possible values for format. */
+extern const char *cmdline_parser_batch_format_values[];  /**< @brief Possible values for batch-format. */
+extern const char *cmdline_parser_batch_output_values[];  /**< @brief Possible values for batch-output. */
 
 
 #ifdef __cplusplus
@@ -0,0 +1,83 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "eventloop.h"
+
+#define MAX_EVENTS 64
+#define MAX_HOOKS 8
+
+static int epoll_fd = -1;
+static event_hook_t hooks[MAX_HOOKS];
+static int hooks_count = 0;
+
+int event_loop_init(void) {
+    if (epoll_fd >= 0)
+        return 0;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return (epoll_fd < 0) ? -1 : 0;
+}
+
+static int event_loop_ctl(int op, event_source_t *source, uint32_t events) {
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.ptr = source;
+    return epoll_ctl(epoll_fd, op, source->fd, &ev);
+}
+
+int event_loop_add(event_source_t *source, uint32_t events) {
+    return event_loop_ctl(EPOLL_CTL_ADD, source, events);
+}
+
+int event_loop_modify(event_source_t *source, uint32_t events) {
+    return event_loop_ctl(EPOLL_CTL_MOD, source, events);
+}
+
+int event_loop_remove(event_source_t *source) {
+    return event_loop_ctl(EPOLL_CTL_DEL, source, 0);
+}
+
+int event_loop_add_hook(event_hook_t hook) {
+    if (hooks_count == MAX_HOOKS)
+        return -1;
+    hooks[hooks_count++] = hook;
+    return 0;
+}
+
+int event_loop_run_once(int timeout_ms) {
+    struct epoll_event events[MAX_EVENTS];
+    int n;
+
+    n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (n < 0) {
+        /* Signals interrupt the wait, that is not an error */
+        return (errno == EINTR) ? 0 : -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        event_source_t *source = (event_source_t *) events[i].data.ptr;
+        source->callback(source, events[i].events);
+    }
+
+    for (int i = 0; i < hooks_count; i++)
+        hooks[i]();
+
+    return n;
+}
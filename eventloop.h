@@ -0,0 +1,52 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/*
+ * Minimal epoll based event loop shared by the daemon's timers and sockets.
+ * A source is owned by its caller and must stay valid while registered.
+ */
+
+typedef struct _event_source event_source_t;
+
+typedef void (*event_callback_t)(event_source_t *source, uint32_t events);
+typedef void (*event_hook_t)(void);
+
+struct _event_source {
+    int fd;
+    event_callback_t callback;
+    void *data;
+};
+
+int event_loop_init(void);
+int event_loop_add(event_source_t *source, uint32_t events);
+int event_loop_modify(event_source_t *source, uint32_t events);
+int event_loop_remove(event_source_t *source);
+
+/*
+ * Run hook after every dispatched batch, e.g. to recycle sources that were
+ * closed while other events of the same batch could still point at them.
+ */
+int event_loop_add_hook(event_hook_t hook);
+
+/* Wait up to timeout_ms (-1 for ever) and dispatch ready sources */
+int event_loop_run_once(int timeout_ms);
+
+#endif /* EVENTLOOP_H */
@@ -0,0 +1,578 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "cmdline.h"
+#include "eventloop.h"
+#include "httpd.h"
+#include "schedule.h"
+#include "systemd.h"
+
+#define HTTP_IN_SIZE 8192
+#define HTTP_OUT_SIZE 65536
+#define HTTP_MAX_CONNECTIONS 1024
+#define HTTP_MAX_DAYS 366
+#define HTTP_MAX_HEADER 256
+#define HTTP_MAX_BODY (HTTP_MAX_DAYS * 160 + 256)
+#define HTTP_CACHE_SIZE 4096    /* must be a power of two */
+
+/*
+ * Every connection is a single block holding its state and both buffers.
+ * Closed blocks are kept on a free list, so a busy server does not touch
+ * the allocator once it reached its working set.
+ */
+typedef struct _http_conn {
+    event_source_t source;
+    struct _http_conn *next;
+    size_t in_len;
+    size_t out_pos;
+    size_t out_len;
+    int keep_alive;
+    int closing;
+    int peer_closed;            /* answer what was read, then close */
+    char in[HTTP_IN_SIZE];
+    char out[HTTP_OUT_SIZE];
+} http_conn_t;
+
+typedef struct _query_key {
+    double latitude;
+    double longitude;
+    double timezone;
+    long day;
+    int method;
+    int asr;
+} query_key_t;
+
+typedef struct _cache_entry {
+    query_key_t key;
+    int valid;
+    double times[PrayerTimes::TimesCount];
+} cache_entry_t;
+
+typedef struct _json_buf {
+    char *p;
+    char *end;
+} json_buf_t;
+
+static event_source_t listener;
+static http_conn_t *free_conns = NULL;
+static http_conn_t *released_conns = NULL;
+static int conns_count = 0;
+
+static uint32_t configs[PrayerTimes::CalculationMethodsCount][2];     /* by method, asr */
+static int default_method;
+static int default_asr;
+static cache_entry_t *cache = NULL;
+static char body[HTTP_MAX_BODY];
+
+static void conn_callback(event_source_t *source, uint32_t events);
+
+/* ---------------------- Result Cache ----------------------- */
+
+static const double *lookup_times(const query_key_t *key) {
+    const unsigned char *bytes = (const unsigned char *) key;
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < sizeof(*key); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+
+    cache_entry_t *entry = &cache[hash & (HTTP_CACHE_SIZE - 1)];
+    if (entry->valid && memcmp(&entry->key, key, sizeof(*key)) == 0) {
+        PrayerTimes::stats_count(PrayerTimes::StatCacheHits);
+        return entry->times;
+    }
+    PrayerTimes::stats_count(PrayerTimes::StatCacheMisses);
+
+    int year, month, day;
+    PrayerTimes::civil_from_days(key->day, year, month, day);
+    PrayerTimes::from_config_id(configs[key->method][key->asr]).get_prayer_times(year, month, day,
+        key->latitude, key->longitude, key->timezone, entry->times);
+    entry->key = *key;
+    entry->valid = 1;
+    return entry->times;
+}
+
+/* ---------------------- JSON Output ----------------------- */
+
+static void json_append(json_buf_t *buf, const char *s) {
+    size_t len = strlen(s);
+    if (len > (size_t) (buf->end - buf->p))
+        len = buf->end - buf->p;
+    memcpy(buf->p, s, len);
+    buf->p += len;
+}
+
+static void json_printf(json_buf_t *buf, const char *fmt, double value) {
+    int len = snprintf(buf->p, buf->end - buf->p, fmt, value);
+    if (len > 0)
+        buf->p += (len < buf->end - buf->p) ? len : buf->end - buf->p;
+}
+
+static void json_date(json_buf_t *buf, long days) {
+    int year, month, day;
+    char date[40];      /* quotes, dashes and three full ints */
+
+    PrayerTimes::civil_from_days(days, year, month, day);
+    snprintf(date, sizeof(date), "\"%04d-%02d-%02d\"", year, month, day);
+    json_append(buf, date);
+}
+
+/* ---------------------- Query Handling ----------------------- */
+
+static int parse_date(const char *s, long *days) {
+    int year, month, day;
+    char tail;
+
+    if (sscanf(s, "%4d-%2d-%2d%c", &year, &month, &day, &tail) != 3)
+        return -1;
+    if (!PrayerTimes::is_valid_date(year, month, day))
+        return -1;
+    *days = PrayerTimes::days_from_civil(year, month, day);
+    return 0;
+}
+
+static int parse_double(const char *s, double *value) {
+    char *end;
+
+    *value = strtod(s, &end);
+    return (end == s || *end != '\0') ? -1 : 0;
+}
+
+static int parse_value(const char *s, const char *values[]) {
+    for (int i = 0; values[i]; i++)
+        if (strcmp(s, values[i]) == 0)
+            return i;
+    return -1;
+}
+
+/* Build the JSON answer for a /times query, returns the HTTP status */
+static int handle_times(char *query, json_buf_t *out, const char **error) {
+    double latitude = NAN, longitude = NAN, timezone = NAN;
+    int method = default_method, asr = default_asr, days = 1;
+    time_t now = time(NULL);
+    struct tm *today = localtime(&now);
+    long first = PrayerTimes::days_from_civil(1900 + today->tm_year,
+        today->tm_mon + 1, today->tm_mday);
+
+    char *saveptr = NULL;
+
+    for (char *param = strtok_r(query, "&", &saveptr); param; param = strtok_r(NULL, "&", &saveptr)) {
+        char *value = strchr(param, '=');
+        int rc = 0;
+
+        if (value == NULL) {
+            *error = "malformed query";
+            return 400;
+        }
+        *value++ = '\0';
+
+        if (strcmp(param, "lat") == 0)
+            rc = parse_double(value, &latitude);
+        else if (strcmp(param, "lon") == 0)
+            rc = parse_double(value, &longitude);
+        else if (strcmp(param, "tz") == 0)
+            rc = parse_double(value, &timezone);
+        else if (strcmp(param, "date") == 0)
+            rc = parse_date(value, &first);
+        else if (strcmp(param, "days") == 0) {
+            days = atoi(value);
+            rc = (days < 1 || days > HTTP_MAX_DAYS) ? -1 : 0;
+        }
+        else if (strcmp(param, "method") == 0)
+            rc = ((method = parse_value(value, cmdline_parser_calc_method_values)) < 0) ? -1 : 0;
+        else if (strcmp(param, "asr") == 0)
+            rc = ((asr = parse_value(value, cmdline_parser_asr_juristic_method_values)) < 0) ? -1 : 0;
+
+        if (rc < 0) {
+            *error = "invalid query parameter";
+            return 400;
+        }
+    }
+
+    if (std::isnan(latitude) || std::isnan(longitude)) {
+        *error = "lat and lon are required";
+        return 400;
+    }
+
+    query_key_t key;
+    memset(&key, 0, sizeof(key));
+    key.latitude = latitude;
+    key.longitude = longitude;
+    key.method = method;
+    key.asr = asr;
+
+    json_append(out, "{\"latitude\":");
+    json_printf(out, "%.6g", latitude);
+    json_append(out, ",\"longitude\":");
+    json_printf(out, "%.6g", longitude);
+    json_append(out, ",\"method\":\"");
+    json_append(out, cmdline_parser_calc_method_values[key.method]);
+    json_append(out, "\",\"times\":[");
+
+    for (long d = first; d < first + days; d++) {
+        char time24[6];
+        int year, month, day;
+
+        PrayerTimes::civil_from_days(d, year, month, day);
+        key.day = d;
+        key.timezone = std::isnan(timezone) ?
+            PrayerTimes::get_effective_timezone(year, month, day) : timezone;
+
+        const double *times = lookup_times(&key);
+
+        json_append(out, (d == first) ? "{\"date\":" : ",{\"date\":");
+        json_date(out, d);
+        for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+            json_append(out, ",\"");
+            json_append(out, TimeKey[i]);
+            json_append(out, "\":\"");
+            json_append(out, PrayerTimes::float_time_to_time24(times[i], time24));
+            json_append(out, "\"");
+        }
+        json_append(out, "}");
+    }
+    json_append(out, "]}");
+
+    return 200;
+}
+
+/* ---------------------- Connections ----------------------- */
+
+static const char *status_reason(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 431: return "Request Header Fields Too Large";
+        default: return "Internal Server Error";
+    }
+}
+
+static void conn_respond(http_conn_t *conn, int status, const char *content, size_t length) {
+    char *out = conn->out + conn->out_len;
+    int header;
+
+    header = snprintf(out, HTTP_MAX_HEADER,
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: %zu\r\n"
+        "%s\r\n",
+        status, status_reason(status), length,
+        conn->keep_alive ? "" : "Connection: close\r\n");
+    memcpy(out + header, content, length);
+    conn->out_len += header + length;
+
+    if (!conn->keep_alive)
+        conn->closing = 1;
+}
+
+static void conn_error(http_conn_t *conn, int status, const char *error) {
+    json_buf_t out = { body, body + sizeof(body) };
+
+    json_append(&out, "{\"error\":\"");
+    json_append(&out, error);
+    json_append(&out, "\"}");
+    conn_respond(conn, status, body, out.p - body);
+}
+
+/* Handle one request, the header block is NUL terminated */
+static void conn_handle(http_conn_t *conn, char *request) {
+    char *target, *version, *line, *query;
+    const char *error = "";
+    int status;
+
+    target = strchr(request, ' ');
+    version = target ? strchr(target + 1, ' ') : NULL;
+    if (version == NULL) {
+        conn->keep_alive = 0;
+        conn_error(conn, 400, "malformed request line");
+        return;
+    }
+    *target++ = '\0';
+    *version++ = '\0';
+
+    line = strstr(version, "\r\n");
+    if (line)
+        *line = '\0';
+
+    conn->keep_alive = (strcmp(version, "HTTP/1.1") == 0);
+    while (line) {
+        line += 2;
+        if (strncasecmp(line, "Connection:", 11) == 0) {
+            if (strcasestr(line, "close"))
+                conn->keep_alive = 0;
+            else if (strcasestr(line, "keep-alive"))
+                conn->keep_alive = 1;
+        }
+        line = strstr(line, "\r\n");
+    }
+
+    if (strcmp(request, "GET") != 0) {
+        conn_error(conn, 405, "only GET is supported");
+        return;
+    }
+
+    query = strchr(target, '?');
+    if (query)
+        *query++ = '\0';
+
+    if (strcmp(target, "/times") != 0) {
+        conn_error(conn, 404, "unknown resource");
+        return;
+    }
+
+    json_buf_t out = { body, body + sizeof(body) };
+    status = handle_times(query ? query : (char *) "", &out, &error);
+    if (status != 200) {
+        conn_error(conn, status, error);
+        return;
+    }
+    conn_respond(conn, status, body, out.p - body);
+}
+
+static void conn_close(http_conn_t *conn) {
+    event_loop_remove(&conn->source);
+    close(conn->source.fd);
+    conn->source.fd = -1;
+
+    /* Recycled after the current batch, see recycle_conns() */
+    conn->next = released_conns;
+    released_conns = conn;
+    conns_count--;
+}
+
+static void recycle_conns(void) {
+    while (released_conns) {
+        http_conn_t *conn = released_conns;
+        released_conns = conn->next;
+        conn->next = free_conns;
+        free_conns = conn;
+    }
+}
+
+/* Answer every complete request in the input buffer (pipelining) */
+static void conn_process(http_conn_t *conn) {
+    size_t pos = 0;
+    int waiting = 0;
+
+    while (!conn->closing) {
+        char *end = (char *) memmem(conn->in + pos, conn->in_len - pos, "\r\n\r\n", 4);
+        if (end == NULL)
+            break;
+
+        if (conn->out_pos > 0) {
+            memmove(conn->out, conn->out + conn->out_pos, conn->out_len - conn->out_pos);
+            conn->out_len -= conn->out_pos;
+            conn->out_pos = 0;
+        }
+        if (HTTP_OUT_SIZE - conn->out_len < HTTP_MAX_HEADER + HTTP_MAX_BODY) {
+            waiting = 1;    /* wait till the client reads what we have */
+            break;
+        }
+
+        *end = '\0';
+        conn_handle(conn, conn->in + pos);
+        pos = end + 4 - conn->in;
+    }
+
+    memmove(conn->in, conn->in + pos, conn->in_len - pos);
+    conn->in_len -= pos;
+
+    if (conn->in_len == HTTP_IN_SIZE && !waiting && !conn->closing) {
+        conn->keep_alive = 0;
+        conn_error(conn, 431, "request too large");
+    }
+}
+
+/* Returns -1 when the connection is gone */
+static int conn_flush(http_conn_t *conn) {
+    while (conn->out_pos < conn->out_len) {
+        ssize_t n = send(conn->source.fd, conn->out + conn->out_pos,
+            conn->out_len - conn->out_pos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        conn->out_pos += n;
+    }
+
+    conn->out_pos = conn->out_len = 0;
+    return conn->closing ? -1 : 0;
+}
+
+static void conn_callback(event_source_t *source, uint32_t events) {
+    http_conn_t *conn = (http_conn_t *) source->data;
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        conn_close(conn);
+        return;
+    }
+
+    if (events & EPOLLIN) {
+        while (conn->in_len < HTTP_IN_SIZE) {
+            ssize_t n = recv(source->fd, conn->in + conn->in_len,
+                HTTP_IN_SIZE - conn->in_len, 0);
+            if (n == 0) {
+                conn->peer_closed = 1;
+                break;
+            }
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                conn_close(conn);
+                return;
+            }
+            conn->in_len += n;
+        }
+    }
+
+    do {
+        conn_process(conn);
+        if (conn_flush(conn) < 0) {
+            conn_close(conn);
+            return;
+        }
+    /* Output drained but pipelined requests are still waiting */
+    } while (conn->out_len == 0 && !conn->closing && memmem(conn->in, conn->in_len, "\r\n\r\n", 4));
+
+    if (conn->peer_closed && conn->out_len == 0) {
+        conn_close(conn);
+        return;
+    }
+
+    /* Stop reading while the client does not keep up with our answers */
+    event_loop_modify(source, (conn->out_len > 0) ? EPOLLOUT : EPOLLIN);
+}
+
+static void accept_callback(event_source_t *source, uint32_t events) {
+    while (true) {
+        int fd = accept4(source->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                syslog(LOG_WARNING, "HTTP accept failed: %s", strerror(errno));
+            return;
+        }
+
+        if (conns_count >= HTTP_MAX_CONNECTIONS) {
+            close(fd);
+            continue;
+        }
+
+        http_conn_t *conn = free_conns;
+        if (conn)
+            free_conns = conn->next;
+        else if ((conn = (http_conn_t *) malloc(sizeof(http_conn_t))) == NULL) {
+            close(fd);
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        conn->source.fd = fd;
+        conn->source.callback = conn_callback;
+        conn->source.data = conn;
+        conn->next = NULL;
+        conn->in_len = conn->out_pos = conn->out_len = 0;
+        conn->keep_alive = 1;
+        conn->closing = 0;
+        conn->peer_closed = 0;
+
+        if (event_loop_add(&conn->source, EPOLLIN) < 0) {
+            close(fd);
+            conn->next = free_conns;
+            free_conns = conn;
+            continue;
+        }
+        conns_count++;
+    }
+}
+
+void httpd_set_defaults(const PrayerTimes *defaults) {
+    /* Intern every variant a query can ask for once, misses only look them up */
+    for (int method = 0; method < PrayerTimes::CalculationMethodsCount; method++)
+        for (int asr = 0; asr < 2; asr++) {
+            PrayerTimes variant = *defaults;
+            variant.set_calc_method((PrayerTimes::CalculationMethod) method);
+            variant.set_asr_method((PrayerTimes::JuristicMethod) asr);
+            configs[method][asr] = variant.get_config_id();
+        }
+    default_method = defaults->get_calc_method();
+    default_asr = defaults->get_asr_method();
+    if (cache != NULL)
+        memset(cache, 0, HTTP_CACHE_SIZE * sizeof(cache_entry_t));
+}
+
+int httpd_init(const char *address, int port, const PrayerTimes *defaults) {
+    struct sockaddr_in addr;
+    int fd, one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+        syslog(LOG_ERR, "Invalid HTTP listen address %s", address);
+        return -1;
+    }
+
+    cache = (cache_entry_t *) calloc(HTTP_CACHE_SIZE, sizeof(cache_entry_t));
+    if (cache == NULL)
+        return -1;
+    httpd_set_defaults(defaults);
+
+    fd = systemd_listen_fd((struct sockaddr *) &addr);
+    if (fd < 0) {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return -1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+            syslog(LOG_ERR, "Unable to listen on %s:%d: %s", address, port, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+
+    listener.fd = fd;
+    listener.callback = accept_callback;
+    listener.data = NULL;
+    if (event_loop_add(&listener, EPOLLIN) < 0 || event_loop_add_hook(recycle_conns) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    syslog(LOG_INFO, "Serving prayer times on http://%s:%d/times", address, port);
+    return 0;
+}
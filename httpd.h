@@ -0,0 +1,37 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPD_H
+#define HTTPD_H
+
+#include "prayertimes.hpp"
+
+/*
+ * HTTP/1.1 query server running on the daemon's event loop.
+ *
+ *   GET /times?lat=&lon=[&date=YYYY-MM-DD][&days=N][&method=][&asr=][&tz=]
+ *
+ * answers with a JSON timetable of N consecutive days (default 1) starting
+ * at date (default today). method and asr take the same values as the
+ * --calc-method and --asr-juristic-method options, the daemon's own
+ * configuration is used for everything not given in the query.
+ */
+
+int httpd_init(const char *address, int port, const PrayerTimes *defaults);
+
+/* Use a reloaded configuration for new queries and drop cached results */
+void httpd_set_defaults(const PrayerTimes *defaults);
+
+#endif /* HTTPD_H */
@@ -0,0 +1,225 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Pipelined load client for ptimes --serve. Keeps CONNECTIONS keep-alive
+    connections with DEPTH requests in flight each for SECONDS seconds and
+    reports the throughput and latency quantiles; a request's latency runs
+    from sending it to reading the end of its answer:
+
+    g++ -O2 -o httpload httpload.cpp
+    ./httpload [-a ADDRESS] [-p PORT] [-c CONNECTIONS] [-d DEPTH] [-t SECONDS] [-n LOCATIONS]
+
+    The requests cycle over LOCATIONS latitudes (default 1, every request a
+    cache hit after the first); use a larger count to measure misses. The
+    latency grows with CONNECTIONS x DEPTH (default 16 x 4) once the server
+    is saturated, so find the rate first and then the latency at that load.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <vector>
+
+#define LOAD_IN_SIZE 65536
+#define LOAD_MAX_DEPTH 256
+
+typedef struct _load_conn {
+    int fd;
+    size_t in_len;
+    int head;                           /* oldest request in flight */
+    int pending;
+    uint64_t sent[LOAD_MAX_DEPTH];      /* send times of the requests in flight */
+    char in[LOAD_IN_SIZE];
+} load_conn_t;
+
+static int locations = 1;
+static unsigned long counter = 0;
+static std::vector<uint64_t> latencies;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int send_requests(load_conn_t *conn, int count) {
+    char out[LOAD_MAX_DEPTH * 128];
+    size_t len = 0;
+    uint64_t now = now_ns();
+
+    for (int i = 0; i < count; i++) {
+        len += snprintf(out + len, sizeof(out) - len,
+            "GET /times?lat=%.3f&lon=39.83&date=2024-03-11 HTTP/1.1\r\nHost: ptimes\r\n\r\n",
+            21.0 + (counter++ % locations) * 0.001);
+        conn->sent[(conn->head + conn->pending++) % LOAD_MAX_DEPTH] = now;
+    }
+    /* A few kilobytes always fit the socket buffer of an idle connection */
+    return send(conn->fd, out, len, MSG_NOSIGNAL) == (ssize_t) len ? 0 : -1;
+}
+
+/* Take the complete answers off the input buffer, returns how many or -1 */
+static int read_answers(load_conn_t *conn, uint64_t now) {
+    size_t pos = 0;
+    int count = 0;
+
+    while (conn->pending > 0) {
+        char *end = (char *) memmem(conn->in + pos, conn->in_len - pos, "\r\n\r\n", 4);
+        if (end == NULL)
+            break;
+        *end = '\0';
+        char *length = strcasestr(conn->in + pos, "Content-Length:");
+        if (strncmp(conn->in + pos, "HTTP/1.1 200", 12) != 0 || length == NULL)
+            return -1;
+        size_t total = end + 4 - (conn->in + pos) + strtoul(length + 15, NULL, 10);
+        if (conn->in_len - pos < total) {
+            *end = '\r';
+            break;
+        }
+
+        latencies.push_back(now - conn->sent[conn->head]);
+        conn->head = (conn->head + 1) % LOAD_MAX_DEPTH;
+        conn->pending--;
+        pos += total;
+        count++;
+    }
+
+    memmove(conn->in, conn->in + pos, conn->in_len - pos);
+    conn->in_len -= pos;
+    return count;
+}
+
+static double quantile(double q) {
+    size_t i = (size_t) (q * (latencies.size() - 1));
+    return latencies[i] / 1000.0;
+}
+
+int main(int argc, char **argv) {
+    const char *address = "127.0.0.1";
+    int port = 8080, connections = 16, depth = 4, seconds = 10, opt;
+    struct sockaddr_in addr;
+    struct epoll_event ev, events[64];
+    uint64_t start, stop, finished;
+    int epfd;
+
+    while ((opt = getopt(argc, argv, "a:p:c:d:t:n:")) != -1) {
+        switch (opt) {
+            case 'a': address = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'c': connections = atoi(optarg); break;
+            case 'd': depth = atoi(optarg); break;
+            case 't': seconds = atoi(optarg); break;
+            case 'n': locations = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-a ADDRESS] [-p PORT] [-c CONNECTIONS] [-d DEPTH] "
+                    "[-t SECONDS] [-n LOCATIONS]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (connections < 1 || depth < 1 || depth > LOAD_MAX_DEPTH || seconds < 1 || locations < 1) {
+        fprintf(stderr, "%s: invalid arguments, DEPTH is at most %d\n", argv[0], LOAD_MAX_DEPTH);
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+        fprintf(stderr, "%s: invalid address %s\n", argv[0], address);
+        return 1;
+    }
+
+    epfd = epoll_create1(0);
+    std::vector<load_conn_t *> conns;
+    for (int i = 0; i < connections; i++) {
+        load_conn_t *conn = (load_conn_t *) calloc(1, sizeof(load_conn_t));
+        int one = 1;
+
+        conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (conn->fd < 0 || connect(conn->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+            perror("connect");
+            return 1;
+        }
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, conn->fd, &ev);
+        conns.push_back(conn);
+    }
+    latencies.reserve((size_t) seconds * 100000);
+
+    start = now_ns();
+    stop = start + (uint64_t) seconds * 1000000000ull;
+    for (size_t i = 0; i < conns.size(); i++)
+        if (send_requests(conns[i], depth) < 0) {
+            perror("send");
+            return 1;
+        }
+
+    /* Closed loop: every answer sends the next request until the time is up */
+    int in_flight = connections * depth;
+    while (in_flight > 0) {
+        int n = epoll_wait(epfd, events, 64, 1000);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            return 1;
+        }
+        for (int i = 0; i < n; i++) {
+            load_conn_t *conn = (load_conn_t *) events[i].data.ptr;
+            ssize_t len = recv(conn->fd, conn->in + conn->in_len, LOAD_IN_SIZE - conn->in_len, 0);
+            if (len <= 0) {
+                fprintf(stderr, "%s: connection closed by the server\n", argv[0]);
+                return 1;
+            }
+            conn->in_len += len;
+
+            uint64_t now = now_ns();
+            int answered = read_answers(conn, now);
+            if (answered < 0) {
+                fprintf(stderr, "%s: unexpected answer\n", argv[0]);
+                return 1;
+            }
+            in_flight -= answered;
+            if (answered > 0 && now < stop) {
+                if (send_requests(conn, answered) < 0) {
+                    perror("send");
+                    return 1;
+                }
+                in_flight += answered;
+            }
+        }
+    }
+    finished = now_ns();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("connections  %d x %d in flight\n", connections, depth);
+    printf("requests     %zu in %.3f s\n", latencies.size(), (finished - start) / 1e9);
+    printf("throughput   %.0f req/s\n", latencies.size() / ((finished - start) / 1e9));
+    printf("latency us   p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+        quantile(0.5), quantile(0.9), quantile(0.99), quantile(0.999), quantile(1));
+    return 0;
+}
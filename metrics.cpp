@@ -0,0 +1,292 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "audio.h"
+#include "eventloop.h"
+#include "metrics.h"
+#include "prayertimes.hpp"
+#include "vclock.h"
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_SHIFTS 44      /* values up to 2^48 ns, about three days */
+#define HIST_BUCKETS ((HIST_SHIFTS + 1) * HIST_SUB)
+
+typedef struct _histogram {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t count;
+    int64_t sum;
+    int64_t max;
+} histogram_t;
+
+static const struct {
+    const char *name;
+    const char *help;
+} histogram_info[METRIC_HISTOGRAMS] = {
+    { "ptimes_alert_wakeup_delay_seconds", "Delay from prayer time to the timer wakeup" },
+    { "ptimes_alert_action_delay_seconds", "Delay from prayer time to the start of the alert action" },
+    { "ptimes_alert_audio_delay_seconds", "Delay from prayer time to the first audio samples" },
+    { "ptimes_schedule_compute_seconds", "Time spent computing the schedule" },
+    { "ptimes_action_spawn_seconds", "Time from spawning an alert action to its exec" },
+    { "ptimes_pipeline_start_delay_seconds", "Delay from the firing time of a pipeline action to its start" },
+    { "ptimes_pipeline_run_seconds", "Run time of pipeline actions" },
+};
+
+static const struct {
+    const char *name;
+    const char *help;
+} counter_info[METRIC_COUNTERS] = {
+    { "ptimes_wakeups_total", "Event loop wakeups" },
+    { "ptimes_alerts_total", "Alerts fired" },
+    { "ptimes_schedule_computes_total", "Schedule computations" },
+    { "ptimes_action_failures_total", "Alert actions that failed to start or exited with an error" },
+    { "ptimes_action_timeouts_total", "Alert actions killed at their time limit" },
+    { "ptimes_actions_cancelled_total", "Alert actions stopped because the next one started" },
+    { "ptimes_actions_refused_total", "Alert actions not started because too many were running" },
+    { "ptimes_pipeline_runs_total", "Pipeline actions started" },
+    { "ptimes_pipeline_misses_total", "Pipeline actions that failed or missed their deadline" },
+    { "ptimes_pipeline_drops_total", "Pipeline actions dropped because the queue was full" },
+};
+
+/* Calculation instrumentation, only in builds with -DPRAYERTIMES_STATS */
+static const struct {
+    const char *name;
+    const char *help;
+} calc_counter_info[PrayerTimes::StatCountersCount] = {
+    { "ptimes_calc_days_total", "Days of prayer times computed" },
+    { "ptimes_calc_trig_calls_total", "Trigonometric function calls" },
+    { "ptimes_calc_high_lat_fallbacks_total", "Undefined times replaced by a night portion" },
+    { "ptimes_calc_cache_hits_total", "Prayer time lookups answered from a cache" },
+    { "ptimes_calc_cache_misses_total", "Prayer time lookups that had to compute" },
+};
+
+static const char *calc_timer_names[PrayerTimes::StatTimersCount] = {
+    "compute_times", "adjust_times", "sun_position"
+};
+
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+static histogram_t histograms[METRIC_HISTOGRAMS];
+static uint64_t counters[METRIC_COUNTERS];
+static time_t last_alert = -1;
+static int64_t last_audio_request = 0;
+
+static const char *textfile = NULL;
+static event_source_t flush_timer;
+
+int64_t metrics_now_ns(void) {
+    return vclock_now_ns();
+}
+
+int64_t metrics_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* ---------------------- Histograms ----------------------- */
+
+static int bucket_index(uint64_t v) {
+    if (v < HIST_SUB)
+        return (int) v;
+
+    int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+    if (shift >= HIST_SHIFTS)
+        return HIST_BUCKETS - 1;
+    return (shift + 1) * HIST_SUB + (int) ((v >> shift) - HIST_SUB);
+}
+
+/* Highest value that falls into a bucket */
+static uint64_t bucket_upper(int index) {
+    if (index < HIST_SUB)
+        return index;
+
+    int shift = index / HIST_SUB - 1;
+    uint64_t sub = index % HIST_SUB;
+    return ((HIST_SUB + sub + 1) << shift) - 1;
+}
+
+static uint64_t histogram_quantile(const histogram_t *h, double q) {
+    uint64_t rank = (uint64_t) (q * h->count + 0.5), seen = 0;
+
+    if (rank == 0)
+        rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t upper = bucket_upper(i);
+            return (upper < (uint64_t) h->max) ? upper : h->max;
+        }
+    }
+    return h->max;
+}
+
+void metrics_record(int histogram, int64_t ns) {
+    histogram_t *h = &histograms[histogram];
+
+    /* Early wakeups count as on time */
+    if (ns < 0)
+        ns = 0;
+    h->counts[bucket_index(ns)]++;
+    h->count++;
+    h->sum += ns;
+    if (ns > h->max)
+        h->max = ns;
+}
+
+void metrics_count(int counter) {
+    counters[counter]++;
+}
+
+void metrics_alert(time_t scheduled) {
+    last_alert = scheduled;
+}
+
+/* The audio thread reports its start asynchronously, pick it up once */
+static void collect_audio_start(void) {
+    int64_t requested, started;
+
+    if (last_alert < 0)
+        return;
+
+    audio_last_start(&requested, &started);
+    if (started == 0 || requested == last_audio_request)
+        return;
+
+    last_audio_request = requested;
+    metrics_record(METRIC_AUDIO_DELAY, started - (int64_t) last_alert * 1000000000);
+}
+
+/* ---------------------- Exposition ----------------------- */
+
+size_t metrics_format(char *buf, size_t size) {
+    size_t len = 0;
+
+#define APPEND(...) do { \
+        int n = snprintf(buf + len, size - len, __VA_ARGS__); \
+        if (n > 0) len += ((size_t) n < size - len) ? (size_t) n : size - len - 1; \
+    } while (0)
+
+    collect_audio_start();
+
+    for (int i = 0; i < METRIC_HISTOGRAMS; i++) {
+        const histogram_t *h = &histograms[i];
+        const char *name = histogram_info[i].name;
+
+        APPEND("# HELP %s %s\n# TYPE %s summary\n", name, histogram_info[i].help, name);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+            APPEND("%s{quantile=\"%g\"} %.9f\n", name, quantiles[q],
+                h->count ? histogram_quantile(h, quantiles[q]) / 1e9 : 0.0);
+        APPEND("%s_sum %.9f\n%s_count %llu\n", name, h->sum / 1e9, name,
+            (unsigned long long) h->count);
+    }
+
+    for (int i = 0; i < METRIC_COUNTERS; i++)
+        APPEND("# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counter_info[i].name,
+            counter_info[i].help, counter_info[i].name, counter_info[i].name,
+            (unsigned long long) counters[i]);
+
+    if (PrayerTimes::StatsEnabled) {
+        PrayerTimes::StatsSnapshot stats;
+        PrayerTimes::stats_snapshot(stats);
+
+        for (int i = 0; i < PrayerTimes::StatCountersCount; i++)
+            APPEND("# HELP %s %s\n# TYPE %s counter\n%s %llu\n", calc_counter_info[i].name,
+                calc_counter_info[i].help, calc_counter_info[i].name, calc_counter_info[i].name,
+                (unsigned long long) stats.counters[i]);
+
+        /* Timers nest, sun_position is part of compute_times */
+        APPEND("# HELP ptimes_calc_seconds_total Time spent in a calculation step, including nested steps\n"
+            "# TYPE ptimes_calc_seconds_total counter\n");
+        for (int i = 0; i < PrayerTimes::StatTimersCount; i++)
+            APPEND("ptimes_calc_seconds_total{step=\"%s\"} %.9f\n", calc_timer_names[i],
+                stats.nanoseconds[i] / 1e9);
+        APPEND("# HELP ptimes_calc_calls_total Calls of a calculation step\n"
+            "# TYPE ptimes_calc_calls_total counter\n");
+        for (int i = 0; i < PrayerTimes::StatTimersCount; i++)
+            APPEND("ptimes_calc_calls_total{step=\"%s\"} %llu\n", calc_timer_names[i],
+                (unsigned long long) stats.timer_calls[i]);
+    }
+
+    if (last_alert >= 0)
+        APPEND("# HELP ptimes_last_alert_timestamp_seconds Prayer time of the last alert\n"
+            "# TYPE ptimes_last_alert_timestamp_seconds gauge\n"
+            "ptimes_last_alert_timestamp_seconds %ld\n", (long) last_alert);
+
+#undef APPEND
+    return len;
+}
+
+/* Replace the textfile atomically so node_exporter never reads half of it */
+void metrics_flush(void) {
+    char buf[METRICS_TEXT_SIZE], tmp[4096];
+    size_t len;
+    FILE *f;
+
+    if (textfile == NULL)
+        return;
+
+    len = metrics_format(buf, sizeof(buf));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", textfile);
+    f = fopen(tmp, "w");
+    if (f == NULL) {
+        syslog(LOG_WARNING, "Unable to write %s: %s", tmp, strerror(errno));
+        return;
+    }
+    fwrite(buf, 1, len, f);
+    if (fclose(f) != 0 || rename(tmp, textfile) != 0) {
+        syslog(LOG_WARNING, "Unable to write %s: %s", textfile, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+static void flush_timer_callback(event_source_t *source, uint32_t events) {
+    uint64_t expirations;
+
+    if (read(source->fd, &expirations, sizeof(expirations)) > 0)
+        metrics_flush();
+}
+
+int metrics_init(const char *path, int interval) {
+    struct itimerspec its;
+
+    textfile = path;
+    if (textfile == NULL)
+        return 0;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = interval;
+    its.it_interval.tv_sec = interval;
+
+    flush_timer.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    flush_timer.callback = flush_timer_callback;
+    flush_timer.data = NULL;
+    if (flush_timer.fd < 0 || timerfd_settime(flush_timer.fd, 0, &its, NULL) < 0
+            || event_loop_add(&flush_timer, EPOLLIN) < 0) {
+        syslog(LOG_ERR, "Unable to create metrics timer: %s", strerror(errno));
+        return -1;
+    }
+
+    metrics_flush();
+    return 0;
+}
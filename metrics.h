@@ -0,0 +1,74 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Alert latency instrumentation. Durations go into log-linear (HDR style)
+ * histograms with 1/16 relative precision and are exported in Prometheus
+ * text format, either to a node_exporter textfile or on request.
+ */
+
+enum {
+    METRIC_WAKEUP_DELAY,    /* prayer time to timer wakeup */
+    METRIC_ACTION_DELAY,    /* prayer time to alert action start */
+    METRIC_AUDIO_DELAY,     /* prayer time to first audio samples */
+    METRIC_COMPUTE,         /* schedule computation */
+    METRIC_SPAWN_DELAY,     /* posix_spawn of an alert action to its exec */
+    METRIC_PIPELINE_DELAY,  /* firing time of a pipeline action to its start */
+    METRIC_PIPELINE_RUN,    /* run time of a pipeline action */
+
+    METRIC_HISTOGRAMS
+};
+
+enum {
+    METRIC_WAKEUPS,         /* event loop wakeups */
+    METRIC_ALERTS,          /* alerts fired */
+    METRIC_COMPUTES,        /* schedule computations */
+    METRIC_ACTION_FAILURES, /* actions that did not start or exited with an error */
+    METRIC_ACTION_TIMEOUTS, /* actions killed at their time limit */
+    METRIC_ACTION_CANCELS,  /* actions stopped for an overlapping one */
+    METRIC_ACTION_REFUSALS, /* actions not started, too many running */
+    METRIC_PIPELINE_RUNS,   /* pipeline actions started */
+    METRIC_PIPELINE_MISSES, /* pipeline actions failed or past their deadline */
+    METRIC_PIPELINE_DROPS,  /* pipeline actions dropped, queue full */
+
+    METRIC_COUNTERS
+};
+
+/* Wall clock for comparing against prayer times, monotonic for durations */
+int64_t metrics_now_ns(void);
+int64_t metrics_monotonic_ns(void);
+
+void metrics_record(int histogram, int64_t ns);
+void metrics_count(int counter);
+
+/* Remember the time of the prayer being alerted, for later audio timing */
+void metrics_alert(time_t scheduled);
+
+/* Prometheus text exposition into buf, returns its length */
+#define METRICS_TEXT_SIZE 8192
+size_t metrics_format(char *buf, size_t size);
+
+/* Write the textfile now and every interval seconds, path may be NULL */
+int metrics_init(const char *textfile, int interval);
+void metrics_flush(void);
+
+#endif /* METRICS_H */
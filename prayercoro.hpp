@@ -0,0 +1,485 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PRAYERCORO_HPP
+#define PRAYERCORO_HPP
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <atomic>
+#include <cmath>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <system_error>
+#include <vector>
+
+#include "prayertimes.hpp"
+
+/* ------------------- Prayer Coroutines -------------------- */
+
+/*
+    C++20 coroutine interface to prayer events, for services that already
+    run an event loop and cannot give a thread (or the blocking sleep of
+    the ptimes daemon) to every location.
+
+    A coroutine suspends until the next prayer of a location:
+
+    PrayerEvent event = co_await next_prayer(executor, prayer_times, location);
+
+    or takes the events of a location one after the other:
+
+    PrayerEventStream events(executor, prayer_times, location);
+    for (;;)
+        PrayerEvent event = co_await events.next();
+
+    Suspended coroutines wait on the executor. Any loop adapts by deriving
+    from PrayerExecutor (e.g. an asio steady_timer per resume_at call);
+    EpollExecutor is a small built-in one that keeps every pending wakeup
+    in a heap behind a single timerfd, so one thread serves thousands of
+    locations. A coroutine must not be destroyed while it is suspended.
+*/
+
+struct PrayerLocation
+{
+    double latitude;
+    double longitude;
+    double timezone;        // fixed UTC offset in hours
+};
+
+struct PrayerEvent
+{
+    PrayerTimes::TimeID time_id;
+    time_t when;
+};
+
+enum
+{
+    // events reported by default, same as the ptimes daemon
+    PrayerEventMask = (1 << PrayerTimes::Fajr) | (1 << PrayerTimes::Dhuhr) |
+                      (1 << PrayerTimes::Asr) | (1 << PrayerTimes::Maghrib) |
+                      (1 << PrayerTimes::Isha),
+};
+
+/* ---------------------- Executor Interface ----------------------- */
+
+class PrayerExecutor
+{
+public:
+    virtual ~PrayerExecutor()
+    {
+    }
+
+    /* current wall clock time */
+    virtual time_t now()
+    {
+        return time(NULL);
+    }
+
+    /* resume handle from the loop as soon as possible */
+    virtual void post(std::coroutine_handle<> handle) = 0;
+
+    /* resume handle from the loop once the wall clock reaches when */
+    virtual void resume_at(time_t when, std::coroutine_handle<> handle) = 0;
+};
+
+/* ---------------------- Event Calculation ----------------------- */
+
+/*
+    the first event of mask after (after, after_id) in (time, TimeID) order,
+    so that events sharing a second (e.g. Sunset and Maghrib) all come out;
+    returns false when none is found within a year (e.g. polar night)
+*/
+inline bool find_next_prayer(const PrayerTimes& prayer_times, const PrayerLocation& location,
+                             unsigned int mask, time_t after, int after_id, PrayerEvent& event)
+{
+    const int64_t seconds_in_day = 86400;
+    const int max_empty_days = 366;
+
+    int64_t local = after + (int64_t) (location.timezone * 3600);
+    int64_t day = local >= 0 ? local / seconds_in_day : (local - seconds_in_day + 1) / seconds_in_day;
+
+    // days without any selected event (e.g. polar night) must not loop forever
+    for (int days = 0; days < max_empty_days; ++days)
+    {
+        double times[PrayerTimes::TimesCount];
+        int year, month, mday;
+        bool found = false;
+
+        PrayerTimes::civil_from_days(day + days, year, month, mday);
+        prayer_times.get_prayer_times(year, month, mday, location.latitude, location.longitude,
+                                      location.timezone, times);
+
+        // times past midnight wrap around, so pick the earliest one instead
+        // of walking TimeIDs
+        time_t midnight = (day + days) * seconds_in_day - (time_t) (location.timezone * 3600);
+        for (int i = 0; i < PrayerTimes::TimesCount; ++i)
+        {
+            if (!(mask & (1 << i)) || std::isnan(times[i]))
+                continue;
+            int hours, minutes;
+            PrayerTimes::get_float_time_parts(times[i], hours, minutes);
+            time_t when = midnight + (hours * 60 + minutes) * 60;
+            if (when < after || (when == after && i <= after_id))
+                continue;
+            if (!found || when < event.when || (when == event.when && i < event.time_id))
+            {
+                event.time_id = (PrayerTimes::TimeID) i;
+                event.when = when;
+                found = true;
+            }
+        }
+        if (found)
+            return true;
+    }
+    return false;
+}
+
+/* ---------------------- Awaitables ----------------------- */
+
+/*
+    awaitable of the first event after (after, after_id), resuming when it
+    is due; await_resume returns a TimesCount time_id when there is none
+*/
+class PrayerAwaitable
+{
+public:
+    PrayerAwaitable(PrayerExecutor& executor, const PrayerTimes& prayer_times,
+                    const PrayerLocation& location, unsigned int mask, time_t after, int after_id)
+    : executor(executor)
+    {
+        if (!find_next_prayer(prayer_times, location, mask, after, after_id, event))
+        {
+            event.time_id = PrayerTimes::TimesCount;
+            event.when = -1;
+        }
+    }
+
+    bool await_ready() const
+    {
+        return event.when < 0;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        if (event.when <= executor.now())
+            executor.post(handle);
+        else
+            executor.resume_at(event.when, handle);
+    }
+
+    PrayerEvent await_resume() const
+    {
+        return event;
+    }
+
+private:
+    PrayerExecutor& executor;
+    PrayerEvent event;
+};
+
+/* suspend until the next prayer of location after the current time */
+inline PrayerAwaitable next_prayer(PrayerExecutor& executor, const PrayerTimes& prayer_times,
+                                   const PrayerLocation& location, unsigned int mask = PrayerEventMask)
+{
+    return PrayerAwaitable(executor, prayer_times, location, mask, executor.now(), PrayerTimes::TimesCount);
+}
+
+/*
+    the events of one location in order, each co_await next() suspends
+    until the following one; a stream holds only its last event, so
+    thousands of them cost no more than the coroutines awaiting them
+*/
+class PrayerEventStream
+{
+public:
+    PrayerEventStream(PrayerExecutor& executor, const PrayerTimes& prayer_times,
+                      const PrayerLocation& location, unsigned int mask = PrayerEventMask)
+    : executor(executor)
+    , config_id(prayer_times.get_config_id())
+    , location(location)
+    , mask(mask)
+    , last_when(executor.now())
+    , last_id(PrayerTimes::TimesCount)
+    {
+    }
+
+    struct Next : PrayerAwaitable
+    {
+        Next(PrayerEventStream& stream)
+        : PrayerAwaitable(stream.executor, PrayerTimes::from_config_id(stream.config_id),
+                          stream.location, stream.mask, stream.last_when, stream.last_id)
+        , stream(stream)
+        {
+        }
+
+        PrayerEvent await_resume() const
+        {
+            PrayerEvent event = PrayerAwaitable::await_resume();
+            if (event.when >= 0)
+            {
+                stream.last_when = event.when;
+                stream.last_id = event.time_id;
+            }
+            return event;
+        }
+
+        PrayerEventStream& stream;
+    };
+
+    Next next()
+    {
+        return Next(*this);
+    }
+
+private:
+    PrayerExecutor& executor;
+    uint32_t config_id;
+    PrayerLocation location;
+    unsigned int mask;
+    time_t last_when;
+    int last_id;
+};
+
+/* ---------------------- Detached Task ----------------------- */
+
+/*
+    coroutine return type for fire-and-forget tasks: the body runs until its
+    first suspension on the spot and frees itself when it returns
+*/
+struct PrayerTask
+{
+    struct promise_type
+    {
+        PrayerTask get_return_object()
+        {
+            return PrayerTask();
+        }
+
+        std::suspend_never initial_suspend()
+        {
+            return std::suspend_never();
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return std::suspend_never();
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+};
+
+/* ---------------------- EpollExecutor Class ----------------------- */
+
+/*
+    single threaded executor: run() resumes the coroutines on the calling
+    thread, post() and stop() may also be called from other threads.
+    Wakeups are kept in a min-heap and the timerfd is armed for the
+    earliest one; it is cancelled by wall clock changes, so an event never
+    fires early when the clock is set back.
+*/
+class EpollExecutor : public PrayerExecutor
+{
+public:
+    EpollExecutor()
+    : epoll_fd(-1)
+    , timer_fd(-1)
+    , wake_fd(-1)
+    , armed(-1)
+    , sequence(0)
+    , stopped(false)
+    {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0 || timer_fd < 0 || wake_fd < 0 ||
+            watch(timer_fd) < 0 || watch(wake_fd) < 0)
+        {
+            int error = errno;
+            close_fds();
+            throw std::system_error(error, std::generic_category(), "EpollExecutor");
+        }
+    }
+
+    ~EpollExecutor()
+    {
+        close_fds();
+    }
+
+    void post(std::coroutine_handle<> handle)
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex);
+        posted.push_back(handle);
+        if (posted.size() == 1)
+        {
+            uint64_t one = 1;
+            (void) !write(wake_fd, &one, sizeof(one));
+        }
+    }
+
+    /* loop thread only, i.e. from a coroutine run by this executor */
+    void resume_at(time_t when, std::coroutine_handle<> handle)
+    {
+        Wakeup wakeup = { when, sequence++, handle };
+        timers.push(wakeup);
+    }
+
+    /* resume coroutines until stop() is called */
+    void run()
+    {
+        while (!stopped)
+            run_once(-1);
+    }
+
+    /* wait up to timeout_ms (-1 for ever) and resume the coroutines due */
+    void run_once(int timeout_ms)
+    {
+        struct epoll_event events[2];
+
+        run_posted();
+        run_timers();
+        arm();
+        if (stopped)
+            return;
+
+        int n = epoll_wait(epoll_fd, events, 2, timeout_ms);
+        for (int i = 0; i < n; ++i)
+        {
+            uint64_t count;
+            // the timerfd read fails with ECANCELED after a clock change,
+            // the heap is checked against the clock in either case
+            (void) !read(events[i].data.fd, &count, sizeof(count));
+            if (events[i].data.fd == timer_fd)
+                armed = -1;
+        }
+
+        run_posted();
+        run_timers();
+    }
+
+    void stop()
+    {
+        stopped = true;
+        uint64_t one = 1;
+        (void) !write(wake_fd, &one, sizeof(one));
+    }
+
+    size_t pending() const
+    {
+        return timers.size();
+    }
+
+private:
+/* ---------------------- Loop Internals ----------------------- */
+
+    struct Wakeup
+    {
+        time_t when;
+        uint64_t sequence;      // keeps wakeups of the same second in order
+        std::coroutine_handle<> handle;
+
+        bool operator>(const Wakeup& other) const
+        {
+            return when != other.when ? when > other.when : sequence > other.sequence;
+        }
+    };
+
+    int watch(int fd)
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void run_posted()
+    {
+        std::vector<std::coroutine_handle<> > batch;
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex);
+            batch.swap(posted);
+        }
+        for (size_t i = 0; i < batch.size(); ++i)
+            batch[i].resume();
+    }
+
+    void run_timers()
+    {
+        time_t now = this->now();
+        // a resumed coroutine may push a wakeup that is already due
+        while (!timers.empty() && timers.top().when <= now)
+        {
+            std::coroutine_handle<> handle = timers.top().handle;
+            timers.pop();
+            handle.resume();
+        }
+    }
+
+    /* arm the timerfd for the earliest wakeup unless it already is */
+    void arm()
+    {
+        if (timers.empty() || timers.top().when == armed)
+            return;
+
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = timers.top().when;
+        if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) == 0)
+            armed = timers.top().when;
+    }
+
+    void close_fds()
+    {
+        if (epoll_fd >= 0)
+            close(epoll_fd);
+        if (timer_fd >= 0)
+            close(timer_fd);
+        if (wake_fd >= 0)
+            close(wake_fd);
+    }
+
+private:
+/* ---------------------- Private Variables -------------------- */
+
+    int epoll_fd;
+    int timer_fd;
+    int wake_fd;
+    time_t armed;                       // expiry the timerfd is set to, -1 if none
+    uint64_t sequence;
+    std::atomic<bool> stopped;
+
+    std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup> > timers;
+    std::mutex posted_mutex;
+    std::vector<std::coroutine_handle<> > posted;
+};
+
+#endif /* PRAYERCORO_HPP */
@@ -0,0 +1,392 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PRAYERSCHEDULER_HPP
+#define PRAYERSCHEDULER_HPP
+
+#include <stdint.h>
+#include <time.h>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "prayertimes.hpp"
+
+/* ------------------- PrayerScheduler Class -------------------- */
+
+/*
+    Keeps the next due prayer event for a large number of subscribers.
+
+    Every subscriber owns exactly one entry in a hashed timing wheel with
+    one second resolution. Only the current local day of a subscriber is
+    materialized, and the following day is needed when its last event
+    fires. precompute() fills the following day into a second buffer ahead
+    of time, in small slices spread over the hours before, so that whole
+    time zones rolling over at once only swap buffers on the hot path.
+
+    PrayerScheduler scheduler(time(NULL));
+    profile = scheduler.add_profile(prayer_times)
+    id = scheduler.add_subscriber(profile, latitude, longitude, timezone)
+    scheduler.remove_subscriber(id)
+    scheduler.pop_due(now, &events)     // append all events due at or before now
+    scheduler.precompute(now, budget)   // when idle, until next_precompute()
+*/
+
+class PrayerScheduler
+{
+public:
+    enum
+    {
+        // events reported by default, same as the ptimes daemon
+        PrayerEvents = (1 << PrayerTimes::Fajr) | (1 << PrayerTimes::Dhuhr) |
+                       (1 << PrayerTimes::Asr) | (1 << PrayerTimes::Maghrib) |
+                       (1 << PrayerTimes::Isha),
+        AllEvents = (1 << PrayerTimes::TimesCount) - 1,
+    };
+
+    enum
+    {
+        InvalidId = 0xffffffffu,
+    };
+
+    struct Event
+    {
+        uint32_t subscriber;
+        PrayerTimes::TimeID time_id;
+        time_t when;
+    };
+
+    PrayerScheduler(time_t now, unsigned int event_mask = PrayerEvents)
+    : event_mask(event_mask & AllEvents)
+    , current(now)
+    , wheel(WHEEL_SLOTS, InvalidId)
+    {
+    }
+
+    /* register a calculator configuration shared by many subscribers,
+       the profile is the id of its interned configuration */
+    uint32_t add_profile(const PrayerTimes& prayer_times)
+    {
+        return prayer_times.get_config_id();
+    }
+
+    /* add a subscriber, timezone is the fixed UTC offset in hours */
+    uint32_t add_subscriber(uint32_t profile, double latitude, double longitude, double timezone)
+    {
+        uint32_t id = subscribers.size();
+        Subscriber s;
+        s.latitude = latitude;
+        s.longitude = longitude;
+        s.timezone = timezone;
+        s.profile = profile;
+        s.active = 0;
+        s.day = local_day(current, timezone);
+        s.spare_day = -1;
+        subscribers.push_back(s);
+        links.push_back(InvalidId);
+        due.push_back(0);
+
+        materialize_day(id);
+        advance(id, current, -1);
+        return id;
+    }
+
+    /* stop delivering events for a subscriber, its entry is dropped lazily */
+    void remove_subscriber(uint32_t id)
+    {
+        if (id < subscribers.size())
+            subscribers[id].profile = InvalidId;
+    }
+
+    /* append every event due at or before now to events, in time order */
+    size_t pop_due(time_t now, std::vector<Event>& events)
+    {
+        size_t count = events.size();
+
+        // every slot maps to exactly one second of the lap being walked
+        for (; current <= now; ++current)
+            while (wheel[current & WHEEL_MASK] != InvalidId && drain_slot(current, events))
+                ;
+
+        return events.size() - count;
+    }
+
+    /* earliest pending event time, or -1 when nothing is scheduled */
+    time_t next_due() const
+    {
+        for (time_t t = current; t < current + WHEEL_SLOTS; ++t)
+        {
+            time_t earliest = -1;
+            for (uint32_t id = wheel[t & WHEEL_MASK]; id != InvalidId; id = links[id])
+                if (subscribers[id].profile != InvalidId && due[id] <= t && (earliest < 0 || due[id] < earliest))
+                    earliest = due[id];
+            if (earliest >= 0)
+                return earliest;
+        }
+        return -1;
+    }
+
+    /* compute up to budget following days whose slice is due at or before
+       now, returns the number computed; run it when the loop is idle */
+    size_t precompute(time_t now, size_t budget)
+    {
+        size_t count = 0;
+
+        while (count < budget && !planned.empty() && planned.top().when <= now)
+        {
+            Plan plan = planned.top();
+            planned.pop();
+
+            // skip plans of removed subscribers and of days already loaded
+            Subscriber& s = subscribers[plan.subscriber];
+            if (s.profile == InvalidId || s.day + 1 != plan.day || s.spare_day == plan.day)
+                continue;
+
+            compute_day(s, plan.day, s.seconds[s.active ^ 1]);
+            s.spare_day = plan.day;     // publish only once complete
+            ++count;
+        }
+        return count;
+    }
+
+    /* time of the next due precompute slice, or -1 when nothing is planned */
+    time_t next_precompute() const
+    {
+        return planned.empty() ? -1 : planned.top().when;
+    }
+
+    size_t subscriber_count() const
+    {
+        return subscribers.size();
+    }
+
+private:
+/* ---------------------- Subscriber State ----------------------- */
+
+    struct Subscriber
+    {
+        double latitude;
+        double longitude;
+        double timezone;
+        uint32_t profile;
+        uint8_t due_time;           // TimeID of the pending event
+        uint8_t active;             // buffer of the materialized day
+        int64_t day;                // materialized local day (days since epoch)
+        int64_t spare_day;          // day in the other buffer, -1 if none
+        int32_t seconds[2][PrayerTimes::TimesCount];   // seconds after local midnight, -1 if undefined
+    };
+
+    struct Plan
+    {
+        time_t when;
+        int64_t day;
+        uint32_t subscriber;
+
+        bool operator>(const Plan& other) const
+        {
+            return when > other.when;
+        }
+    };
+
+    void compute_day(const Subscriber& s, int64_t day, int32_t seconds[])
+    {
+        double times[PrayerTimes::TimesCount];
+        int year, month, mday;
+
+        PrayerTimes::civil_from_days(day, year, month, mday);
+        PrayerTimes::from_config_id(s.profile).get_prayer_times(year, month, mday, s.latitude, s.longitude, s.timezone, times);
+
+        for (int i = 0; i < PrayerTimes::TimesCount; ++i)
+        {
+            if (std::isnan(times[i]))
+            {
+                seconds[i] = -1;
+                continue;
+            }
+            int hours, minutes;
+            PrayerTimes::get_float_time_parts(times[i], hours, minutes);
+            seconds[i] = (hours * 60 + minutes) * 60;
+        }
+    }
+
+    /* make the local day of a subscriber current, swapping in the
+       precomputed buffer when it holds that day */
+    void materialize_day(uint32_t id)
+    {
+        Subscriber& s = subscribers[id];
+
+        if (s.spare_day == s.day)
+        {
+            PrayerTimes::stats_count(PrayerTimes::StatCacheHits);
+            s.active ^= 1;
+        }
+        else
+        {
+            PrayerTimes::stats_count(PrayerTimes::StatCacheMisses);
+            compute_day(s, s.day, s.seconds[s.active]);
+        }
+        s.spare_day = -1;
+        plan_precompute(id);
+    }
+
+    /* plan the following day for a slice before the last event of the day,
+       when it is needed; subscribers are spread over the window by id */
+    void plan_precompute(uint32_t id)
+    {
+        const Subscriber& s = subscribers[id];
+        time_t midnight = s.day * SECONDS_IN_DAY - (time_t) (s.timezone * 3600);
+        time_t deadline = midnight;
+
+        for (int i = 0; i < PrayerTimes::TimesCount; ++i)
+            if ((event_mask & (1 << i)) && s.seconds[s.active][i] >= 0 && midnight + s.seconds[s.active][i] > deadline)
+                deadline = midnight + s.seconds[s.active][i];
+
+        // a day without events is skipped at once, nothing to prepare
+        if (deadline == midnight)
+            return;
+
+        time_t first = deadline - PRECOMPUTE_WINDOW;
+        if (first < current)
+            first = current;
+        time_t span = deadline - PRECOMPUTE_MARGIN - first;
+
+        Plan plan;
+        plan.when = first + (span > 0 ? (time_t) ((id * 2654435761u) % span) : 0);
+        plan.day = s.day + 1;
+        plan.subscriber = id;
+        planned.push(plan);
+    }
+
+    /* find the event following (after, after_id) and put it on the wheel */
+    void advance(uint32_t id, time_t after, int after_id)
+    {
+        Subscriber& s = subscribers[id];
+
+        // times past midnight wrap around, so pick the earliest one instead of
+        // walking TimeIDs; days without any selected event (e.g. polar night)
+        // must not loop forever
+        for (int days = 0; days < MAX_EMPTY_DAYS; ++days)
+        {
+            time_t midnight = s.day * SECONDS_IN_DAY - (time_t) (s.timezone * 3600);
+            time_t best = -1;
+            int best_id = -1;
+            for (int i = 0; i < PrayerTimes::TimesCount; ++i)
+            {
+                if (!(event_mask & (1 << i)) || s.seconds[s.active][i] < 0)
+                    continue;
+                time_t when = midnight + s.seconds[s.active][i];
+                if (when < after || (when == after && i <= after_id))
+                    continue;
+                if (best_id < 0 || when < best || (when == best && i < best_id))
+                {
+                    best = when;
+                    best_id = i;
+                }
+            }
+            if (best_id >= 0)
+            {
+                s.due_time = best_id;
+                insert(id, best);
+                return;
+            }
+            ++s.day;
+            materialize_day(id);
+        }
+    }
+
+    void insert(uint32_t id, time_t when)
+    {
+        due[id] = when;
+        time_t slot = when < current ? current : when;
+        links[id] = wheel[slot & WHEEL_MASK];
+        wheel[slot & WHEEL_MASK] = id;
+    }
+
+    /* fire the entries of second t, returns false when nothing was due */
+    bool drain_slot(time_t t, std::vector<Event>& events)
+    {
+        size_t slot = t & WHEEL_MASK;
+        uint32_t id = wheel[slot];
+        uint32_t fired = InvalidId;
+        wheel[slot] = InvalidId;
+
+        // split the slot into entries of a later lap and entries due now
+        while (id != InvalidId)
+        {
+            uint32_t next = links[id];
+            if (subscribers[id].profile == InvalidId)
+                ;   // removed subscriber, drop the entry
+            else if (due[id] > t)
+            {
+                links[id] = wheel[slot];
+                wheel[slot] = id;
+            }
+            else
+            {
+                links[id] = fired;
+                fired = id;
+            }
+            id = next;
+        }
+
+        if (fired == InvalidId)
+            return false;
+
+        // an event at the same second lands back in this slot
+        for (id = fired; id != InvalidId; )
+        {
+            uint32_t next = links[id];
+            Subscriber& s = subscribers[id];
+            Event event = { id, (PrayerTimes::TimeID) s.due_time, due[id] };
+            events.push_back(event);
+
+            advance(id, due[id], s.due_time);
+            id = next;
+        }
+        return true;
+    }
+
+/* ---------------------- Calendar Functions ----------------------- */
+
+    /* local day number (days since 1970-01-01) of an instant */
+    static int64_t local_day(time_t t, double timezone)
+    {
+        int64_t local = t + (int64_t) (timezone * 3600);
+        return local >= 0 ? local / SECONDS_IN_DAY : (local - SECONDS_IN_DAY + 1) / SECONDS_IN_DAY;
+    }
+
+private:
+/* ---------------------- Private Variables -------------------- */
+
+    unsigned int event_mask;
+    time_t current;                     // first second not yet drained
+
+    std::vector<Subscriber> subscribers;
+    std::vector<time_t> due;            // pending event time per subscriber
+    std::vector<uint32_t> links;        // intrusive slot lists
+    std::vector<uint32_t> wheel;        // slot heads
+    std::priority_queue<Plan, std::vector<Plan>, std::greater<Plan> > planned;
+
+/* --------------------- Technical Settings -------------------- */
+
+    static const int64_t SECONDS_IN_DAY = 86400;
+    static const int MAX_EMPTY_DAYS = 366;
+    static const time_t WHEEL_SLOTS = 1 << 17;     // 36 hours, one lap covers a whole day
+    static const time_t WHEEL_MASK = WHEEL_SLOTS - 1;
+    static const time_t PRECOMPUTE_WINDOW = 6 * 3600;  // slices start this long before a day is needed
+    static const time_t PRECOMPUTE_MARGIN = 60;
+};
+
+#endif /* PRAYERSCHEDULER_HPP */
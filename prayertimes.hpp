@@ -37,9 +37,84 @@ http://code.ebrahim.ir/prayertimes/
 
 \*--------------------------------------------------------------------------*/
 
+#ifndef PRAYERTIMES_HPP
+#define PRAYERTIMES_HPP
+
 #include <cstdio>
+#include <cstdlib>
 #include <cmath>
+#include <ctime>
+#include <cstring>
+#include <atomic>
+#include <limits>
+#include <stdint.h>
+#include <mutex>
+#include <new>
 #include <string>
+#include <unordered_map>
+
+/*
+    The calculation chain is constexpr where the compiler can tell a
+    constant evaluation from a runtime call (C++14 with GCC 9 or Clang 9,
+    or C++20); constant evaluation uses the series in PrayerTimes::Math,
+    runtime calls keep using libm. The scoped timers of PRAYERTIMES_STATS
+    need C++20 for that.
+*/
+#if __cplusplus >= 202002L
+#include <type_traits>
+#define PRAYERTIMES_CONSTEXPR constexpr
+#define PRAYERTIMES_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#elif defined(PRAYERTIMES_STATS)
+    // not constexpr
+#elif __cplusplus >= 201402L && defined(__clang__)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define PRAYERTIMES_CONSTEXPR constexpr
+#define PRAYERTIMES_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#elif __cplusplus >= 201402L && defined(__GNUC__) && __GNUC__ >= 9
+#define PRAYERTIMES_CONSTEXPR constexpr
+#define PRAYERTIMES_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+
+#ifndef PRAYERTIMES_CONSTEXPR
+#define PRAYERTIMES_CONSTEXPR
+#define PRAYERTIMES_CONSTANT_EVALUATED() false
+#endif
+
+/*
+    USDT probes (provider "prayertimes") where <sys/sdt.h> is available, a
+    nop until a tracer attaches:
+
+    times_entry, times_return       year, month, day of get_prayer_times
+    range_entry, range_return       first day, count of get_prayer_times_range
+    batch_entry, batch_return       count of get_prayer_times_batch
+    high_lat_adjust                 time id, 1 if the time was undefined
+*/
+#if defined(__has_include) && !defined(PRAYERTIMES_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PRAYERTIMES_PROBE(name, ...) STAP_PROBEV(prayertimes, name, ##__VA_ARGS__)
+#endif
+#endif
+
+#ifndef PRAYERTIMES_PROBE
+#define PRAYERTIMES_PROBE(name, ...) do { } while (0)
+#endif
+
+/*
+    Instrumentation hooks of the calculation, compiled in with
+    -DPRAYERTIMES_STATS (see PrayerTimes::stats_snapshot) and expanding to
+    nothing otherwise.
+*/
+#ifdef PRAYERTIMES_STATS
+#include <chrono>
+#define PRAYERTIMES_COUNT(counter) \
+    do { if (!PRAYERTIMES_CONSTANT_EVALUATED()) stats_count(counter); } while (0)
+#define PRAYERTIMES_TIMER(timer) StatsTimer stats_timer(timer)
+#else
+#define PRAYERTIMES_COUNT(counter) do { } while (0)
+#define PRAYERTIMES_TIMER(timer) do { } while (0)
+#endif
 
 /* -------------------- PrayerTimes Class --------------------- */
 
@@ -60,9 +135,15 @@ public:
 
     get_prayer_times(date, latitude, longitude, timezone, &times)
     get_prayer_times(year, month, day, latitude, longitude, timezone, &times)
+    get_prayer_times_range(first_day, count, latitude, longitude, timezone, &times)
+    get_prayer_times_batch(count, latitudes, longitudes, julian_dates, timezones, &times)
+    compute_prayer_times(day, latitude, longitude, timezone, calc_method,
+            asr_juristic, adjust_high_lats, dhuhr_minutes, &times)      // constexpr
 
     set_calc_method(method_id)
     set_asr_method(method_id)
+    get_calc_method()
+    get_asr_method()
     set_high_lats_adjust_method(method_id)      // adjust method for higher latitudes
 
     set_fajr_angle(angle)
@@ -72,8 +153,20 @@ public:
     set_maghrib_minutes(minutes)        // minutes after sunset
     set_isha_minutes(minutes)       // minutes after maghrib
 
+    get_config_id()     // shared by equally configured calculators
+    from_config_id(config_id)
+    config_count()      // distinct configurations interned so far
+
+    days_from_civil(year, month, day)
+    civil_from_days(days, &year, &month, &day)
+    is_valid_date(year, month, day)     // false for e.g. 2024-02-30
+
+    stats_count(counter, n)     // with PRAYERTIMES_STATS, per thread
+    stats_snapshot(&snapshot)       // sum over all threads
+
     get_float_time_parts(time, &hours, &minutes)
     float_time_to_time24(time)
+    float_time_to_time24(time, buf)
     float_time_to_time12(time)
     float_time_to_time12ns(time)
 */
@@ -128,106 +221,196 @@ public:
             JuristicMethod asr_juristic = Shafii,
             AdjustingMethod adjust_high_lats = MidNight,
             double dhuhr_minutes = 0)
-    : calc_method(calc_method)
-    , asr_juristic(asr_juristic)
-    , adjust_high_lats(adjust_high_lats)
-    , dhuhr_minutes(dhuhr_minutes)
+    : config_id(intern(Config(calc_method, asr_juristic, adjust_high_lats, dhuhr_minutes)))
     {
-        method_params[Jafari]  = MethodConfig(16.0, false, 4.0, false, 14.0);   // Jafari
-        method_params[Karachi] = MethodConfig(18.0, true,  0.0, false, 18.0);   // Karachi
-        method_params[ISNA]    = MethodConfig(15.0, true,  0.0, false, 15.0);   // ISNA
-        method_params[MWL]     = MethodConfig(18.0, true,  0.0, false, 17.0);   // MWL
-        method_params[Makkah]  = MethodConfig(19.0, true,  0.0, true,  90.0);   // Makkah
-        method_params[Egypt]   = MethodConfig(19.5, true,  0.0, false, 17.5);   // Egypt
-        method_params[Custom]  = MethodConfig(18.0, true,  0.0, false, 17.0);   // Custom
+    }
+
+    /* calculator viewing a configuration id returned by get_config_id(),
+       aborts on ids that were never handed out */
+    static PrayerTimes from_config_id(uint32_t config_id)
+    {
+        if (!ConfigRegistry::instance().contains(config_id))
+            abort();
+        PrayerTimes prayer_times;
+        prayer_times.config_id = config_id;
+        return prayer_times;
+    }
+
+    /* id of the interned configuration, equal for equally configured calculators */
+    uint32_t get_config_id() const
+    {
+        return config_id;
+    }
+
+    /* number of distinct configurations interned so far */
+    static uint32_t config_count()
+    {
+        return ConfigRegistry::instance().size();
     }
 
     /* return prayer times for a given date */
-    void get_prayer_times(int year, int month, int day, double _latitude, double _longitude, double _timezone, double times[])
+    void get_prayer_times(int year, int month, int day, double _latitude, double _longitude, double _timezone, double times[]) const
     {
-        latitude = _latitude;
-        longitude = _longitude;
-        timezone = _timezone;
-        julian_date = get_julian_date(year, month, day) - longitude / (double) (15 * 24);
-        compute_day_times(times);
+        PRAYERTIMES_PROBE(times_entry, year, month, day);
+        Query q = query(_latitude, _longitude, _timezone);
+        q.julian_date = get_julian_date(year, month, day) - _longitude / (double) (15 * 24);
+        compute_day_times(q, times);
+        PRAYERTIMES_PROBE(times_return, year, month, day);
+    }
+
+    /* return prayer times for count consecutive days starting at a day number
+       (days since 1970-01-01), TimesCount values per day */
+    void get_prayer_times_range(long first_day, int count, double _latitude, double _longitude, double _timezone, double times[]) const
+    {
+        PRAYERTIMES_PROBE(range_entry, first_day, count);
+        Query q = query(_latitude, _longitude, _timezone);
+        for (int i = 0; i < count; ++i)
+        {
+            // 2440587.5 is the julian date of 1970-01-01
+            q.julian_date = 2440587.5 + first_day + i - _longitude / (double) (15 * 24);
+            compute_day_times(q, times + i * TimesCount);
+        }
+        PRAYERTIMES_PROBE(range_return, first_day, count);
+    }
+
+    /* return prayer times for count independent entries; julian_dates are
+       those of 0h UT of the dates (2440587.5 + days since 1970-01-01) and
+       timezones may be NULL for UTC; TimesCount values per entry */
+    void get_prayer_times_batch(size_t count, const double latitudes[], const double longitudes[],
+            const double julian_dates[], const double timezones[], double times[]) const
+    {
+        PRAYERTIMES_PROBE(batch_entry, count);
+        Query q = query(0, 0, 0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            q.latitude = latitudes[i];
+            q.longitude = longitudes[i];
+            q.timezone = timezones ? timezones[i] : 0;
+            q.julian_date = julian_dates[i] - longitudes[i] / (double) (15 * 24);
+            compute_day_times(q, times + i * TimesCount);
+        }
+        PRAYERTIMES_PROBE(batch_return, count);
     }
 
     /* return prayer times for a given date */
-    void get_prayer_times(time_t date, double latitude, double longitude, double timezone, double times[])
+    void get_prayer_times(time_t date, double latitude, double longitude, double timezone, double times[]) const
     {
         tm* t = localtime(&date);
         get_prayer_times(1900 + t->tm_year, t->tm_mon + 1, t->tm_mday, latitude, longitude, timezone, times);
     }
 
+    /* return prayer times of a day number (days since 1970-01-01) for a
+       predefined method; usable in constant expressions, e.g. to bake a
+       timetable into a binary (see ptclock.cpp) */
+    static PRAYERTIMES_CONSTEXPR void compute_prayer_times(long day, double latitude, double longitude, double timezone,
+            CalculationMethod calc_method, JuristicMethod asr_juristic, AdjustingMethod adjust_high_lats,
+            double dhuhr_minutes, double times[])
+    {
+        Query q = { method_params(calc_method), asr_juristic, adjust_high_lats, dhuhr_minutes,
+                    latitude, longitude, timezone,
+                    2440587.5 + day - longitude / (double) (15 * 24) };
+        compute_day_times(q, times);
+    }
+
     /* set the calculation method  */
     void set_calc_method(CalculationMethod method_id)
     {
-        calc_method = method_id;
+        Config c = config();
+        c.calc_method = method_id;
+        config_id = intern(c);
+    }
+
+    /* get the calculation method */
+    CalculationMethod get_calc_method() const
+    {
+        return config().calc_method;
+    }
+
+    /* get the juristic method for Asr */
+    JuristicMethod get_asr_method() const
+    {
+        return config().asr_juristic;
     }
 
     /* set the juristic method for Asr */
     void set_asr_method(JuristicMethod method_id)
     {
-        asr_juristic = method_id;
+        Config c = config();
+        c.asr_juristic = method_id;
+        config_id = intern(c);
     }
 
     /* set adjusting method for higher latitudes */
     void set_high_lats_adjust_method(AdjustingMethod method_id)
     {
-        adjust_high_lats = method_id;
+        Config c = config();
+        c.adjust_high_lats = method_id;
+        config_id = intern(c);
     }
 
     /* set the angle for calculating Fajr */
     void set_fajr_angle(double angle)
     {
-        method_params[Custom].fajr_angle = angle;
-        calc_method = Custom;
+        Config c = config();
+        c.custom.fajr_angle = angle;
+        c.calc_method = Custom;
+        config_id = intern(c);
     }
 
     /* set the angle for calculating Maghrib */
     void set_maghrib_angle(double angle)
     {
-        method_params[Custom].maghrib_is_minutes = false;
-        method_params[Custom].maghrib_value = angle;
-        calc_method = Custom;
+        Config c = config();
+        c.custom.maghrib_is_minutes = false;
+        c.custom.maghrib_value = angle;
+        c.calc_method = Custom;
+        config_id = intern(c);
     }
 
     /* set the angle for calculating Isha */
     void set_isha_angle(double angle)
     {
-        method_params[Custom].isha_is_minutes = false;
-        method_params[Custom].isha_value = angle;
-        calc_method = Custom;
+        Config c = config();
+        c.custom.isha_is_minutes = false;
+        c.custom.isha_value = angle;
+        c.calc_method = Custom;
+        config_id = intern(c);
     }
 
     /* set the minutes after mid-day for calculating Dhuhr */
     void set_dhuhr_minutes(double minutes)
     {
-        dhuhr_minutes = minutes;
+        Config c = config();
+        c.dhuhr_minutes = minutes;
+        config_id = intern(c);
     }
 
     /* set the minutes after Sunset for calculating Maghrib */
     void set_maghrib_minutes(double minutes)
     {
-        method_params[Custom].maghrib_is_minutes = true;
-        method_params[Custom].maghrib_value = minutes;
-        calc_method = Custom;
+        Config c = config();
+        c.custom.maghrib_is_minutes = true;
+        c.custom.maghrib_value = minutes;
+        c.calc_method = Custom;
+        config_id = intern(c);
     }
 
     /* set the minutes after Maghrib for calculating Isha */
     void set_isha_minutes(double minutes)
     {
-        method_params[Custom].isha_is_minutes = true;
-        method_params[Custom].isha_value = minutes;
-        calc_method = Custom;
+        Config c = config();
+        c.custom.isha_is_minutes = true;
+        c.custom.isha_value = minutes;
+        c.calc_method = Custom;
+        config_id = intern(c);
     }
 
     /* get hours and minutes parts of a float time */
-    static void get_float_time_parts(double time, int& hours, int& minutes)
+    static PRAYERTIMES_CONSTEXPR void get_float_time_parts(double time, int& hours, int& minutes)
     {
         time = fix_hour(time + 0.5 / 60);       // add 0.5 minutes to round
-        hours = floor(time);
-        minutes = floor((time - hours) * 60);
+        hours = Math::floor(time);
+        minutes = Math::floor((time - hours) * 60);
     }
 
     /* convert float hours to 24h format */
@@ -240,6 +423,25 @@ public:
         return two_digits_format(hours) + ':' + two_digits_format(minutes);
     }
 
+    /* convert float hours to 24h format into buf (at least 6 chars), no allocation */
+    static char* float_time_to_time24(double time, char* buf)
+    {
+        int hours, minutes;
+        if (std::isnan(time))
+        {
+            buf[0] = '\0';
+            return buf;
+        }
+        get_float_time_parts(time, hours, minutes);
+        buf[0] = '0' + hours / 10;
+        buf[1] = '0' + hours % 10;
+        buf[2] = ':';
+        buf[3] = '0' + minutes / 10;
+        buf[4] = '0' + minutes % 10;
+        buf[5] = '\0';
+        return buf;
+    }
+
     /* convert float time to epoch */
     static time_t float_time_to_epoch(double time, time_t date) {
         time_t now;
@@ -301,6 +503,106 @@ public:
         return get_effective_timezone(local);
     }
 
+/* ---------------------- Calendar Functions ----------------------- */
+
+    /* convert a proleptic Gregorian date to days since 1970-01-01 */
+    static PRAYERTIMES_CONSTEXPR long days_from_civil(int year, int month, int day)
+    {
+        year -= month <= 2;
+        long era = (year >= 0 ? year : year - 399) / 400;
+        unsigned yoe = (unsigned) (year - era * 400);
+        unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + (long) doe - 719468;
+    }
+
+    /* convert days since 1970-01-01 to a proleptic Gregorian date */
+    static void civil_from_days(long z, int& year, int& month, int& day)
+    {
+        z += 719468;
+        long era = (z >= 0 ? z : z - 146096) / 146097;
+        unsigned doe = (unsigned) (z - era * 146097);
+        unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        unsigned mp = (5 * doy + 2) / 153;
+        day = doy - (153 * mp + 2) / 5 + 1;
+        month = mp < 10 ? mp + 3 : mp - 9;
+        year = (int) (yoe + era * 400) + (month <= 2);
+    }
+
+    /* whether a date exists in the proleptic Gregorian calendar */
+    static bool is_valid_date(int year, int month, int day)
+    {
+        int y, m, d;
+
+        if (month < 1 || month > 12 || day < 1 || day > 31)
+            return false;
+        civil_from_days(days_from_civil(year, month, day), y, m, d);
+        return y == year && m == month && d == day;
+    }
+
+/* ---------------------- Instrumentation ----------------------- */
+
+    // Counters of the calculation work
+    enum StatCounter
+    {
+        StatDays,               // days computed
+        StatTrigCalls,          // trigonometric function calls
+        StatHighLatFallbacks,   // undefined Fajr, Isha or Maghrib replaced by a night portion
+        StatCacheHits,          // result caches in front of the calculator
+        StatCacheMisses,
+
+        StatCountersCount
+    };
+
+    // Scoped timers, the time of nested ones is included in the outer ones
+    enum StatTimer
+    {
+        TimerComputeTimes,
+        TimerAdjustTimes,
+        TimerSunPosition,
+
+        StatTimersCount
+    };
+
+    struct StatsSnapshot
+    {
+        uint64_t counters[StatCountersCount];
+        uint64_t timer_calls[StatTimersCount];
+        uint64_t nanoseconds[StatTimersCount];
+    };
+
+#ifdef PRAYERTIMES_STATS
+    static const bool StatsEnabled = true;
+#else
+    static const bool StatsEnabled = false;
+#endif
+
+    /* add to a counter of the calling thread, e.g. from a cache in front
+       of the calculator; does nothing without PRAYERTIMES_STATS */
+    static void stats_count(StatCounter counter, uint64_t n = 1)
+    {
+#ifdef PRAYERTIMES_STATS
+        bump(thread_stats().counters[counter], n);
+#else
+        (void) counter;
+        (void) n;
+#endif
+    }
+
+    /* sum the counters and timers of all threads, including exited ones */
+    static void stats_snapshot(StatsSnapshot& snapshot)
+    {
+        memset(&snapshot, 0, sizeof(snapshot));
+#ifdef PRAYERTIMES_STATS
+        StatsRegistry& registry = StatsRegistry::instance();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        snapshot = registry.retired;
+        for (const ThreadStats* t = registry.threads; t != NULL; t = t->next)
+            t->add_to(snapshot);
+#endif
+    }
+
 private:
 /* ------------------- Calc Method Parameters -------------------- */
 
@@ -310,7 +612,7 @@ private:
         {
         }
 
-        MethodConfig(double fajr_angle,
+        constexpr MethodConfig(double fajr_angle,
                 bool maghrib_is_minutes,
                 double maghrib_value,
                 bool isha_is_minutes,
@@ -323,6 +625,15 @@ private:
         {
         }
 
+        constexpr bool operator==(const MethodConfig& other) const
+        {
+            return fajr_angle == other.fajr_angle
+                && maghrib_is_minutes == other.maghrib_is_minutes
+                && maghrib_value == other.maghrib_value
+                && isha_is_minutes == other.isha_is_minutes
+                && isha_value == other.isha_value;
+        }
+
         double fajr_angle;
         bool   maghrib_is_minutes;
         double maghrib_value;       // angle or minutes
@@ -330,6 +641,174 @@ private:
         double isha_value;      // angle or minutes
     };
 
+    /* parameters of the predefined methods, Custom starts from its row */
+    static constexpr MethodConfig method_params(CalculationMethod method)
+    {
+        return method == Jafari  ? MethodConfig(16.0, false, 4.0, false, 14.0) :
+               method == Karachi ? MethodConfig(18.0, true,  0.0, false, 18.0) :
+               method == ISNA    ? MethodConfig(15.0, true,  0.0, false, 15.0) :
+               method == MWL     ? MethodConfig(18.0, true,  0.0, false, 17.0) :
+               method == Makkah  ? MethodConfig(19.0, true,  0.0, true,  90.0) :
+               method == Egypt   ? MethodConfig(19.5, true,  0.0, false, 17.5) :
+                                   MethodConfig(18.0, true,  0.0, false, 17.0);    // Custom
+    }
+
+/* ------------------- Interned Configurations -------------------- */
+
+    /* everything a calculator is configured with; the predefined rows of
+       the method table never change, so only the Custom row is kept */
+    struct Config
+    {
+        Config(CalculationMethod calc_method,
+                JuristicMethod asr_juristic,
+                AdjustingMethod adjust_high_lats,
+                double dhuhr_minutes)
+        : calc_method(calc_method)
+        , asr_juristic(asr_juristic)
+        , adjust_high_lats(adjust_high_lats)
+        , dhuhr_minutes(dhuhr_minutes)
+        , custom(method_params(Custom))
+        {
+        }
+
+        bool operator==(const Config& other) const
+        {
+            return calc_method == other.calc_method
+                && asr_juristic == other.asr_juristic
+                && adjust_high_lats == other.adjust_high_lats
+                && dhuhr_minutes == other.dhuhr_minutes
+                && custom == other.custom;
+        }
+
+        CalculationMethod calc_method;      // caculation method
+        JuristicMethod asr_juristic;        // Juristic method for Asr
+        AdjustingMethod adjust_high_lats;   // adjusting method for higher latitudes
+        double dhuhr_minutes;       // minutes after mid-day for Dhuhr
+        MethodConfig custom;        // parameters of the Custom method
+    };
+
+    struct ConfigHash
+    {
+        size_t operator()(const Config& c) const
+        {
+            double values[] = { c.dhuhr_minutes, c.custom.fajr_angle, c.custom.maghrib_value, c.custom.isha_value };
+            int flags[] = { c.calc_method, c.asr_juristic, c.adjust_high_lats,
+                            c.custom.maghrib_is_minutes, c.custom.isha_is_minutes };
+            uint64_t hash = 14695981039346656037ull;        // FNV-1a over 64-bit words
+            for (int i = 0; i < 4; ++i)
+                hash = (hash ^ (values[i] == 0 ? 0 : bits(values[i]))) * 1099511628211ull;    // -0.0 == 0.0
+            for (int i = 0; i < 5; ++i)
+                hash = (hash ^ flags[i]) * 1099511628211ull;
+            return hash;
+        }
+
+        static uint64_t bits(double d)
+        {
+            uint64_t u;
+            memcpy(&u, &d, sizeof(u));
+            return u;
+        }
+    };
+
+    /*
+        Append-only table of configurations, one entry per distinct value.
+        Entries never move, so looking one up by id takes no lock; only
+        interning a configuration does.
+    */
+    class ConfigRegistry
+    {
+    public:
+        static ConfigRegistry& instance()
+        {
+            static ConfigRegistry registry;
+            return registry;
+        }
+
+        uint32_t intern(const Config& config)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            std::unordered_map<Config, uint32_t, ConfigHash>::const_iterator it = ids.find(config);
+            if (it != ids.end())
+                return it->second;
+
+            uint32_t id = ids.size();
+            if (id / BLOCK_SIZE >= MAX_BLOCKS)
+                abort();        // millions of distinct configurations, not a real workload
+            Config*& block = blocks[id / BLOCK_SIZE];
+            if (block == NULL && (block = static_cast<Config*>(malloc(BLOCK_SIZE * sizeof(Config)))) == NULL)
+                abort();
+            new (&block[id % BLOCK_SIZE]) Config(config);
+            ids.insert(std::make_pair(config, id));
+            published.store(id + 1, std::memory_order_release);
+            return id;
+        }
+
+        /* lock-free, for checking ids on the hot path */
+        bool contains(uint32_t id) const
+        {
+            return id < published.load(std::memory_order_acquire);
+        }
+
+        const Config& get(uint32_t id) const
+        {
+            return blocks[id / BLOCK_SIZE][id % BLOCK_SIZE];
+        }
+
+        uint32_t size()
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return ids.size();
+        }
+
+    private:
+        ConfigRegistry()
+        : published(0)
+        {
+            memset(blocks, 0, sizeof(blocks));
+        }
+
+        static const uint32_t BLOCK_SIZE = 1024;
+        static const uint32_t MAX_BLOCKS = 4096;
+
+        std::mutex lock;
+        std::unordered_map<Config, uint32_t, ConfigHash> ids;
+        Config* blocks[MAX_BLOCKS];
+        std::atomic<uint32_t> published;    // entries complete below this id
+    };
+
+    static uint32_t intern(const Config& config)
+    {
+        return ConfigRegistry::instance().intern(config);
+    }
+
+    const Config& config() const
+    {
+        return ConfigRegistry::instance().get(config_id);
+    }
+
+    /* per-call state of a computation, a copy of the selected method keeps
+       it a literal type for constant evaluation */
+    struct Query
+    {
+        MethodConfig params;        // of the selected method
+        JuristicMethod asr_juristic;
+        AdjustingMethod adjust_high_lats;
+        double dhuhr_minutes;
+        double latitude;
+        double longitude;
+        double timezone;
+        double julian_date;
+    };
+
+    Query query(double latitude, double longitude, double timezone) const
+    {
+        const Config& c = config();
+        Query q = { c.calc_method == Custom ? c.custom : method_params(c.calc_method),
+                    c.asr_juristic, c.adjust_high_lats, c.dhuhr_minutes,
+                    latitude, longitude, timezone, 0 };
+        return q;
+    }
+
 /* ---------------------- Calculation Functions ----------------------- */
 
     /* References: */
@@ -339,8 +818,9 @@ private:
     typedef std::pair<double, double> DoublePair;
 
     /* compute declination angle of sun and equation of time */
-    DoublePair sun_position(double jd)
+    static PRAYERTIMES_CONSTEXPR DoublePair sun_position(double jd)
     {
+        PRAYERTIMES_TIMER(TimerSunPosition);
         double d = jd - 2451545.0;
         double g = fix_angle(357.529 + 0.98560028 * d);
         double q = fix_angle(280.459 + 0.98564736 * d);
@@ -358,40 +838,40 @@ private:
     }
 
     /* compute equation of time */
-    double equation_of_time(double jd)
+    static PRAYERTIMES_CONSTEXPR double equation_of_time(double jd)
     {
         return sun_position(jd).second;
     }
 
     /* compute declination angle of sun */
-    double sun_declination(double jd)
+    static PRAYERTIMES_CONSTEXPR double sun_declination(double jd)
     {
         return sun_position(jd).first;
     }
 
     /* compute mid-day (Dhuhr, Zawal) time */
-    double compute_mid_day(double _t)
+    static PRAYERTIMES_CONSTEXPR double compute_mid_day(const Query& q, double _t)
     {
-        double t = equation_of_time(julian_date + _t);
+        double t = equation_of_time(q.julian_date + _t);
         double z = fix_hour(12 - t);
         return z;
     }
 
     /* compute time for a given angle G */
-    double compute_time(double g, double t)
+    static PRAYERTIMES_CONSTEXPR double compute_time(const Query& q, double g, double t)
     {
-        double d = sun_declination(julian_date + t);
-        double z = compute_mid_day(t);
-        double v = 1.0 / 15.0 * darccos((-dsin(g) - dsin(d) * dsin(latitude)) / (dcos(d) * dcos(latitude)));
+        double d = sun_declination(q.julian_date + t);
+        double z = compute_mid_day(q, t);
+        double v = 1.0 / 15.0 * darccos((-dsin(g) - dsin(d) * dsin(q.latitude)) / (dcos(d) * dcos(q.latitude)));
         return z + (g > 90.0 ? - v :  v);
     }
 
     /* compute the time of Asr */
-    double compute_asr(int step, double t)  // Shafii: step=1, Hanafi: step=2
+    static PRAYERTIMES_CONSTEXPR double compute_asr(const Query& q, int step, double t)  // Shafii: step=1, Hanafi: step=2
     {
-        double d = sun_declination(julian_date + t);
-        double g = -darccot(step + dtan(fabs(latitude - d)));
-        return compute_time(g, t);
+        double d = sun_declination(q.julian_date + t);
+        double g = -darccot(step + dtan(Math::fabs(q.latitude - d)));
+        return compute_time(q, g, t);
     }
 
 /* ---------------------- Compute Prayer Times ----------------------- */
@@ -399,77 +879,110 @@ private:
     // array parameters must be at least of size TimesCount
 
     /* compute prayer times at given julian date */
-    void compute_times(double times[])
+    static PRAYERTIMES_CONSTEXPR void compute_times(const Query& q, double times[])
     {
+        PRAYERTIMES_TIMER(TimerComputeTimes);
         day_portion(times);
 
-        times[Fajr]    = compute_time(180.0 - method_params[calc_method].fajr_angle, times[Fajr]);
-        times[Sunrise] = compute_time(180.0 - 0.833, times[Sunrise]);
-        times[Dhuhr]   = compute_mid_day(times[Dhuhr]);
-        times[Asr]     = compute_asr(1 + asr_juristic, times[Asr]);
-        times[Sunset]  = compute_time(0.833, times[Sunset]);
-        times[Maghrib] = compute_time(method_params[calc_method].maghrib_value, times[Maghrib]);
-        times[Isha]    = compute_time(method_params[calc_method].isha_value, times[Isha]);
+        times[Fajr]    = compute_time(q, 180.0 - q.params.fajr_angle, times[Fajr]);
+        times[Sunrise] = compute_time(q, 180.0 - 0.833, times[Sunrise]);
+        times[Dhuhr]   = compute_mid_day(q, times[Dhuhr]);
+        times[Asr]     = compute_asr(q, 1 + q.asr_juristic, times[Asr]);
+        times[Sunset]  = compute_time(q, 0.833, times[Sunset]);
+        times[Maghrib] = compute_time(q, q.params.maghrib_value, times[Maghrib]);
+        times[Isha]    = compute_time(q, q.params.isha_value, times[Isha]);
     }
 
 
     /* compute prayer times at given julian date */
-    void compute_day_times(double times[])
+    static PRAYERTIMES_CONSTEXPR void compute_day_times(const Query& q, double times[])
     {
+        PRAYERTIMES_COUNT(StatDays);
         double default_times[] = { 5, 6, 12, 13, 18, 18, 18 };      // default times
         for (int i = 0; i < TimesCount; ++i)
             times[i] = default_times[i];
 
         for (int i = 0; i < NUM_ITERATIONS; ++i)
-            compute_times(times);
+            compute_times(q, times);
 
-        adjust_times(times);
+        adjust_times(q, times);
     }
 
 
     /* adjust times in a prayer time array */
-    void adjust_times(double times[])
+    static PRAYERTIMES_CONSTEXPR void adjust_times(const Query& q, double times[])
     {
+        PRAYERTIMES_TIMER(TimerAdjustTimes);
         for (int i = 0; i < TimesCount; ++i)
-            times[i] += timezone - longitude / 15.0;
-        times[Dhuhr] += dhuhr_minutes / 60.0;       // Dhuhr
-        if (method_params[calc_method].maghrib_is_minutes)      // Maghrib
-            times[Maghrib] = times[Sunset] + method_params[calc_method].maghrib_value / 60.0;
-        if (method_params[calc_method].isha_is_minutes)     // Isha
-            times[Isha] = times[Maghrib] + method_params[calc_method].isha_value / 60.0;
-
-        if (adjust_high_lats != None)
-            adjust_high_lat_times(times);
+            times[i] += q.timezone - q.longitude / 15.0;
+        times[Dhuhr] += q.dhuhr_minutes / 60.0;       // Dhuhr
+        if (q.params.maghrib_is_minutes)      // Maghrib
+            times[Maghrib] = times[Sunset] + q.params.maghrib_value / 60.0;
+        if (q.params.isha_is_minutes)     // Isha
+            times[Isha] = times[Maghrib] + q.params.isha_value / 60.0;
+
+        if (q.adjust_high_lats != None)
+            adjust_high_lat_times(q, times);
     }
 
     /* adjust Fajr, Isha and Maghrib for locations in higher latitudes */
-    void adjust_high_lat_times(double times[])
+    static PRAYERTIMES_CONSTEXPR void adjust_high_lat_times(const Query& q, double times[])
     {
+        const MethodConfig& params = q.params;
         double night_time = time_diff(times[Sunset], times[Sunrise]);       // sunset to sunrise
 
         // Adjust Fajr
-        double fajr_diff = night_portion(method_params[calc_method].fajr_angle) * night_time;
-        if (std::isnan(times[Fajr]) || time_diff(times[Fajr], times[Sunrise]) > fajr_diff)
+        double fajr_diff = night_portion(q, params.fajr_angle) * night_time;
+        if (Math::is_nan(times[Fajr]))
+            PRAYERTIMES_COUNT(StatHighLatFallbacks);
+        if (Math::is_nan(times[Fajr]) || time_diff(times[Fajr], times[Sunrise]) > fajr_diff)
+        {
+            high_lat_adjusted(Fajr, times[Fajr]);
             times[Fajr] = times[Sunrise] - fajr_diff;
+        }
 
         // Adjust Isha
-        double isha_angle = method_params[calc_method].isha_is_minutes ? 18.0 : method_params[calc_method].isha_value;
-        double isha_diff = night_portion(isha_angle) * night_time;
-        if (std::isnan(times[Isha]) || time_diff(times[Sunset], times[Isha]) > isha_diff)
+        double isha_angle = params.isha_is_minutes ? 18.0 : params.isha_value;
+        double isha_diff = night_portion(q, isha_angle) * night_time;
+        if (Math::is_nan(times[Isha]))
+            PRAYERTIMES_COUNT(StatHighLatFallbacks);
+        if (Math::is_nan(times[Isha]) || time_diff(times[Sunset], times[Isha]) > isha_diff)
+        {
+            high_lat_adjusted(Isha, times[Isha]);
             times[Isha] = times[Sunset] + isha_diff;
+        }
 
         // Adjust Maghrib
-        double maghrib_angle = method_params[calc_method].maghrib_is_minutes ? 4.0 : method_params[calc_method].maghrib_value;
-        double maghrib_diff = night_portion(maghrib_angle) * night_time;
-        if (std::isnan(times[Maghrib]) || time_diff(times[Sunset], times[Maghrib]) > maghrib_diff)
+        double maghrib_angle = params.maghrib_is_minutes ? 4.0 : params.maghrib_value;
+        double maghrib_diff = night_portion(q, maghrib_angle) * night_time;
+        if (Math::is_nan(times[Maghrib]))
+            PRAYERTIMES_COUNT(StatHighLatFallbacks);
+        if (Math::is_nan(times[Maghrib]) || time_diff(times[Sunset], times[Maghrib]) > maghrib_diff)
+        {
+            high_lat_adjusted(Maghrib, times[Maghrib]);
             times[Maghrib] = times[Sunset] + maghrib_diff;
+        }
+    }
+
+    /* the probe is kept out of line, constant expressions cannot fire it */
+    static PRAYERTIMES_CONSTEXPR void high_lat_adjusted(TimeID time_id, double time)
+    {
+        if (!PRAYERTIMES_CONSTANT_EVALUATED())
+            high_lat_probe(time_id, Math::is_nan(time));
+    }
+
+    static void high_lat_probe(int time_id, int undefined)
+    {
+        PRAYERTIMES_PROBE(high_lat_adjust, time_id, undefined);
+        (void) time_id;
+        (void) undefined;
     }
 
 
     /* the night portion used for adjusting times in higher latitudes */
-    double night_portion(double angle)
+    static PRAYERTIMES_CONSTEXPR double night_portion(const Query& q, double angle)
     {
-        switch (adjust_high_lats)
+        switch (q.adjust_high_lats)
         {
             case AngleBased:
                 return angle / 60.0;
@@ -487,7 +1000,7 @@ private:
     }
 
     /* convert hours to day portions  */
-    void day_portion(double times[])
+    static PRAYERTIMES_CONSTEXPR void day_portion(double times[])
     {
         for (int i = 0; i < TimesCount; ++i)
             times[i] /= 24.0;
@@ -496,7 +1009,7 @@ private:
 /* ---------------------- Misc Functions ----------------------- */
 
     /* compute the difference between two times  */
-    static double time_diff(double time1, double time2)
+    static PRAYERTIMES_CONSTEXPR double time_diff(double time1, double time2)
     {
         return fix_hour(time2 - time1);
     }
@@ -521,7 +1034,7 @@ private:
 /* ---------------------- Julian Date Functions ----------------------- */
 
     /* calculate julian date from a calendar date */
-    double get_julian_date(int year, int month, int day)
+    static PRAYERTIMES_CONSTEXPR double get_julian_date(int year, int month, int day)
     {
         if (month <= 2)
         {
@@ -529,14 +1042,14 @@ private:
             month += 12;
         }
 
-        double a = floor(year / 100.0);
-        double b = 2 - a + floor(a / 4.0);
+        double a = Math::floor(year / 100.0);
+        double b = 2 - a + Math::floor(a / 4.0);
 
-        return floor(365.25 * (year + 4716)) + floor(30.6001 * (month + 1)) + day + b - 1524.5;
+        return Math::floor(365.25 * (year + 4716)) + Math::floor(30.6001 * (month + 1)) + day + b - 1524.5;
     }
 
     /* convert a calendar date to julian date (second method) */
-    double calc_julian_date(int year, int month, int day)
+    static double calc_julian_date(int year, int month, int day)
     {
         double j1970 = 2440588.0;
         tm date = { 0 };
@@ -552,97 +1065,353 @@ private:
 /* ---------------------- Trigonometric Functions ----------------------- */
 
     /* degree sin */
-    static double dsin(double d)
+    static PRAYERTIMES_CONSTEXPR double dsin(double d)
     {
-        return sin(deg2rad(d));
+        PRAYERTIMES_COUNT(StatTrigCalls);
+        return Math::sin(deg2rad(d));
     }
 
     /* degree cos */
-    static double dcos(double d)
+    static PRAYERTIMES_CONSTEXPR double dcos(double d)
     {
-        return cos(deg2rad(d));
+        PRAYERTIMES_COUNT(StatTrigCalls);
+        return Math::cos(deg2rad(d));
     }
 
     /* degree tan */
-    static double dtan(double d)
+    static PRAYERTIMES_CONSTEXPR double dtan(double d)
     {
-        return tan(deg2rad(d));
+        PRAYERTIMES_COUNT(StatTrigCalls);
+        return Math::tan(deg2rad(d));
     }
 
     /* degree arcsin */
-    static double darcsin(double x)
+    static PRAYERTIMES_CONSTEXPR double darcsin(double x)
     {
-        return rad2deg(asin(x));
+        PRAYERTIMES_COUNT(StatTrigCalls);
+        return rad2deg(Math::asin(x));
     }
 
     /* degree arccos */
-    static double darccos(double x)
+    static PRAYERTIMES_CONSTEXPR double darccos(double x)
     {
-        return rad2deg(acos(x));
+        PRAYERTIMES_COUNT(StatTrigCalls);
+        return rad2deg(Math::acos(x));
     }
 
     /* degree arctan */
-    static double darctan(double x)
+    static PRAYERTIMES_CONSTEXPR double darctan(double x)
     {
-        return rad2deg(atan(x));
+        PRAYERTIMES_COUNT(StatTrigCalls);
+        return rad2deg(Math::atan(x));
     }
 
     /* degree arctan2 */
-    static double darctan2(double y, double x)
+    static PRAYERTIMES_CONSTEXPR double darctan2(double y, double x)
     {
-        return rad2deg(atan2(y, x));
+        PRAYERTIMES_COUNT(StatTrigCalls);
+        return rad2deg(Math::atan2(y, x));
     }
 
     /* degree arccot */
-    static double darccot(double x)
+    static PRAYERTIMES_CONSTEXPR double darccot(double x)
     {
-        return rad2deg(atan(1.0 / x));
+        PRAYERTIMES_COUNT(StatTrigCalls);
+        return rad2deg(Math::atan(1.0 / x));
     }
 
     /* degree to radian */
-    static double deg2rad(double d)
+    static PRAYERTIMES_CONSTEXPR double deg2rad(double d)
     {
         return d * M_PI / 180.0;
     }
 
     /* radian to degree */
-    static double rad2deg(double r)
+    static PRAYERTIMES_CONSTEXPR double rad2deg(double r)
     {
         return r * 180.0 / M_PI;
     }
 
     /* range reduce angle in degrees. */
-    static double fix_angle(double a)
+    static PRAYERTIMES_CONSTEXPR double fix_angle(double a)
     {
-        a = a - 360.0 * floor(a / 360.0);
+        a = a - 360.0 * Math::floor(a / 360.0);
         a = a < 0.0 ? a + 360.0 : a;
         return a;
     }
 
     /* range reduce hours to 0..23 */
-    static double fix_hour(double a)
+    static PRAYERTIMES_CONSTEXPR double fix_hour(double a)
     {
-        a = a - 24.0 * floor(a / 24.0);
+        a = a - 24.0 * Math::floor(a / 24.0);
         a = a < 0.0 ? a + 24.0 : a;
         return a;
     }
 
-private:
-/* ---------------------- Private Variables -------------------- */
+/* ---------------------- Math Functions ----------------------- */
+
+    /* libm at runtime, series in constant expressions */
+    struct Math
+    {
+        static PRAYERTIMES_CONSTEXPR double sin(double x)
+        {
+            return PRAYERTIMES_CONSTANT_EVALUATED() ? series_sin(x) : std::sin(x);
+        }
+
+        static PRAYERTIMES_CONSTEXPR double cos(double x)
+        {
+            return PRAYERTIMES_CONSTANT_EVALUATED() ? series_sin(x + HALF_PI_HI + HALF_PI_LO) : std::cos(x);
+        }
+
+        static PRAYERTIMES_CONSTEXPR double tan(double x)
+        {
+            return PRAYERTIMES_CONSTANT_EVALUATED() ? series_sin(x) / series_sin(x + HALF_PI_HI + HALF_PI_LO) : std::tan(x);
+        }
+
+        static PRAYERTIMES_CONSTEXPR double asin(double x)
+        {
+            return PRAYERTIMES_CONSTANT_EVALUATED() ? series_atan2(x, series_sqrt((1 - x) * (1 + x))) : std::asin(x);
+        }
+
+        static PRAYERTIMES_CONSTEXPR double acos(double x)
+        {
+            return PRAYERTIMES_CONSTANT_EVALUATED() ? series_atan2(series_sqrt((1 - x) * (1 + x)), x) : std::acos(x);
+        }
+
+        static PRAYERTIMES_CONSTEXPR double atan(double x)
+        {
+            return PRAYERTIMES_CONSTANT_EVALUATED() ? series_atan(x) : std::atan(x);
+        }
+
+        static PRAYERTIMES_CONSTEXPR double atan2(double y, double x)
+        {
+            return PRAYERTIMES_CONSTANT_EVALUATED() ? series_atan2(y, x) : std::atan2(y, x);
+        }
+
+        static PRAYERTIMES_CONSTEXPR double floor(double x)
+        {
+            if (PRAYERTIMES_CONSTANT_EVALUATED())
+            {
+                if (is_nan(x) || fabs(x) >= 4503599627370496.0)       // 2^52, no fraction left
+                    return x;
+                double t = (double) (long long) x;
+                return t > x ? t - 1 : t;
+            }
+            return std::floor(x);
+        }
+
+        static constexpr double fabs(double x)
+        {
+            return x < 0 ? -x : x;
+        }
+
+        static constexpr bool is_nan(double x)
+        {
+            return x != x;
+        }
+
+        // pi/2 split so that k * HALF_PI_HI is exact for the quadrants we see
+        static constexpr double HALF_PI_HI = 1.57079632673412561417e+00;
+        static constexpr double HALF_PI_LO = 6.07710050650619224932e-11;
+
+        /* sine by reduction to [-pi/4, pi/4] and Taylor series */
+        static PRAYERTIMES_CONSTEXPR double series_sin(double x)
+        {
+            if (is_nan(x) || fabs(x) > 1e9)
+                return std::numeric_limits<double>::quiet_NaN();
+            double k = floor(x / (HALF_PI_HI + HALF_PI_LO) + 0.5);
+            double r = (x - k * HALF_PI_HI) - k * HALF_PI_LO;
+            double quadrant = k - 4 * floor(k / 4);
+            double r2 = r * r;
+            bool odd = quadrant == 1 || quadrant == 3;
+            double term = odd ? 1 : r;
+            double sum = term;
+            for (int n = odd ? 1 : 2; sum + term != sum; n += 2)
+            {
+                term *= -r2 / (n * (n + 1));
+                sum += term;
+            }
+            return quadrant >= 2 ? -sum : sum;
+        }
+
+        /* arctangent, two angle halvings bring |x| below tan(pi/16) */
+        static PRAYERTIMES_CONSTEXPR double series_atan(double x)
+        {
+            if (is_nan(x))
+                return x;
+            if (x < 0)
+                return -series_atan(-x);
+            if (x > 1)
+                return (HALF_PI_HI + HALF_PI_LO) - series_atan(1 / x);
+            x = x / (1 + series_sqrt(1 + x * x));
+            x = x / (1 + series_sqrt(1 + x * x));
+            double x2 = x * x;
+            double power = x;
+            double sum = x;
+            double term = x;
+            for (int n = 3; sum + term != sum; n += 2)
+            {
+                power *= -x2;
+                term = power / n;
+                sum += term;
+            }
+            return 4 * sum;
+        }
+
+        static PRAYERTIMES_CONSTEXPR double series_atan2(double y, double x)
+        {
+            if (is_nan(x) || is_nan(y))
+                return std::numeric_limits<double>::quiet_NaN();
+            if (x > 0)
+                return series_atan(y / x);
+            if (x < 0)
+                return series_atan(y / x) + (y < 0 ? -2 : 2) * (HALF_PI_HI + HALF_PI_LO);
+            return y > 0 ? HALF_PI_HI + HALF_PI_LO : y < 0 ? -(HALF_PI_HI + HALF_PI_LO) : 0;
+        }
 
-    MethodConfig method_params[CalculationMethodsCount];
+        /* Newton iteration after scaling into [1/4, 4] */
+        static PRAYERTIMES_CONSTEXPR double series_sqrt(double x)
+        {
+            if (is_nan(x) || x < 0)
+                return std::numeric_limits<double>::quiet_NaN();
+            if (x == 0 || x > std::numeric_limits<double>::max())
+                return x;
+            double scale = 1;
+            for (; x > 4; x /= 4)
+                scale *= 2;
+            for (; x < 0.25; x *= 4)
+                scale /= 2;
+            double r = 1;
+            for (int i = 0; i < 8; ++i)
+                r = 0.5 * (r + x / r);
+            return r * scale;
+        }
+    };
 
-    CalculationMethod calc_method;      // caculation method
-    JuristicMethod asr_juristic;        // Juristic method for Asr
-    AdjustingMethod adjust_high_lats;   // adjusting method for higher latitudes
-    double dhuhr_minutes;       // minutes after mid-day for Dhuhr
+#ifdef PRAYERTIMES_STATS
+/* ---------------------- Instrumentation State ----------------------- */
 
-    double latitude;
-    double longitude;
-    double timezone;
-    double julian_date;
+    /* counters of one thread, only written by that thread */
+    struct ThreadStats
+    {
+        std::atomic<uint64_t> counters[StatCountersCount];
+        std::atomic<uint64_t> timer_calls[StatTimersCount];
+        std::atomic<uint64_t> nanoseconds[StatTimersCount];
+        ThreadStats* next;
+
+        void add_to(StatsSnapshot& snapshot) const
+        {
+            for (int i = 0; i < StatCountersCount; ++i)
+                snapshot.counters[i] += counters[i].load(std::memory_order_relaxed);
+            for (int i = 0; i < StatTimersCount; ++i)
+            {
+                snapshot.timer_calls[i] += timer_calls[i].load(std::memory_order_relaxed);
+                snapshot.nanoseconds[i] += nanoseconds[i].load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /* plain load and store, a locked add is not needed with a single writer */
+    static void bump(std::atomic<uint64_t>& counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    class StatsRegistry
+    {
+    public:
+        static StatsRegistry& instance()
+        {
+            static StatsRegistry registry;
+            return registry;
+        }
+
+        std::mutex lock;
+        ThreadStats* threads;       // live threads
+        StatsSnapshot retired;      // sum of the exited ones
+
+    private:
+        StatsRegistry()
+        : threads(NULL)
+        {
+            memset(&retired, 0, sizeof(retired));
+        }
+    };
+
+    /* links the counters of a thread into the registry for its lifetime */
+    struct ThreadStatsOwner
+    {
+        ThreadStatsOwner()
+        : stats()
+        {
+            StatsRegistry& registry = StatsRegistry::instance();
+            std::lock_guard<std::mutex> guard(registry.lock);
+            stats.next = registry.threads;
+            registry.threads = &stats;
+        }
+
+        ~ThreadStatsOwner()
+        {
+            StatsRegistry& registry = StatsRegistry::instance();
+            std::lock_guard<std::mutex> guard(registry.lock);
+            stats.add_to(registry.retired);
+            for (ThreadStats** p = &registry.threads; *p != NULL; p = &(*p)->next)
+                if (*p == &stats)
+                {
+                    *p = stats.next;
+                    break;
+                }
+        }
+
+        ThreadStats stats;
+    };
+
+    static ThreadStats& thread_stats()
+    {
+        static thread_local ThreadStatsOwner owner;
+        return owner.stats;
+    }
+
+    class StatsTimer
+    {
+    public:
+        PRAYERTIMES_CONSTEXPR StatsTimer(StatTimer timer)
+        : timer(timer)
+        , start(0)
+        {
+            if (!PRAYERTIMES_CONSTANT_EVALUATED())
+                start = now();
+        }
+
+        PRAYERTIMES_CONSTEXPR ~StatsTimer()
+        {
+            if (PRAYERTIMES_CONSTANT_EVALUATED())
+                return;
+            ThreadStats& stats = thread_stats();
+            bump(stats.timer_calls[timer], 1);
+            bump(stats.nanoseconds[timer], now() - start);
+        }
+
+    private:
+        static uint64_t now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        StatTimer timer;
+        uint64_t start;
+    };
+#endif
+
+private:
+/* ---------------------- Private Variables -------------------- */
+
+    uint32_t config_id;         // entry of the configuration registry
 
 /* --------------------- Technical Settings -------------------- */
 
     static const int NUM_ITERATIONS = 1;        // number of iterations needed to compute times
 };
+
+#endif /* PRAYERTIMES_HPP */
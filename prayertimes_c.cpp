@@ -0,0 +1,108 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <new>
+
+#include "prayertimes.hpp"
+#include "prayertimes_c.h"
+
+/*
+ * The C ABI over PrayerTimes. Built with -fvisibility=hidden, so only the
+ * functions of prayertimes_c.h are exported and the inline class is
+ * compiled once into the library. Nothing may throw across the ABI.
+ */
+
+static int check_config(uint32_t config) {
+    if (config >= PrayerTimes::config_count()) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+uint32_t prayertimes_abi_version(void) {
+    return PRAYERTIMES_ABI_VERSION;
+}
+
+int prayertimes_config(int method, int asr, int high_lats, double dhuhr_minutes, uint32_t *config) {
+    if (method < PRAYERTIMES_JAFARI || method > PRAYERTIMES_CUSTOM ||
+            asr < PRAYERTIMES_SHAFII || asr > PRAYERTIMES_HANAFI ||
+            high_lats < PRAYERTIMES_NONE || high_lats > PRAYERTIMES_ANGLE_BASED) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    try {
+        PrayerTimes prayer_times((PrayerTimes::CalculationMethod) method,
+            (PrayerTimes::JuristicMethod) asr, (PrayerTimes::AdjustingMethod) high_lats,
+            dhuhr_minutes);
+        *config = prayer_times.get_config_id();
+    } catch (const std::bad_alloc &) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+int prayertimes_config_custom(uint32_t base, double fajr_angle, double maghrib, int maghrib_is_minutes,
+        double isha, int isha_is_minutes, uint32_t *config) {
+    if (check_config(base) < 0)
+        return -1;
+
+    try {
+        PrayerTimes prayer_times = PrayerTimes::from_config_id(base);
+        prayer_times.set_fajr_angle(fajr_angle);
+        if (maghrib_is_minutes)
+            prayer_times.set_maghrib_minutes(maghrib);
+        else
+            prayer_times.set_maghrib_angle(maghrib);
+        if (isha_is_minutes)
+            prayer_times.set_isha_minutes(isha);
+        else
+            prayer_times.set_isha_angle(isha);
+        *config = prayer_times.get_config_id();
+    } catch (const std::bad_alloc &) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+double prayertimes_julian_date(int year, int month, int day) {
+    return 2440587.5 + PrayerTimes::days_from_civil(year, month, day);
+}
+
+int prayertimes_compute(uint32_t config, size_t count, const double *latitude, const double *longitude,
+        const double *julian_date, const double *timezone, double *times) {
+    if (check_config(config) < 0)
+        return -1;
+    PrayerTimes::from_config_id(config).get_prayer_times_batch(count, latitude, longitude,
+        julian_date, timezone, times);
+    return 0;
+}
+
+int prayertimes_compute_days(uint32_t config, double latitude, double longitude, double timezone,
+        int64_t first_day, size_t count, double *times) {
+    if (check_config(config) < 0)
+        return -1;
+    if (count > INT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    PrayerTimes::from_config_id(config).get_prayer_times_range(first_day, count, latitude, longitude,
+        timezone, times);
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PRAYERTIMES_C_H
+#define PRAYERTIMES_C_H
+
+/*
+ * Stable C ABI of the prayer times calculator (libprayertimes.so.1), for
+ * C programs and FFI callers such as Python ctypes, cffi or cgo.
+ *
+ * A configuration is interned once and referred to by a 32-bit id. The
+ * compute functions read caller-owned contiguous arrays and write
+ * PRAYERTIMES_TIMES doubles per entry (hours after local midnight, NaN
+ * when undefined), so NumPy arrays or Go slices are passed without a copy:
+ *
+ *   uint32_t config;
+ *   prayertimes_config(PRAYERTIMES_MAKKAH, PRAYERTIMES_SHAFII,
+ *                      PRAYERTIMES_MIDNIGHT, 0, &config);
+ *   prayertimes_compute(config, n, lat, lon, jd, tz, out);    // out[n][7]
+ *
+ * All functions are thread-safe and return 0, or -1 with errno set.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define PRAYERTIMES_C_API __attribute__((visibility("default")))
+#else
+#define PRAYERTIMES_C_API
+#endif
+
+#define PRAYERTIMES_ABI_VERSION 1
+#define PRAYERTIMES_TIMES 7
+
+enum prayertimes_method {
+    PRAYERTIMES_JAFARI,
+    PRAYERTIMES_KARACHI,
+    PRAYERTIMES_ISNA,
+    PRAYERTIMES_MWL,
+    PRAYERTIMES_MAKKAH,
+    PRAYERTIMES_EGYPT,
+    PRAYERTIMES_CUSTOM,
+};
+
+enum prayertimes_asr {
+    PRAYERTIMES_SHAFII,
+    PRAYERTIMES_HANAFI,
+};
+
+enum prayertimes_high_lats {
+    PRAYERTIMES_NONE,
+    PRAYERTIMES_MIDNIGHT,
+    PRAYERTIMES_ONE_SEVENTH,
+    PRAYERTIMES_ANGLE_BASED,
+};
+
+/* Index of a time within the PRAYERTIMES_TIMES values of an entry */
+enum prayertimes_time {
+    PRAYERTIMES_FAJR,
+    PRAYERTIMES_SUNRISE,
+    PRAYERTIMES_DHUHR,
+    PRAYERTIMES_ASR,
+    PRAYERTIMES_SUNSET,
+    PRAYERTIMES_MAGHRIB,
+    PRAYERTIMES_ISHA,
+};
+
+/* PRAYERTIMES_ABI_VERSION of the loaded library */
+PRAYERTIMES_C_API uint32_t prayertimes_abi_version(void);
+
+/* Intern a configuration; EINVAL for an unknown method, asr or high_lats */
+PRAYERTIMES_C_API int prayertimes_config(int method, int asr, int high_lats, double dhuhr_minutes,
+    uint32_t *config);
+
+/*
+ * Derive a PRAYERTIMES_CUSTOM configuration from base. Maghrib and Isha
+ * are angles, or minutes after sunset and Maghrib when the matching
+ * *_is_minutes flag is set.
+ */
+PRAYERTIMES_C_API int prayertimes_config_custom(uint32_t base, double fajr_angle,
+    double maghrib, int maghrib_is_minutes, double isha, int isha_is_minutes, uint32_t *config);
+
+/* Julian date of 0h UT of a Gregorian date */
+PRAYERTIMES_C_API double prayertimes_julian_date(int year, int month, int day);
+
+/*
+ * Times of count independent entries. julian_date holds julian dates of
+ * 0h UT, timezone the UTC offsets in hours (NULL for UTC); times receives
+ * count * PRAYERTIMES_TIMES values.
+ */
+PRAYERTIMES_C_API int prayertimes_compute(uint32_t config, size_t count, const double *latitude,
+    const double *longitude, const double *julian_date, const double *timezone, double *times);
+
+/* Times of count consecutive days from first_day (days since 1970-01-01) */
+PRAYERTIMES_C_API int prayertimes_compute_days(uint32_t config, double latitude, double longitude,
+    double timezone, int64_t first_day, size_t count, double *times);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PRAYERTIMES_C_H */
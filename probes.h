@@ -0,0 +1,56 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * USDT probes of the daemon (provider "ptimes"), compiled in when
+ * <sys/sdt.h> (systemtap-sdt-dev) is installed. An unattached probe is a
+ * single nop; bpftrace or SystemTap attach to it in the running binary:
+ *
+ * bpftrace -e 'usdt:/usr/bin/ptimes:ptimes:timer_fired { @late = hist(arg2); }'
+ *
+ * Probes and arguments:
+ *   schedule_compute    day, nanoseconds
+ *   timer_armed         time id (-1 when nothing is due), epoch
+ *   timer_fired         time id, epoch, nanoseconds late
+ *   action_spawn        pid (0 for the in-process audio)
+ *   action_exit         pid, exit status (-signal when killed), nanoseconds run
+ *   pipeline_start      --actions line, time id, nanoseconds late
+ *   pipeline_done       --actions line, errno (0 on success), nanoseconds run
+ *
+ * Every child started through supervise.h, the aplay player and exec
+ * actions, ends with action_exit. pipeline_start fires when an action is
+ * queued or spawned, pipeline_done once a worker finished it (for exec
+ * actions right after the spawn, their end is the action_exit).
+ *   audio_start         frames
+ *   audio_done          frames played
+ *
+ * The library's probes are in prayertimes.hpp (provider "prayertimes").
+ */
+
+#if defined(__has_include) && !defined(PTIMES_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PTIMES_PROBE(name, ...) STAP_PROBEV(ptimes, name, ##__VA_ARGS__)
+#endif
+#endif
+
+#ifndef PTIMES_PROBE
+#define PTIMES_PROBE(name, ...) do { } while (0)
+#endif
+
+#endif /* PROBES_H */
@@ -0,0 +1,133 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Clock for one fixed location with its timetable computed at compile time.
+
+    The prayer times of BAKED_YEARS years from BAKED_FIRST_YEAR are baked
+    into the binary as minutes after local midnight; at runtime the clock
+    only looks up a row, without floating-point work or libm calls:
+
+    g++ -std=c++17 -O2 -fconstexpr-ops-limit=1000000000 -DBAKED_LATITUDE=21.42 \
+        -DBAKED_LONGITUDE=39.83 -DBAKED_TIMEZONE=3 -DBAKED_METHOD=Makkah \
+        -o ptclock ptclock.cpp
+
+    BAKED_TIMEZONE is a fixed UTC offset in hours, BAKED_METHOD, BAKED_ASR
+    and BAKED_HIGH_LATS name PrayerTimes enumerators. Needs a compiler where
+    PRAYERTIMES_CONSTEXPR is constexpr (see prayertimes.hpp).
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "prayertimes.hpp"
+
+#if !defined(BAKED_LATITUDE) || !defined(BAKED_LONGITUDE) || !defined(BAKED_TIMEZONE)
+#error "define BAKED_LATITUDE, BAKED_LONGITUDE and BAKED_TIMEZONE"
+#endif
+#ifndef BAKED_METHOD
+#define BAKED_METHOD Jafari
+#endif
+#ifndef BAKED_ASR
+#define BAKED_ASR Shafii
+#endif
+#ifndef BAKED_HIGH_LATS
+#define BAKED_HIGH_LATS MidNight
+#endif
+#ifndef BAKED_DHUHR_MINUTES
+#define BAKED_DHUHR_MINUTES 0
+#endif
+#ifndef BAKED_FIRST_YEAR
+#define BAKED_FIRST_YEAR 2025
+#endif
+#ifndef BAKED_YEARS
+#define BAKED_YEARS 5
+#endif
+
+#define SECONDSINDAY 86400
+
+static constexpr long first_day = PrayerTimes::days_from_civil(BAKED_FIRST_YEAR, 1, 1);
+static constexpr long day_count = PrayerTimes::days_from_civil(BAKED_FIRST_YEAR + BAKED_YEARS, 1, 1) - first_day;
+static constexpr long utc_offset = (long) (BAKED_TIMEZONE * 3600);     /* seconds */
+
+static const char *names[PrayerTimes::TimesCount] = {
+    "fajr", "sunrise", "dhuhr", "asr", "sunset", "maghrib", "isha"
+};
+
+typedef struct _baked_table {
+    int16_t minutes[day_count][PrayerTimes::TimesCount];   /* after local midnight, -1 if undefined */
+} baked_table_t;
+
+static constexpr baked_table_t bake_table() {
+    baked_table_t table = {};
+
+    for (long i = 0; i < day_count; i++) {
+        double times[PrayerTimes::TimesCount] = {};
+        PrayerTimes::compute_prayer_times(first_day + i, BAKED_LATITUDE, BAKED_LONGITUDE, BAKED_TIMEZONE,
+            PrayerTimes::BAKED_METHOD, PrayerTimes::BAKED_ASR, PrayerTimes::BAKED_HIGH_LATS,
+            BAKED_DHUHR_MINUTES, times);
+
+        for (int j = 0; j < PrayerTimes::TimesCount; j++) {
+            int hours = 0, minutes = 0;
+            if (times[j] != times[j]) {
+                table.minutes[i][j] = -1;
+                continue;
+            }
+            PrayerTimes::get_float_time_parts(times[j], hours, minutes);
+            table.minutes[i][j] = hours * 60 + minutes;
+        }
+    }
+    return table;
+}
+
+static constexpr baked_table_t table = bake_table();
+
+int main(int argc, char **argv) {
+    int year, month, day;
+    long days;
+
+    if (argc > 1) {
+        if (sscanf(argv[1], "%d-%d-%d", &year, &month, &day) != 3) {
+            fprintf(stderr, "usage: %s [YYYY-MM-DD]\n", argv[0]);
+            return 1;
+        }
+        days = PrayerTimes::days_from_civil(year, month, day);
+    } else {
+        long local = time(NULL) + utc_offset;
+        days = local >= 0 ? local / SECONDSINDAY : (local - SECONDSINDAY + 1) / SECONDSINDAY;
+    }
+
+    if (days < first_day || days >= first_day + day_count) {
+        fprintf(stderr, "ERROR: the timetable covers %d-%d only\n",
+            BAKED_FIRST_YEAR, BAKED_FIRST_YEAR + BAKED_YEARS - 1);
+        return 1;
+    }
+    PrayerTimes::civil_from_days(days, year, month, day);
+
+    printf("date");
+    for (int i = 0; i < PrayerTimes::TimesCount; i++)
+        printf(",%s", names[i]);
+    printf("\n%04d-%02d-%02d", year, month, day);
+    for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+        int minutes = table.minutes[days - first_day][i];
+        if (minutes < 0)
+            printf(",");
+        else
+            printf(",%02d:%02d", minutes / 60, minutes % 60);
+    }
+    printf("\n");
+    return 0;
+}
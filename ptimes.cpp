@@ -22,18 +22,39 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "actions.h"
+#include "announce.h"
+#include "audio.h"
+#include "batch.h"
+#include "citydb.h"
 #include "cmdline.h"
+#include "eventloop.h"
+#include "httpd.h"
+#include "metrics.h"
 #include "prayertimes.hpp"
+#include "probes.h"
+#include "querysock.h"
+#include "schedcache.h"
+#include "schedule.h"
+#include "shmpub.h"
+#include "supervise.h"
+#include "systemd.h"
+#include "timetable.h"
+#include "tzmap.h"
+#include "vclock.h"
 
 #define DAEMON_NAME "ptimes"
 #define PID_FILE "/run/ptimes.pid"
 #define BUF_SIZE 256
 
 #define PLAYER "/usr/bin/aplay"
-#define AZAN "/usr/share/sounds/ptimes/azan.wav"
+#define AUDIO_PREPARE_SECONDS 5     /* open the audio device this early */
 
 #define SECONDSINDAY 86400
 
@@ -47,29 +68,33 @@ static const char *config_fname = "ptimes.conf";
 
 typedef struct gengetopt_args_info *opts_t;
 static opts_t opts = NULL;
-
-static const char* TimeName[] =
-{
-	"Fajr",
-	"Sunrise",
-	"Dhuhr",
-	"Asr",
-	"Sunset",
-	"Maghrib",
-	"Isha",
-};
+static opts_t active_opts = NULL;  /* last applied, differs from opts after a reload */
+static int saved_argc;
+static char **saved_argv;
 
 typedef struct _prayer {
     char name_id;
     int seconds;
+    time_t epoch;
     char time24[6];
 } prayer_t;
 
+static PrayerTimes prayer_times;
+static schedule_t schedule;
+static prayer_t next_prayer;
+static event_source_t prayer_timer;
+static event_source_t prepare_timer;
+static event_source_t reload_signal;
+static sigset_t reload_mask;        /* signals handled by the event loop */
+static int in_process_audio = 0;
+static time_t last_alert = -1;
+static time_t prayer_deadline = -1;    /* expiry of the prayer timer */
+static FILE *trace = NULL;              /* --simulate output */
+static const char *startup_tz = NULL;   /* TZ the daemon was started with, NULL if unset */
+static char active_zone[256];           /* TZ of active_opts, "" for startup_tz */
+
 void signal_handler(int sig) {
     switch(sig) {
-        case SIGHUP:
-            syslog(LOG_WARNING, "Received SIGHUP signal.");
-            break;
         case SIGTERM:
             syslog(LOG_WARNING, "Received SIGTERM signal.");
             exit(EXIT_SUCCESS);
@@ -103,7 +128,7 @@ static int config_exists(const char *fpath)
   return (have_config);
 }
 
-static int parse_config(int argc, char **argv)
+static int parse_config(int argc, char **argv, opts_t target)
 {
   struct cmdline_parser_params *pp = NULL;
   int have_config = 0;
@@ -127,14 +152,14 @@ static int parse_config(int argc, char **argv)
   pp = cmdline_parser_params_create();
   pp->check_required = 0;
 
-  have_config = (int)(cmdline_parser_config_file(fpath, opts, pp) == 0);
+  have_config = (int)(cmdline_parser_config_file(fpath, target, pp) == 0);
   if (have_config == 1)
     {
       _free(fpath);
       pp->check_required = 1;
       pp->initialize = 0;
       pp->override = 1;
-      have_config = (int)(cmdline_parser_ext(argc, argv, opts, pp) == 0);
+      have_config = (int)(cmdline_parser_ext(argc, argv, target, pp) == 0);
     }
 
   _free(fpath);
@@ -143,21 +168,16 @@ static int parse_config(int argc, char **argv)
   return (have_config);
 }
 
-static void parse_cmdline(int argc, char **argv)
+/* Parse the config file and command line into target, exits on errors */
+static void parse_options(int argc, char **argv, opts_t target)
 {
   int have_config = 0;
 
-  opts = (opts_t) calloc(1, sizeof(struct gengetopt_args_info));
-  if (opts == NULL) {
-      perror("ERROR");
-      exit(EXIT_FAILURE);
-  }
-
-  have_config = parse_config(argc, argv);
+  have_config = parse_config(argc, argv, target);
 
   if (have_config == 0)
     {
-      if (cmdline_parser(argc, argv, opts) != 0)
+      if (cmdline_parser(argc, argv, target) != 0)
         {
           cleanup();
           exit (EXIT_FAILURE);
@@ -165,116 +185,192 @@ static void parse_cmdline(int argc, char **argv)
     }
 }
 
-int set_prayer_options(PrayerTimes *prayer_times) {
+static void parse_cmdline(int argc, char **argv)
+{
+  opts = (opts_t) calloc(1, sizeof(struct gengetopt_args_info));
+  if (opts == NULL) {
+      perror("ERROR");
+      exit(EXIT_FAILURE);
+  }
+
+  saved_argc = argc;
+  saved_argv = argv;
+  parse_options(argc, argv, opts);
+}
+
+int set_prayer_options(opts_t options, PrayerTimes *prayer_times) {
 
-    if(opts->calc_method_given) {         // --calc-method
-        if (strcmp(opts->calc_method_arg, "jafari") == 0)
+    if(options->calc_method_given) {         // --calc-method
+        if (strcmp(options->calc_method_arg, "jafari") == 0)
             prayer_times->set_calc_method(PrayerTimes::Jafari);
 
-        else if (strcmp(opts->calc_method_arg, "karachi") == 0)
+        else if (strcmp(options->calc_method_arg, "karachi") == 0)
             prayer_times->set_calc_method(PrayerTimes::Karachi);
 
-        else if (strcmp(opts->calc_method_arg, "isna") == 0)
+        else if (strcmp(options->calc_method_arg, "isna") == 0)
             prayer_times->set_calc_method(PrayerTimes::ISNA);
 
-        else if (strcmp(opts->calc_method_arg, "mwl") == 0)
+        else if (strcmp(options->calc_method_arg, "mwl") == 0)
             prayer_times->set_calc_method(PrayerTimes::MWL);
 
-        else if (strcmp(opts->calc_method_arg, "makkah") == 0)
+        else if (strcmp(options->calc_method_arg, "makkah") == 0)
             prayer_times->set_calc_method(PrayerTimes::Makkah);
 
-        else if (strcmp(opts->calc_method_arg, "egypt") == 0)
+        else if (strcmp(options->calc_method_arg, "egypt") == 0)
             prayer_times->set_calc_method(PrayerTimes::Egypt);
 
-        else if (strcmp(opts->calc_method_arg, "custom") == 0)
+        else if (strcmp(options->calc_method_arg, "custom") == 0)
             prayer_times->set_calc_method(PrayerTimes::Custom);
     }
-    if(opts->asr_juristic_method_given) { // --asr-juristic-method
-        if (strcmp(opts->asr_juristic_method_arg, "shafii") == 0)
+    if(options->asr_juristic_method_given) { // --asr-juristic-method
+        if (strcmp(options->asr_juristic_method_arg, "shafii") == 0)
             prayer_times->set_asr_method(PrayerTimes::Shafii);
 
-        else if (strcmp(opts->asr_juristic_method_arg, "hanafi") == 0)
+        else if (strcmp(options->asr_juristic_method_arg, "hanafi") == 0)
             prayer_times->set_asr_method(PrayerTimes::Hanafi);
     }
-    if(opts->high_lats_method_given) {    // --high-lats-method
-        if (strcmp(opts->high_lats_method_arg, "none") == 0)
+    if(options->high_lats_method_given) {    // --high-lats-method
+        if (strcmp(options->high_lats_method_arg, "none") == 0)
             prayer_times->set_high_lats_adjust_method(PrayerTimes::None);
 
-        else if (strcmp(opts->high_lats_method_arg, "midnight") == 0)
+        else if (strcmp(options->high_lats_method_arg, "midnight") == 0)
             prayer_times->set_high_lats_adjust_method(PrayerTimes::MidNight);
 
-        else if (strcmp(opts->high_lats_method_arg, "oneseventh") == 0)
+        else if (strcmp(options->high_lats_method_arg, "oneseventh") == 0)
             prayer_times->set_high_lats_adjust_method(PrayerTimes::OneSeventh);
 
-        else if (strcmp(opts->high_lats_method_arg, "anglebased") == 0)
+        else if (strcmp(options->high_lats_method_arg, "anglebased") == 0)
             prayer_times->set_high_lats_adjust_method(PrayerTimes::AngleBased);
     }
-    if(opts->dhuhr_minutes_given) {
-        prayer_times->set_dhuhr_minutes(opts->dhuhr_minutes_arg);
+    if(options->dhuhr_minutes_given) {
+        prayer_times->set_dhuhr_minutes(options->dhuhr_minutes_arg);
     }
-    if(opts->maghrib_minutes_given) {
-        prayer_times->set_maghrib_minutes(opts->maghrib_minutes_arg);
+    if(options->maghrib_minutes_given) {
+        prayer_times->set_maghrib_minutes(options->maghrib_minutes_arg);
     }
-    if(opts->isha_minutes_given) {
-        prayer_times->set_isha_minutes(opts->isha_minutes_arg);
+    if(options->isha_minutes_given) {
+        prayer_times->set_isha_minutes(options->isha_minutes_arg);
     }
-    if(opts->fajr_angle_given) {
-        prayer_times->set_fajr_angle(opts->fajr_angle_arg);
+    if(options->fajr_angle_given) {
+        prayer_times->set_fajr_angle(options->fajr_angle_arg);
     }
-    if(opts->maghrib_angle_given) {
-        prayer_times->set_maghrib_angle(opts->maghrib_angle_arg);
+    if(options->maghrib_angle_given) {
+        prayer_times->set_maghrib_angle(options->maghrib_angle_arg);
     }
-    if(opts->isha_angle_given) {
-        prayer_times->set_isha_angle(opts->isha_angle_arg);
+    if(options->isha_angle_given) {
+        prayer_times->set_isha_angle(options->isha_angle_arg);
     }
 
     return 0;
 }
 
-int get_next_prayer(PrayerTimes *prayer_times, prayer_t *prayer) {
-    time_t time_of_day, curr_time = time(NULL);
-    double timezone = NAN;
-	double times[PrayerTimes::TimesCount];
-
-    timezone = PrayerTimes::get_effective_timezone(curr_time);
+/* Hash of the options and the time zone that change the computed schedule */
+static uint64_t prayer_options_hash(opts_t o, const char *zone) {
+    uint64_t hash = SCHEDCACHE_HASH_INIT;
+
+#define HASH_VALUE(value) (hash = schedcache_hash(hash, &(value), sizeof(value)))
+#define HASH_STRING(field) do { HASH_VALUE(o->field##_given); \
+        if(o->field##_given) hash = schedcache_hash(hash, o->field##_arg, strlen(o->field##_arg) + 1); \
+    } while(0)
+#define HASH_OPTIONAL(field) do { HASH_VALUE(o->field##_given); \
+        if(o->field##_given) HASH_VALUE(o->field##_arg); \
+    } while(0)
+
+    HASH_VALUE(o->latitude_arg);
+    HASH_VALUE(o->longitude_arg);
+    HASH_STRING(calc_method);
+    HASH_STRING(asr_juristic_method);
+    HASH_STRING(high_lats_method);
+    HASH_OPTIONAL(dhuhr_minutes);
+    HASH_OPTIONAL(maghrib_minutes);
+    HASH_OPTIONAL(isha_minutes);
+    HASH_OPTIONAL(fajr_angle);
+    HASH_OPTIONAL(maghrib_angle);
+    HASH_OPTIONAL(isha_angle);
+    hash = schedcache_hash(hash, zone, strlen(zone) + 1);
+
+#undef HASH_VALUE
+#undef HASH_STRING
+#undef HASH_OPTIONAL
+    return hash;
+}
 
-    /* Only check times between today and tomorrow otherwise give error */
-    for(time_t j = curr_time; j <= curr_time + SECONDSINDAY; j += SECONDSINDAY) {
-        prayer_times->get_prayer_times(j, opts->latitude_arg, 
-            opts->longitude_arg, timezone, times);
-        for (int i = 0; i < PrayerTimes::TimesCount; i++) {
-            /* Skip time for Sunrise (1) and Sunset (4) */
-            if (i == 1 || i == 4)
-                i++;
-
-            time_of_day = PrayerTimes::float_time_to_epoch(times[i], j);
-            if(time_of_day >= curr_time) {
-                prayer->name_id = i;
-                prayer->seconds = time_of_day - curr_time;
-                strcpy(prayer->time24, PrayerTimes::float_time_to_time24(times[i]).c_str());
-                return 1;
-            }
-        }
+/* --city: replace the location by the city's, -1 without a database, -2 if unknown */
+static int resolve_city(opts_t o) {
+    citydb_t db;
+    const citydb_city_t *city;
+
+    if(!o->city_given)
+        return 0;
+    if(citydb_open(&db, o->citydb_arg) < 0)
+        return -1;
+    city = citydb_find(&db, o->city_arg);
+    if(city) {
+        o->latitude_arg = city->latitude;
+        o->longitude_arg = city->longitude;
+        o->latitude_given = 1;
+        o->longitude_given = 1;
     }
+    citydb_close(&db);
+    return city ? 0 : -2;
+}
+
+/* --auto-timezone: the zone of the location, else "" for the TZ we started with */
+static int resolve_timezone(opts_t o, char *zone, size_t size) {
+    tzmap_t map;
+
+    zone[0] = '\0';
+    if(!o->auto_timezone_given)
+        return 0;
+    if(tzmap_open(&map, o->tzmap_arg) < 0)
+        return -1;
+    snprintf(zone, size, "%s", tzmap_name(&map, tzmap_zone(&map, o->latitude_arg, o->longitude_arg)));
+    tzmap_close(&map);
     return 0;
 }
 
+/* Switch the process to a zone of resolve_timezone() */
+static void apply_timezone(const char *zone) {
+    if(*zone)
+        setenv("TZ", zone, 1);
+    else if(startup_tz)
+        setenv("TZ", startup_tz, 1);
+    else
+        unsetenv("TZ");
+    tzset();
+    snprintf(active_zone, sizeof(active_zone), "%s", zone);
+}
+
+int get_next_prayer(prayer_t *prayer, time_t curr_time) {
+    int time_id;
+    time_t time_of_day;
+    const char *time24;
+
+    /* Only check times between today and tomorrow otherwise give error */
+    if(!schedule_next(&schedule, curr_time, &time_id, &time_of_day, &time24))
+        return 0;
+
+    prayer->name_id = time_id;
+    prayer->seconds = time_of_day - curr_time;
+    prayer->epoch = time_of_day;
+    strcpy(prayer->time24, time24);
+    return 1;
+}
+
 void play_azan() {
-    switch(fork()) {
-        case -1:
-            syslog(LOG_INFO, "Unable to fork Azan player process");
-            exit(EXIT_FAILURE);
-            break;
-        case 0:
-            /* child process */
-            syslog(LOG_INFO, "Forking azan player");
-            execl(PLAYER, "aplay", AZAN, (char *) 0);
-            exit(EXIT_SUCCESS);
-            break;
-        default:
-            /* parent process */
-            break;
+    char *argv[] = { (char *) "aplay", opts->azan_file_arg, NULL };
+    pid_t pid;
+
+    if(in_process_audio) {
+        PTIMES_PROBE(action_spawn, 0);
+        audio_play();
+        return;
     }
+
+    /* A player still running from the last prayer is stopped first */
+    pid = supervise_spawn("azan player", PLAYER, argv, 0);
+    if(pid > 0)
+        PTIMES_PROBE(action_spawn, pid);
 }
 
 void daemonize(void) {
@@ -287,9 +383,13 @@ void daemonize(void) {
     int daemonize = 1;
 #endif
 
+    /* systemd supervises a Type=notify service itself, no fork or PID file */
+    if(systemd_notify_enabled())
+        daemonize = 0;
+
     /* Setup signal handling before we start */
-    signal(SIGCHLD, SIG_IGN);
-    signal(SIGHUP, signal_handler);
+    /* Children are reaped through their pidfds or waited for */
+    signal(SIGCHLD, SIG_DFL);
     signal(SIGTERM, signal_handler);
     signal(SIGINT, signal_handler);
     signal(SIGQUIT, signal_handler);
@@ -356,14 +456,537 @@ void daemonize(void) {
     }
 }
 
+/* Arm the prayer timer for the first prayer at or after from */
+static void schedule_next_prayer(time_t from) {
+    struct itimerspec its;
+    char status[64];
+
+    memset(&its, 0, sizeof(its));
+    if(get_next_prayer(&next_prayer, from)) {
+        syslog(LOG_INFO, "%s will be in %d minutes at %s", TimeName[(int) next_prayer.name_id],
+            next_prayer.seconds/60, next_prayer.time24);
+        snprintf(status, sizeof(status), "STATUS=Next prayer %s at %s",
+            TimeName[(int) next_prayer.name_id], next_prayer.time24);
+        systemd_notify(status);
+        its.it_value.tv_sec = next_prayer.epoch;
+    } else {
+        /* Nothing found for today and tomorrow, try again later */
+        next_prayer.epoch = -1;
+        its.it_value.tv_sec = from + SECONDSINDAY / 24;
+    }
+    shmpub_publish(&schedule, next_prayer.name_id, next_prayer.epoch);
+    if(opts->announce_given && !vclock_simulated())
+        announce_publish(&schedule, next_prayer.name_id, next_prayer.epoch,
+            prayer_options_hash(active_opts, active_zone));
+    prayer_deadline = its.it_value.tv_sec;
+
+    /* The simulation runs the deadlines itself */
+    if(vclock_simulated())
+        return;
+
+    /* Absolute wall clock deadline, cancelled when the clock is set */
+    if(timerfd_settime(prayer_timer.fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+            &its, NULL) < 0) {
+        syslog(LOG_ERR, "Unable to arm prayer timer: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    PTIMES_PROBE(timer_armed, next_prayer.epoch >= 0 ? next_prayer.name_id : -1,
+        its.it_value.tv_sec);
+
+    if(in_process_audio && next_prayer.epoch >= 0) {
+        its.it_value.tv_sec = next_prayer.epoch - AUDIO_PREPARE_SECONDS;
+        timerfd_settime(prepare_timer.fd, TFD_TIMER_ABSTIME, &its, NULL);
+    }
+    actions_rearm(vclock_now());
+}
+
+static void prepare_timer_callback(event_source_t *source, uint32_t events) {
+    uint64_t expirations;
+
+    if(read(source->fd, &expirations, sizeof(expirations)) > 0)
+        audio_prepare();
+}
+
+/* --simulate: one line per fired event instead of the alert action */
+static void trace_event(int time_id, time_t epoch) {
+    char local[32];
+    struct tm *tm = localtime(&epoch);
+
+    strftime(local, sizeof(local), "%Y-%m-%dT%H:%M:%S%z", tm);
+    fprintf(trace, "%s,%s,%ld\n", local, TimeName[time_id], (long) epoch);
+}
+
+static void prayer_timer_callback(event_source_t *source, uint32_t events) {
+    uint64_t expirations;
+    int64_t wakeup_ns = metrics_now_ns();
+    time_t now = vclock_now();
+
+    if(read(source->fd, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED) {
+        /* The system clock was changed, recompute from the new time */
+        schedule_next_prayer(now);
+        return;
+    }
+
+    if(next_prayer.epoch >= 0 && now >= next_prayer.epoch) {
+        int64_t scheduled_ns = (int64_t) next_prayer.epoch * 1000000000;
+
+        metrics_record(METRIC_WAKEUP_DELAY, wakeup_ns - scheduled_ns);
+        PTIMES_PROBE(timer_fired, next_prayer.name_id, next_prayer.epoch, wakeup_ns - scheduled_ns);
+        metrics_count(METRIC_ALERTS);
+        metrics_alert(next_prayer.epoch);
+        last_alert = next_prayer.epoch;
+        if(trace)
+            trace_event(next_prayer.name_id, next_prayer.epoch);
+        else
+            play_azan();
+        /* Includes the spawn up to the exec, or the hand-off to the audio thread */
+        metrics_record(METRIC_ACTION_DELAY, metrics_now_ns() - scheduled_ns);
+        syslog(LOG_INFO, "Time for %s", TimeName[(int) next_prayer.name_id]);
+        /* Make sure we don't keep on alerting for the same prayer */
+        schedule_next_prayer(now > next_prayer.epoch ? now : next_prayer.epoch + 1);
+        schedcache_maintain(&schedule, prayer_options_hash(active_opts, active_zone), now);
+        /* The next rollover then needs no calculation */
+        schedule_precompute(&schedule, now);
+    } else {
+        schedule_next_prayer(now);
+    }
+}
+
+/* The generated parser exits on any error, so let a child try it first */
+static int options_are_valid(void) {
+    int fds[2];
+    char ok = 0;
+    pid_t pid;
+
+    if(pipe2(fds, O_CLOEXEC) < 0)
+        return 0;
+
+    switch(pid = fork()) {
+        case -1:
+            close(fds[0]);
+            close(fds[1]);
+            return 0;
+        case 0:
+            close(fds[0]);
+            parse_options(saved_argc, saved_argv,
+                (opts_t) calloc(1, sizeof(struct gengetopt_args_info)));
+            write(fds[1], "1", 1);
+            _exit(EXIT_SUCCESS);
+        default:
+            break;
+    }
+
+    close(fds[1]);
+    while(read(fds[0], &ok, 1) < 0 && errno == EINTR)
+        ;
+    close(fds[0]);
+    while(waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+        ;
+    return ok == '1';
+}
+
+/*
+ * Re-read the configuration and swap in a new schedule when the prayer
+ * parameters changed. The new schedule is computed completely before it
+ * replaces the old one; an alert that is already playing is left alone.
+ * Sockets, audio and metrics settings only take effect after a restart.
+ */
+static void reload_config(void) {
+    opts_t fresh;
+    time_t now = vclock_now();
+
+    syslog(LOG_INFO, "Reloading configuration");
+    if(!options_are_valid()) {
+        syslog(LOG_ERR, "Invalid configuration, keeping the current one");
+        return;
+    }
+
+    fresh = (opts_t) calloc(1, sizeof(struct gengetopt_args_info));
+    if(fresh == NULL) {
+        syslog(LOG_ERR, "Unable to reload configuration: %s", strerror(errno));
+        return;
+    }
+    parse_options(saved_argc, saved_argv, fresh);
+    if(resolve_city(fresh) < 0) {
+        syslog(LOG_ERR, "Unable to find city %s in %s, keeping the current configuration",
+            fresh->city_arg, fresh->citydb_arg);
+        cmdline_parser_free(fresh);
+        free(fresh);
+        return;
+    }
+    if(!fresh->latitude_given || !fresh->longitude_given) {
+        syslog(LOG_ERR, "Configuration without a location, keeping the current one");
+        cmdline_parser_free(fresh);
+        free(fresh);
+        return;
+    }
+    char fresh_zone[sizeof(active_zone)];
+    if(resolve_timezone(fresh, fresh_zone, sizeof(fresh_zone)) < 0) {
+        syslog(LOG_ERR, "Unable to open %s: %s, keeping the current configuration",
+            fresh->tzmap_arg, strerror(errno));
+        cmdline_parser_free(fresh);
+        free(fresh);
+        return;
+    }
+
+    if(prayer_options_hash(active_opts, active_zone) == prayer_options_hash(fresh, fresh_zone)) {
+        syslog(LOG_INFO, "Prayer time parameters unchanged");
+        cmdline_parser_free(fresh);
+        free(fresh);
+        return;
+    }
+
+    PrayerTimes fresh_times;
+    schedule_t fresh_schedule;
+
+    set_prayer_options(fresh, &fresh_times);
+    /* Local days and times of the new schedule are in its zone */
+    apply_timezone(fresh_zone);
+    schedule_init(&fresh_schedule, &fresh_times, fresh->latitude_arg, fresh->longitude_arg);
+    schedule_update(&fresh_schedule, now);
+
+    prayer_times = fresh_times;
+    schedule = fresh_schedule;
+    httpd_set_defaults(&prayer_times);
+    actions_reset(now);
+
+    /* Subsystems keep pointers into the startup options, never free those */
+    if(active_opts != opts) {
+        cmdline_parser_free(active_opts);
+        free(active_opts);
+    }
+    active_opts = fresh;
+
+    syslog(LOG_INFO, "Using latitude=%.5lf, longitude=%.5lf", fresh->latitude_arg,
+        fresh->longitude_arg);
+    schedule_next_prayer(last_alert >= now ? last_alert + 1 : now);
+    schedcache_maintain(&schedule, prayer_options_hash(active_opts, active_zone), now);
+}
+
+static void reload_signal_callback(event_source_t *source, uint32_t events) {
+    struct signalfd_siginfo info;
+    int pending = 0;
+
+    /* Any number of queued SIGHUPs make a single reload */
+    while(read(source->fd, &info, sizeof(info)) == sizeof(info))
+        pending = 1;
+    if(pending) {
+        systemd_notify("RELOADING=1");
+        reload_config();
+        systemd_notify("READY=1");
+    }
+}
+
+/* First day of --print and city batches: --from or today */
+static int first_day(long *first) {
+    int year, month, day;
+    char tail;
+
+    if(!opts->from_given) {
+        *first = schedule_local_day(time(NULL));
+        return 0;
+    }
+    if(sscanf(opts->from_arg, "%4d-%2d-%2d%c", &year, &month, &day, &tail) != 3
+            || !PrayerTimes::is_valid_date(year, month, day)) {
+        fprintf(stderr, "%s: invalid date %s, expected YYYY-MM-DD\n", DAEMON_NAME, opts->from_arg);
+        return -1;
+    }
+    *first = PrayerTimes::days_from_civil(year, month, day);
+    return 0;
+}
+
+/* --print: write the timetable to stdout instead of running the daemon */
+static int print_timetable(void) {
+    int format = TIMETABLE_CSV;
+    long first;
+
+    if(first_day(&first) < 0)
+        return -1;
+    if(opts->days_arg < 1) {
+        fprintf(stderr, "%s: --days must be at least 1\n", DAEMON_NAME);
+        return -1;
+    }
+
+    for(int i = 0; cmdline_parser_format_values[i]; i++)
+        if(strcmp(opts->format_arg, cmdline_parser_format_values[i]) == 0)
+            format = i;
+
+    if(timetable_print(STDOUT_FILENO, &prayer_times, opts->latitude_arg, opts->longitude_arg,
+            first, opts->days_arg, format) < 0) {
+        perror("ERROR");
+        return -1;
+    }
+    return 0;
+}
+
+static time_t local_midnight(long day) {
+    struct tm midnight;
+
+    memset(&midnight, 0, sizeof(midnight));
+    PrayerTimes::civil_from_days(day, midnight.tm_year, midnight.tm_mon, midnight.tm_mday);
+    midnight.tm_year -= 1900;
+    midnight.tm_mon -= 1;
+    midnight.tm_isdst = -1;
+    return mktime(&midnight);
+}
+
+/*
+ * --simulate: run the daemon's alert path on a virtual clock that jumps
+ * from one armed deadline to the next, and trace every fired event. The
+ * trace is deterministic, the summary on stderr gives the throughput.
+ */
+static int simulate(void) {
+    long first, events = 0;
+    time_t begin, end;
+    int64_t start_ns, elapsed_ns;
+
+    if(first_day(&first) < 0)
+        return -1;
+    if(opts->days_arg < 1) {
+        fprintf(stderr, "%s: --days must be at least 1\n", DAEMON_NAME);
+        return -1;
+    }
+    trace = opts->trace_given ? fopen(opts->trace_arg, "w") : stdout;
+    if(trace == NULL) {
+        perror(opts->trace_arg);
+        return -1;
+    }
+
+    begin = local_midnight(first);
+    end = local_midnight(first + opts->days_arg);
+    active_opts = opts;
+    prayer_timer.fd = -1;
+    /* Every event logs twice at LOG_INFO, keep only the problems */
+    setlogmask(LOG_UPTO(LOG_WARNING));
+    vclock_simulate(begin);
+    schedule_init(&schedule, &prayer_times, opts->latitude_arg, opts->longitude_arg);
+    /* Actions are traced at their firing times too, nothing is run */
+    if(opts->actions_given) {
+        if(actions_simulate(opts->actions_arg, &schedule, trace) < 0)
+            return -1;
+        actions_rearm(begin);
+    }
+
+    fprintf(trace, "time,prayer,epoch\n");
+    start_ns = metrics_monotonic_ns();
+    schedule_next_prayer(begin);
+    while(true) {
+        time_t action_deadline = actions_deadline();
+        time_t next = (action_deadline >= 0 && action_deadline < prayer_deadline) ?
+            action_deadline : prayer_deadline;
+        if(next >= end)
+            break;
+        vclock_advance(next);
+        if(next == prayer_deadline) {
+            if(next_prayer.epoch >= 0)
+                events++;
+            prayer_timer_callback(&prayer_timer, EPOLLIN);
+        }
+        if(next == action_deadline)
+            actions_expire(next);
+    }
+    elapsed_ns = metrics_monotonic_ns() - start_ns;
+
+    fprintf(stderr, "%ld events in %d days, %.3f s, %ld ns per event\n", events, opts->days_arg,
+        elapsed_ns / 1e9, events ? (long) (elapsed_ns / events) : 0L);
+    if(trace != stdout && fclose(trace) != 0) {
+        perror(opts->trace_arg);
+        return -1;
+    }
+    return 0;
+}
+
+/* --test-actions: run the action pipeline once, e.g. against a local stub */
+static int test_actions(void) {
+    prayer_t prayer;
+
+    if(!opts->actions_given) {
+        fprintf(stderr, "%s: --test-actions needs --actions\n", DAEMON_NAME);
+        return -1;
+    }
+    openlog(DAEMON_NAME, LOG_PERROR | LOG_PID, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+    schedule_init(&schedule, &prayer_times, opts->latitude_arg, opts->longitude_arg);
+    if(event_loop_init() < 0
+            || supervise_init(opts->max_actions_arg, opts->action_timeout_arg) < 0
+            || actions_init(opts->actions_arg, opts->action_workers_arg, &schedule) < 0)
+        return -1;
+    if(!get_next_prayer(&prayer, vclock_now())) {
+        fprintf(stderr, "%s: no prayer within today and tomorrow\n", DAEMON_NAME);
+        return -1;
+    }
+    return actions_test(prayer.name_id, prayer.epoch, prayer.time24, stdout);
+}
+
+/* --listen: show and publish the schedule of another daemon, computing nothing */
+static int listen_announcements(void) {
+    openlog(DAEMON_NAME, LOG_PERROR | LOG_PID, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+    if(event_loop_init() < 0) {
+        perror("epoll");
+        return -1;
+    }
+    if(opts->shm_file_given && shmpub_init(opts->shm_file_arg) < 0)
+        return -1;
+    if(announce_listen(opts->listen_arg, opts->announce_key_arg) < 0)
+        return -1;
+
+    while(true) {
+        if(event_loop_run_once(-1) < 0) {
+            perror("epoll_wait");
+            return -1;
+        }
+    }
+}
+
+/* --auto-timezone for batches: every record gets the zone of its location */
+static int use_tzmap(void) {
+    static tzmap_t map;
+
+    if(!opts->auto_timezone_given)
+        return 0;
+    if(tzmap_open(&map, opts->tzmap_arg) < 0) {
+        perror(opts->tzmap_arg);
+        return -1;
+    }
+    batch_use_tzmap(&map);
+    return 0;
+}
+
+/* --batch --min-population: every large enough city of the database */
+static int batch_cities(void) {
+    citydb_t db;
+    long first;
+    int rc;
+
+    if(first_day(&first) < 0)
+        return -1;
+    if(citydb_open(&db, opts->citydb_arg) < 0) {
+        perror(opts->citydb_arg);
+        return -1;
+    }
+    if(use_tzmap() < 0) {
+        citydb_close(&db);
+        return -1;
+    }
+    rc = batch_run_cities(&prayer_times, &db,
+        opts->min_population_arg > 0 ? opts->min_population_arg : 0, first,
+        strcmp(opts->batch_output_arg, "arrow") == 0, opts->threads_arg);
+    citydb_close(&db);
+    return rc;
+}
+
+/* --nearest-city: name the database city closest to the location */
+static int print_nearest_city(void) {
+    citydb_t db;
+    const citydb_city_t *city;
+    double distance;
+
+    if(citydb_open(&db, opts->citydb_arg) < 0) {
+        perror(opts->citydb_arg);
+        return -1;
+    }
+    city = citydb_nearest(&db, opts->latitude_arg, opts->longitude_arg, &distance);
+    printf("%s,%.2s,%.5f,%.5f,%u,%.1f km\n", citydb_name(&db, city), city->country,
+        city->latitude, city->longitude, city->population, distance);
+    citydb_close(&db);
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
-    int last_prayer = -1;
-    PrayerTimes prayer_times;
-    prayer_t next_prayer;
-
     parse_cmdline(argc, argv);
-    set_prayer_options(&prayer_times);
+    set_prayer_options(opts, &prayer_times);
+    if(getenv("TZ"))
+        startup_tz = strdup(getenv("TZ"));
+
+    if(opts->build_tzmap_given) {
+        long count = tzmap_build(opts->build_tzmap_arg, opts->tzmap_arg);
+        if(count >= 0)
+            printf("%ld zones written to %s\n", count, opts->tzmap_arg);
+        cleanup();
+        exit(count < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    if(opts->build_citydb_given) {
+        long count = citydb_build(opts->build_citydb_arg, opts->citydb_arg);
+        if(count >= 0)
+            printf("%ld cities written to %s\n", count, opts->citydb_arg);
+        cleanup();
+        exit(count < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    switch(resolve_city(opts)) {
+        case -1:
+            perror(opts->citydb_arg);
+            cleanup();
+            exit(EXIT_FAILURE);
+        case -2:
+            fprintf(stderr, "%s: unknown city %s\n", DAEMON_NAME, opts->city_arg);
+            cleanup();
+            exit(EXIT_FAILURE);
+    }
+
+    if(opts->listen_given) {
+        int rc = listen_announcements();
+        cleanup();
+        exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    /* Batch records carry their own location, everything else needs one */
+    if(opts->batch_given && opts->min_population_given) {
+        int rc = batch_cities();
+        cleanup();
+        exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    if(opts->batch_given) {
+        int rc = use_tzmap();
+        if(rc == 0)
+            rc = batch_run(&prayer_times, opts->input_given ? opts->input_arg : NULL,
+                strcmp(opts->batch_format_arg, "binary") == 0,
+                strcmp(opts->batch_output_arg, "arrow") == 0, opts->threads_arg);
+        cleanup();
+        exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    if(!opts->latitude_given || !opts->longitude_given) {
+        fprintf(stderr, "%s: '--latitude' ('-l') and '--longitude' ('-n') options required\n",
+            DAEMON_NAME);
+        cleanup();
+        exit(EXIT_FAILURE);
+    }
+    char zone[sizeof(active_zone)];
+    if(resolve_timezone(opts, zone, sizeof(zone)) < 0) {
+        perror(opts->tzmap_arg);
+        cleanup();
+        exit(EXIT_FAILURE);
+    }
+    apply_timezone(zone);
+
+    if(opts->nearest_city_given) {
+        int rc = print_nearest_city();
+        cleanup();
+        exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    if(opts->print_given) {
+        int rc = print_timetable();
+        cleanup();
+        exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    if(opts->simulate_given) {
+        int rc = simulate();
+        cleanup();
+        exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    if(opts->test_actions_given) {
+        int rc = test_actions();
+        cleanup();
+        exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    schedule_init(&schedule, &prayer_times, opts->latitude_arg, opts->longitude_arg);
 
     daemonize();
 
@@ -371,29 +994,97 @@ int main(int argc, char *argv[])
     syslog(LOG_INFO, 
         "%s daemon started with parameters latitude=%.5lf, longitude=%.5lf", 
         DAEMON_NAME, opts->latitude_arg, opts->longitude_arg);
- 
+
+    if(event_loop_init() < 0) {
+        syslog(LOG_ERR, "Unable to create event loop: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* Block SIGHUP before any thread starts so that only the signalfd sees it */
+    active_opts = opts;
+    sigemptyset(&reload_mask);
+    sigaddset(&reload_mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, &reload_mask, NULL);
+    reload_signal.fd = signalfd(-1, &reload_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    reload_signal.callback = reload_signal_callback;
+    reload_signal.data = NULL;
+    if(reload_signal.fd < 0 || event_loop_add(&reload_signal, EPOLLIN) < 0) {
+        syslog(LOG_ERR, "Unable to watch for SIGHUP: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if(opts->shm_file_given) {
+        if(shmpub_init(opts->shm_file_arg) < 0)
+            exit(EXIT_FAILURE);
+    }
+
+    if(opts->announce_given) {
+        if(announce_init(opts->announce_arg, opts->announce_key_arg,
+                opts->announce_interval_arg) < 0)
+            exit(EXIT_FAILURE);
+    }
+
+    if(strcmp(opts->audio_sink_arg, "aplay") != 0) {
+        if(audio_init(opts->audio_sink_arg, opts->azan_file_arg, opts->audio_device_arg) < 0)
+            exit(EXIT_FAILURE);
+        in_process_audio = 1;
+
+        prepare_timer.fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+        prepare_timer.callback = prepare_timer_callback;
+        prepare_timer.data = NULL;
+        if(prepare_timer.fd < 0 || event_loop_add(&prepare_timer, EPOLLIN) < 0) {
+            syslog(LOG_ERR, "Unable to create audio timer: %s", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    prayer_timer.fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    prayer_timer.callback = prayer_timer_callback;
+    prayer_timer.data = NULL;
+    if(prayer_timer.fd < 0 || event_loop_add(&prayer_timer, EPOLLIN) < 0) {
+        syslog(LOG_ERR, "Unable to create prayer timer: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if(opts->cache_file_given) {
+        if(schedcache_open(opts->cache_file_arg, prayer_options_hash(opts, active_zone), &schedule))
+            syslog(LOG_INFO, "Using schedule cache %s", opts->cache_file_arg);
+    }
+    schedule_next_prayer(vclock_now());
+    /* A missing or stale cache is written once the timers are armed */
+    schedcache_maintain(&schedule, prayer_options_hash(opts, active_zone), vclock_now());
+
+    if(opts->serve_given) {
+        if(httpd_init(opts->http_address_arg, opts->http_port_arg, &prayer_times) < 0)
+            exit(EXIT_FAILURE);
+    }
+
+    if(opts->query_socket_given) {
+        if(querysock_init(opts->query_socket_arg, opts->query_allow_uids_arg, &schedule) < 0)
+            exit(EXIT_FAILURE);
+    }
+
+    if(metrics_init(opts->metrics_file_arg, opts->metrics_interval_arg) < 0)
+        exit(EXIT_FAILURE);
+
+    if(supervise_init(opts->max_actions_arg, opts->action_timeout_arg) < 0)
+        exit(EXIT_FAILURE);
+
+    if(opts->actions_given) {
+        if(actions_init(opts->actions_arg, opts->action_workers_arg, &schedule) < 0)
+            exit(EXIT_FAILURE);
+        actions_rearm(vclock_now());
+    }
+
+    if(systemd_watchdog_init() < 0)
+        exit(EXIT_FAILURE);
+    systemd_notify("READY=1");
+
     while(true) {
-        if(get_next_prayer(&prayer_times, &next_prayer)) {
-            if(next_prayer.seconds != 0) {
-                syslog(LOG_INFO, "%s will be in %d minutes at %s", TimeName[next_prayer.name_id], 
-                    next_prayer.seconds/60, next_prayer.time24);
-
-                /* Wait till next prayer */
-                sleep(next_prayer.seconds);
-            } else {
-                /* If it's time for prayer then sleep for 1 second, 
-                 * so that we don't start utilizing too much CPU.
-                 */
-                sleep(1);
-            }
-
-            /* Make sure we don't keep on alerting for same prayer in the loop */
-            if(last_prayer != next_prayer.name_id) {
-                syslog(LOG_INFO, "Time for %s", TimeName[next_prayer.name_id]);
-                play_azan();    
-                last_prayer = next_prayer.name_id;
-            }
+        if(event_loop_run_once(-1) < 0) {
+            syslog(LOG_ERR, "Event loop failed: %s", strerror(errno));
+            break;
         }
+        metrics_count(METRIC_WAKEUPS);
     }
 
     syslog(LOG_INFO, "%s daemon exiting", DAEMON_NAME);
@@ -401,4 +1092,3 @@ int main(int argc, char *argv[])
     cleanup();
     exit(0);
 }
-
@@ -0,0 +1,54 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PTIMES_ANNOUNCE_H
+#define PTIMES_ANNOUNCE_H
+
+/*
+ * Datagram the ptimes daemon multicasts with --announce whenever its
+ * schedule or next prayer changes and every --announce-interval seconds,
+ * and that --listen consumes. All fields are little endian.
+ *
+ * tag is the HMAC-SHA256 of every byte before it under the shared key of
+ * --announce-key, truncated to PTIMES_ANNOUNCE_TAG_SIZE bytes. Receivers
+ * drop datagrams whose tag does not match and, against replays, those not
+ * newer in (sent, seq) than the last one they accepted.
+ */
+
+#include <stdint.h>
+
+#define PTIMES_ANNOUNCE_MAGIC 0x414d5450u  /* "PTMA" */
+#define PTIMES_ANNOUNCE_VERSION 1
+#define PTIMES_ANNOUNCE_DAYS 2              /* today and tomorrow */
+#define PTIMES_ANNOUNCE_TIMES 7             /* Fajr, Sunrise, Dhuhr, Asr, Sunset, Maghrib, Isha */
+#define PTIMES_ANNOUNCE_UNDEFINED INT32_MIN /* time undefined at this latitude */
+#define PTIMES_ANNOUNCE_NO_NEXT 0xff
+#define PTIMES_ANNOUNCE_TAG_SIZE 16
+
+struct ptimes_announce {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t next_id;        /* time ID of the next prayer, or PTIMES_ANNOUNCE_NO_NEXT */
+    uint16_t interval;      /* heartbeat of the sender in seconds */
+    uint32_t seq;           /* incremented with every datagram of a sender */
+    int64_t sent;           /* epoch of sending, the times count from here */
+    uint64_t config_hash;   /* prayer options of the sender, to spot drift */
+    int32_t first_day;      /* local days since 1970-01-01 of the first day */
+    int32_t times[PTIMES_ANNOUNCE_DAYS][PTIMES_ANNOUNCE_TIMES];    /* seconds after sent */
+    int32_t next;           /* seconds after sent of the next prayer */
+    uint8_t tag[PTIMES_ANNOUNCE_TAG_SIZE];
+} __attribute__((packed));
+
+#endif /* PTIMES_ANNOUNCE_H */
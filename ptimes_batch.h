@@ -0,0 +1,54 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PTIMES_BATCH_H
+#define PTIMES_BATCH_H
+
+/*
+ * Records of ptimes --batch --batch-format=binary. Input is a stream of
+ * ptimes_batch_record, the output has one ptimes_batch_result per input
+ * record in the same order. Both are in host byte order.
+ *
+ * The text format reads lines "lat,lon,YYYY-MM-DD[,method[,tz]]" and
+ * writes each line back followed by the seven times as ",HH:MM" (empty
+ * for times undefined at the latitude or for invalid lines).
+ */
+
+#include <stdint.h>
+
+#define PTIMES_BATCH_TIMES 7            /* Fajr, Sunrise, Dhuhr, Asr, Sunset, Maghrib, Isha */
+#define PTIMES_BATCH_DEFAULT_METHOD -1  /* method of the ptimes configuration */
+#define PTIMES_BATCH_HOST_TZ INT16_MIN  /* UTC offset of the host's time zone that day */
+
+enum ptimes_batch_status {
+    PTIMES_BATCH_OK = 0,
+    PTIMES_BATCH_INVALID = 1,
+};
+
+struct ptimes_batch_record {
+    double latitude;
+    double longitude;
+    int32_t day;            /* local day, days since 1970-01-01 */
+    int8_t method;          /* index into the --calc-method values */
+    uint8_t reserved;
+    int16_t tz_minutes;     /* UTC offset in minutes */
+};
+
+struct ptimes_batch_result {
+    int16_t minutes[PTIMES_BATCH_TIMES];  /* after local midnight, -1 when undefined */
+    uint16_t status;
+};
+
+#endif /* PTIMES_BATCH_H */
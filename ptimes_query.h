@@ -0,0 +1,73 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PTIMES_QUERY_H
+#define PTIMES_QUERY_H
+
+/*
+ * Protocol of the ptimes query socket (--query-socket).
+ *
+ * Text requests are lines, answered with "OK <n>" followed by n lines or
+ * with "ERR <reason>":
+ *
+ *   NEXT                   <name> <epoch> <HH:MM>
+ *   TODAY                  <name> <epoch> <HH:MM>          (7 lines)
+ *   RANGE YYYY-MM-DD N     <YYYY-MM-DD> <name> <epoch> <HH:MM>
+ *   STATS                  alert latency metrics in Prometheus text format
+ *
+ * Binary requests start with PTIMES_QUERY_MAGIC and use the structures
+ * below in host byte order. Any number of requests of either kind may be
+ * written at once, the answers come back in the same order.
+ */
+
+#include <stdint.h>
+
+#define PTIMES_QUERY_MAGIC 0xA5
+#define PTIMES_QUERY_MAX_DAYS 31
+
+enum ptimes_query_op {
+    PTIMES_QUERY_NEXT = 1,
+    PTIMES_QUERY_TODAY = 2,
+    PTIMES_QUERY_RANGE = 3,
+};
+
+enum ptimes_query_status {
+    PTIMES_QUERY_OK = 0,
+    PTIMES_QUERY_BAD_REQUEST = 1,
+};
+
+struct ptimes_query_request {
+    uint8_t magic;
+    uint8_t op;
+    uint16_t days;          /* RANGE: number of days */
+    int32_t day;            /* RANGE: first local day, days since 1970-01-01 */
+};
+
+struct ptimes_query_response {
+    uint8_t magic;
+    uint8_t op;
+    uint8_t status;
+    uint8_t reserved;
+    uint32_t count;         /* number of events that follow */
+};
+
+struct ptimes_query_event {
+    int64_t epoch;          /* -1 when undefined at this latitude */
+    int32_t day;
+    uint8_t time_id;        /* Fajr, Sunrise, Dhuhr, Asr, Sunset, Maghrib, Isha */
+    uint8_t reserved[3];
+};
+
+#endif /* PTIMES_QUERY_H */
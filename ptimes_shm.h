@@ -0,0 +1,137 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PTIMES_SHM_H
+#define PTIMES_SHM_H
+
+/*
+ * Header-only reader of the schedule the ptimes daemon publishes in shared
+ * memory (--shm-file). Opening maps the segment once, every read after that
+ * is a plain memory access guarded by a sequence lock: no system call and
+ * no context switch, cheap enough to poll at display refresh rate.
+ *
+ *   const struct ptimes_shm *shm = ptimes_shm_open("/dev/shm/ptimes");
+ *   struct ptimes_shm_event next;
+ *   if (shm && ptimes_shm_next(shm, time(NULL), &next))
+ *       printf("%s in %ld s\n", next.name, (long) (next.epoch - time(NULL)));
+ */
+
+/*
+ * O_CLOEXEC is POSIX.1-2008, hidden by a strict -std=c99 unless a feature
+ * macro is set; include this header first or define one yourself.
+ */
+#if defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE) && !defined(_XOPEN_SOURCE) \
+    && !defined(_GNU_SOURCE) && !defined(_DEFAULT_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define PTIMES_SHM_MAGIC 0x534d5450u   /* "PTMS" */
+#define PTIMES_SHM_VERSION 1
+#define PTIMES_SHM_DAYS 2               /* today and tomorrow */
+#define PTIMES_SHM_TIMES 7              /* Fajr, Sunrise, Dhuhr, Asr, Sunset, Maghrib, Isha */
+
+struct ptimes_shm_event {
+    int64_t epoch;          /* -1 when undefined at this latitude */
+    uint8_t time_id;
+    uint8_t is_prayer;      /* 0 for Sunrise and Sunset */
+    char name[8];
+    char time24[6];
+};
+
+struct ptimes_shm_data {
+    int64_t updated;        /* when the daemon last published */
+    struct ptimes_shm_event next;       /* next prayer as seen by the daemon */
+    struct ptimes_shm_event days[PTIMES_SHM_DAYS][PTIMES_SHM_TIMES];
+};
+
+struct ptimes_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;           /* odd while the daemon is writing */
+    uint32_t reserved;
+    struct ptimes_shm_data data;
+};
+
+/* Map the published segment read-only, returns NULL on failure */
+static inline const struct ptimes_shm *ptimes_shm_open(const char *path)
+{
+    const struct ptimes_shm *shm;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return NULL;
+    shm = (const struct ptimes_shm *) mmap(NULL, sizeof(struct ptimes_shm),
+        PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (shm == MAP_FAILED)
+        return NULL;
+    if (shm->magic != PTIMES_SHM_MAGIC || shm->version != PTIMES_SHM_VERSION) {
+        munmap((void *) shm, sizeof(struct ptimes_shm));
+        return NULL;
+    }
+    return shm;
+}
+
+static inline void ptimes_shm_close(const struct ptimes_shm *shm)
+{
+    munmap((void *) shm, sizeof(struct ptimes_shm));
+}
+
+/* Take a consistent snapshot of the published data */
+static inline void ptimes_shm_read(const struct ptimes_shm *shm, struct ptimes_shm_data *out)
+{
+    uint32_t begin, end;
+
+    do {
+        begin = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (begin & 1)
+            continue;   /* the daemon is in the middle of an update */
+        memcpy(out, (const void *) &shm->data, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+    } while ((begin & 1) || begin != end);
+}
+
+/* Find the next prayer at or after now, returns 0 when there is none */
+static inline int ptimes_shm_next(const struct ptimes_shm *shm, time_t now,
+    struct ptimes_shm_event *next)
+{
+    struct ptimes_shm_data data;
+    int found = 0;
+
+    ptimes_shm_read(shm, &data);
+    for (int d = 0; d < PTIMES_SHM_DAYS; d++) {
+        for (int i = 0; i < PTIMES_SHM_TIMES; i++) {
+            const struct ptimes_shm_event *event = &data.days[d][i];
+            if (!event->is_prayer || event->epoch < now)
+                continue;
+            if (!found || event->epoch < next->epoch) {
+                *next = *event;
+                found = 1;
+            }
+        }
+    }
+    return found;
+}
+
+#endif /* PTIMES_SHM_H */
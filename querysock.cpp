@@ -0,0 +1,462 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "eventloop.h"
+#include "metrics.h"
+#include "ptimes_query.h"
+#include "querysock.h"
+#include "systemd.h"
+
+#define QUERY_IN_SIZE 4096
+#define QUERY_OUT_SIZE 65536
+#define QUERY_MAX_CONNECTIONS 64
+#define QUERY_MAX_ALLOWED 16
+/* Largest answer: a text RANGE of PTIMES_QUERY_MAX_DAYS days or STATS */
+#define QUERY_RANGE_RESPONSE (16 + PTIMES_QUERY_MAX_DAYS * PrayerTimes::TimesCount * 48)
+#define QUERY_MAX_RESPONSE (QUERY_RANGE_RESPONSE > 16 + METRICS_TEXT_SIZE ? \
+    QUERY_RANGE_RESPONSE : 16 + METRICS_TEXT_SIZE)
+
+typedef struct _query_conn {
+    event_source_t source;
+    struct _query_conn *next;
+    size_t in_len;
+    size_t out_pos;
+    size_t out_len;
+    int closing;
+    int peer_closed;            /* answer what was read, then close */
+    char in[QUERY_IN_SIZE];
+    char out[QUERY_OUT_SIZE];
+} query_conn_t;
+
+static event_source_t listener;
+static query_conn_t *free_conns = NULL;
+static query_conn_t *released_conns = NULL;
+static int conns_count = 0;
+
+static schedule_t *schedule = NULL;
+static uid_t allowed_uids[QUERY_MAX_ALLOWED];
+static int allowed_count = -1;      /* -1: everybody */
+
+/* ---------------------- Answers ----------------------- */
+
+static void out_printf(query_conn_t *conn, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void out_printf(query_conn_t *conn, const char *fmt, ...) {
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(conn->out + conn->out_len, QUERY_OUT_SIZE - conn->out_len, fmt, ap);
+    va_end(ap);
+    if (len > 0)
+        conn->out_len += len;
+}
+
+static void out_write(query_conn_t *conn, const void *data, size_t len) {
+    memcpy(conn->out + conn->out_len, data, len);
+    conn->out_len += len;
+}
+
+/* Resolve the days of a request, today and tomorrow come from the schedule */
+static const schedule_day_t *query_day(long day, schedule_day_t *scratch) {
+    for (int i = 0; i < SCHEDULE_DAYS; i++)
+        if (schedule->days[i].day == day)
+            return &schedule->days[i];
+
+    schedule_fetch_day(schedule, day, scratch);
+    return scratch;
+}
+
+static void text_day_line(query_conn_t *conn, const schedule_day_t *day, int i, int with_date) {
+    if (with_date) {
+        int year, month, mday;
+        PrayerTimes::civil_from_days(day->day, year, month, mday);
+        out_printf(conn, "%04d-%02d-%02d ", year, month, mday);
+    }
+    out_printf(conn, "%s %ld %s\n", TimeName[i], (long) day->epoch[i],
+        day->time24[i][0] ? day->time24[i] : "-");
+}
+
+static void handle_text(query_conn_t *conn, char *line) {
+    time_t now = time(NULL);
+    schedule_day_t scratch;
+    int year, month, mday, days;
+    char tail;
+
+    schedule_update(schedule, now);
+
+    if (strcmp(line, "NEXT") == 0) {
+        int time_id;
+        time_t epoch;
+        const char *time24;
+
+        if (!schedule_next(schedule, now, &time_id, &epoch, &time24)) {
+            out_printf(conn, "OK 0\n");
+            return;
+        }
+        out_printf(conn, "OK 1\n%s %ld %s\n", TimeName[time_id], (long) epoch, time24);
+    } else if (strcmp(line, "TODAY") == 0) {
+        out_printf(conn, "OK %d\n", PrayerTimes::TimesCount);
+        for (int i = 0; i < PrayerTimes::TimesCount; i++)
+            text_day_line(conn, &schedule->days[0], i, 0);
+    } else if (sscanf(line, "RANGE %4d-%2d-%2d %d%c", &year, &month, &mday, &days, &tail) == 4) {
+        if (!PrayerTimes::is_valid_date(year, month, mday)) {
+            out_printf(conn, "ERR invalid date\n");
+            return;
+        }
+        if (days < 1 || days > PTIMES_QUERY_MAX_DAYS) {
+            out_printf(conn, "ERR days must be between 1 and %d\n", PTIMES_QUERY_MAX_DAYS);
+            return;
+        }
+        long first = PrayerTimes::days_from_civil(year, month, mday);
+        out_printf(conn, "OK %d\n", days * PrayerTimes::TimesCount);
+        for (long d = first; d < first + days; d++) {
+            const schedule_day_t *day = query_day(d, &scratch);
+            for (int i = 0; i < PrayerTimes::TimesCount; i++)
+                text_day_line(conn, day, i, 1);
+        }
+    } else if (strcmp(line, "STATS") == 0) {
+        char text[METRICS_TEXT_SIZE];
+        size_t len = metrics_format(text, sizeof(text));
+        int lines = 0;
+
+        for (size_t i = 0; i < len; i++)
+            lines += text[i] == '\n';
+        out_printf(conn, "OK %d\n", lines);
+        out_write(conn, text, len);
+    } else {
+        out_printf(conn, "ERR unknown request\n");
+    }
+}
+
+static void binary_events(query_conn_t *conn, const schedule_day_t *day) {
+    for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+        struct ptimes_query_event event;
+        memset(&event, 0, sizeof(event));
+        event.epoch = day->epoch[i];
+        event.day = day->day;
+        event.time_id = i;
+        out_write(conn, &event, sizeof(event));
+    }
+}
+
+static void handle_binary(query_conn_t *conn, const struct ptimes_query_request *req) {
+    struct ptimes_query_response resp;
+    time_t now = time(NULL);
+    schedule_day_t scratch;
+
+    memset(&resp, 0, sizeof(resp));
+    resp.magic = PTIMES_QUERY_MAGIC;
+    resp.op = req->op;
+
+    schedule_update(schedule, now);
+
+    switch (req->op) {
+        case PTIMES_QUERY_NEXT: {
+            struct ptimes_query_event event;
+            int time_id;
+            time_t epoch;
+
+            memset(&event, 0, sizeof(event));
+            resp.count = schedule_next(schedule, now, &time_id, &epoch, NULL);
+            out_write(conn, &resp, sizeof(resp));
+            if (resp.count) {
+                event.epoch = epoch;
+                event.day = schedule_local_day(epoch);
+                event.time_id = time_id;
+                out_write(conn, &event, sizeof(event));
+            }
+            break;
+        }
+        case PTIMES_QUERY_TODAY:
+            resp.count = PrayerTimes::TimesCount;
+            out_write(conn, &resp, sizeof(resp));
+            binary_events(conn, &schedule->days[0]);
+            break;
+        case PTIMES_QUERY_RANGE:
+            if (req->days < 1 || req->days > PTIMES_QUERY_MAX_DAYS) {
+                resp.status = PTIMES_QUERY_BAD_REQUEST;
+                out_write(conn, &resp, sizeof(resp));
+                break;
+            }
+            resp.count = req->days * PrayerTimes::TimesCount;
+            out_write(conn, &resp, sizeof(resp));
+            for (long d = req->day; d < req->day + req->days; d++)
+                binary_events(conn, query_day(d, &scratch));
+            break;
+        default:
+            resp.status = PTIMES_QUERY_BAD_REQUEST;
+            out_write(conn, &resp, sizeof(resp));
+            break;
+    }
+}
+
+/* ---------------------- Connections ----------------------- */
+
+static void conn_close(query_conn_t *conn) {
+    event_loop_remove(&conn->source);
+    close(conn->source.fd);
+    conn->next = released_conns;
+    released_conns = conn;
+    conns_count--;
+}
+
+static void recycle_conns(void) {
+    while (released_conns) {
+        query_conn_t *conn = released_conns;
+        released_conns = conn->next;
+        conn->next = free_conns;
+        free_conns = conn;
+    }
+}
+
+/* Answer every complete request of the batch in the input buffer */
+static void conn_process(query_conn_t *conn) {
+    size_t pos = 0;
+
+    while (pos < conn->in_len && !conn->closing) {
+        if (QUERY_OUT_SIZE - conn->out_len < QUERY_MAX_RESPONSE)
+            break;
+
+        if ((uint8_t) conn->in[pos] == PTIMES_QUERY_MAGIC) {
+            struct ptimes_query_request req;
+            if (conn->in_len - pos < sizeof(req))
+                break;
+            memcpy(&req, conn->in + pos, sizeof(req));
+            handle_binary(conn, &req);
+            pos += sizeof(req);
+            continue;
+        }
+
+        char *end = (char *) memchr(conn->in + pos, '\n', conn->in_len - pos);
+        if (end == NULL) {
+            if (pos == 0 && conn->in_len == QUERY_IN_SIZE) {
+                out_printf(conn, "ERR request too long\n");
+                conn->closing = 1;
+            }
+            break;
+        }
+        *end = '\0';
+        if (end > conn->in + pos && end[-1] == '\r')
+            end[-1] = '\0';
+        handle_text(conn, conn->in + pos);
+        pos = end + 1 - conn->in;
+    }
+
+    memmove(conn->in, conn->in + pos, conn->in_len - pos);
+    conn->in_len -= pos;
+}
+
+/* Returns 1 when conn_process() has something to answer */
+static int conn_has_request(const query_conn_t *conn) {
+    if (conn->in_len == QUERY_IN_SIZE)
+        return 1;
+    if (conn->in_len > 0 && (uint8_t) conn->in[0] == PTIMES_QUERY_MAGIC)
+        return conn->in_len >= sizeof(struct ptimes_query_request);
+    return memchr(conn->in, '\n', conn->in_len) != NULL;
+}
+
+static int conn_flush(query_conn_t *conn) {
+    while (conn->out_pos < conn->out_len) {
+        ssize_t n = send(conn->source.fd, conn->out + conn->out_pos,
+            conn->out_len - conn->out_pos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        conn->out_pos += n;
+    }
+
+    memmove(conn->out, conn->out + conn->out_pos, conn->out_len - conn->out_pos);
+    conn->out_len -= conn->out_pos;
+    conn->out_pos = 0;
+    return (conn->closing && conn->out_len == 0) ? -1 : 0;
+}
+
+static void conn_callback(event_source_t *source, uint32_t events) {
+    query_conn_t *conn = (query_conn_t *) source->data;
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        conn_close(conn);
+        return;
+    }
+
+    /* A full buffer is left to conn_process(), recv() would read 0 like EOF */
+    if ((events & EPOLLIN) && conn->in_len < QUERY_IN_SIZE) {
+        ssize_t n = recv(source->fd, conn->in + conn->in_len, QUERY_IN_SIZE - conn->in_len, 0);
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            conn_close(conn);
+            return;
+        }
+        if (n == 0)
+            conn->peer_closed = 1;
+        if (n > 0)
+            conn->in_len += n;
+    }
+
+    do {
+        conn_process(conn);
+        if (conn_flush(conn) < 0) {
+            conn_close(conn);
+            return;
+        }
+    /* Output drained but pipelined requests are still waiting */
+    } while (conn->out_len == 0 && !conn->closing && conn_has_request(conn));
+
+    if (conn->peer_closed && conn->out_len == 0) {
+        conn_close(conn);
+        return;
+    }
+
+    /* Stop reading while the client does not keep up with our answers */
+    event_loop_modify(source, (conn->out_len > 0) ? EPOLLOUT : EPOLLIN);
+}
+
+static int peer_allowed(int fd) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    if (allowed_count < 0)
+        return 1;
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        return 0;
+    if (cred.uid == 0 || cred.uid == geteuid())
+        return 1;
+    for (int i = 0; i < allowed_count; i++)
+        if (allowed_uids[i] == cred.uid)
+            return 1;
+
+    syslog(LOG_NOTICE, "Query from uid %d pid %d refused", (int) cred.uid, (int) cred.pid);
+    return 0;
+}
+
+static void accept_callback(event_source_t *source, uint32_t events) {
+    while (true) {
+        int fd = accept4(source->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        if (conns_count >= QUERY_MAX_CONNECTIONS || !peer_allowed(fd)) {
+            close(fd);
+            continue;
+        }
+
+        query_conn_t *conn = free_conns;
+        if (conn)
+            free_conns = conn->next;
+        else if ((conn = (query_conn_t *) malloc(sizeof(query_conn_t))) == NULL) {
+            close(fd);
+            continue;
+        }
+
+        conn->source.fd = fd;
+        conn->source.callback = conn_callback;
+        conn->source.data = conn;
+        conn->next = NULL;
+        conn->in_len = conn->out_pos = conn->out_len = 0;
+        conn->closing = 0;
+        conn->peer_closed = 0;
+
+        if (event_loop_add(&conn->source, EPOLLIN) < 0) {
+            close(fd);
+            conn->next = free_conns;
+            free_conns = conn;
+            continue;
+        }
+        conns_count++;
+    }
+}
+
+static int parse_allowed_uids(const char *list) {
+    char *copy, *saveptr = NULL;
+
+    if (list == NULL)
+        return 0;
+
+    allowed_count = 0;
+    copy = strdup(list);
+    for (char *uid = strtok_r(copy, ",", &saveptr); uid; uid = strtok_r(NULL, ",", &saveptr)) {
+        char *end;
+        long value = strtol(uid, &end, 10);
+        if (*end != '\0' || value < 0 || allowed_count == QUERY_MAX_ALLOWED) {
+            syslog(LOG_ERR, "Invalid uid list %s", list);
+            free(copy);
+            return -1;
+        }
+        allowed_uids[allowed_count++] = (uid_t) value;
+    }
+    free(copy);
+    return 0;
+}
+
+int querysock_init(const char *path, const char *allow_uids, schedule_t *sched) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        syslog(LOG_ERR, "Query socket path too long: %s", path);
+        return -1;
+    }
+    if (parse_allowed_uids(allow_uids) < 0)
+        return -1;
+    schedule = sched;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* A socket unit may already listen on it and have queued clients */
+    fd = systemd_listen_fd((struct sockaddr *) &addr);
+    if (fd < 0) {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return -1;
+
+        unlink(path);
+        if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+            syslog(LOG_ERR, "Unable to listen on %s: %s", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        /* Access is checked with SO_PEERCRED on every connection */
+        chmod(path, 0666);
+    }
+
+    listener.fd = fd;
+    listener.callback = accept_callback;
+    listener.data = NULL;
+    if (event_loop_add(&listener, EPOLLIN) < 0 || event_loop_add_hook(recycle_conns) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    syslog(LOG_INFO, "Answering queries on %s", path);
+    return 0;
+}
@@ -0,0 +1,29 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUERYSOCK_H
+#define QUERYSOCK_H
+
+#include "schedule.h"
+
+/*
+ * Unix domain socket answering local clients from the daemon's schedule,
+ * see ptimes_query.h for the protocol. allow_uids is a comma separated
+ * list of uids that may connect besides root and the daemon's own user,
+ * NULL lets anyone connect.
+ */
+int querysock_init(const char *path, const char *allow_uids, schedule_t *schedule);
+
+#endif /* QUERYSOCK_H */
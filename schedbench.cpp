@@ -0,0 +1,91 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Throughput of PrayerScheduler: N subscribers spread over the globe,
+    driven through H hours of simulated time in steps of S seconds, as a
+    notification backend would call it from one thread:
+
+    g++ -std=c++11 -O2 -o schedbench schedbench.cpp -pthread
+    ./schedbench [SUBSCRIBERS [HOURS [STEP]]]      # default 1000000 48 1
+
+    Setup (the first day of every subscriber) is timed apart from the
+    steady state, which includes the precomputed following days.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "prayerscheduler.hpp"
+
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv) {
+    long subscribers = argc > 1 ? atol(argv[1]) : 1000000;
+    long hours = argc > 2 ? atol(argv[2]) : 48;
+    long step = argc > 3 ? atol(argv[3]) : 1;
+    time_t begin = time(NULL), end = begin + hours * 3600;
+    std::vector<PrayerScheduler::Event> events;
+    struct timespec start;
+    size_t fired = 0, precomputed = 0, batches = 0;
+    double setup, run;
+
+    if (subscribers < 1 || hours < 1 || step < 1) {
+        fprintf(stderr, "usage: %s [SUBSCRIBERS [HOURS [STEP]]]\n", argv[0]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    PrayerScheduler scheduler(begin);
+    uint32_t profiles[] = {
+        scheduler.add_profile(PrayerTimes(PrayerTimes::MWL)),
+        scheduler.add_profile(PrayerTimes(PrayerTimes::ISNA)),
+        scheduler.add_profile(PrayerTimes(PrayerTimes::Makkah, PrayerTimes::Hanafi)),
+    };
+    for (long i = 0; i < subscribers; i++) {
+        /* a deterministic spread between the polar circles, zone from the longitude */
+        double latitude = -60 + 120.0 * ((i * 7919) % 100003) / 100003;
+        double longitude = -180 + 360.0 * ((i * 104729) % 100019) / 100019;
+        double timezone = (long) (longitude / 15 + (longitude < 0 ? -0.5 : 0.5));
+        scheduler.add_subscriber(profiles[i % 3], latitude, longitude, timezone);
+    }
+    setup = elapsed(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (time_t now = begin; now < end; now += step) {
+        precomputed += scheduler.precompute(now, (size_t) -1);
+        events.clear();
+        fired += scheduler.pop_due(now, events);
+        batches++;
+    }
+    run = elapsed(&start);
+
+    printf("subscribers       %ld\n", subscribers);
+    printf("setup             %.3f s\n", setup);
+    printf("simulated         %ld h in %zu batches\n", hours, batches);
+    printf("events            %zu\n", fired);
+    printf("precomputed days  %zu\n", precomputed);
+    printf("run               %.3f s\n", run);
+    printf("throughput        %.0f events/s, %.1f million events/min\n",
+        fired / run, fired / run * 60 / 1e6);
+    return 0;
+}
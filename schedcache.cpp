@@ -0,0 +1,189 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "schedcache.h"
+
+#define ZONEINFO_DIR "/usr/share/zoneinfo/"
+
+static const char *cache_path = NULL;
+static void *mapping = NULL;
+static size_t mapping_size = 0;
+
+uint64_t schedcache_hash(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = (const unsigned char *) data;
+
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
+
+/* Fingerprint of the rules mktime/localtime use: TZ and the zone file */
+static uint64_t tz_hash(void) {
+    const char *tz = getenv("TZ");
+    char path[PATH_MAX], buf[4096];
+    uint64_t hash = SCHEDCACHE_HASH_INIT;
+    ssize_t len;
+    int fd;
+
+    if (tz != NULL) {
+        hash = schedcache_hash(hash, tz, strlen(tz) + 1);
+        if (*tz == ':')
+            tz++;
+        snprintf(path, sizeof(path), "%s%s", *tz == '/' ? "" : ZONEINFO_DIR, tz);
+    } else {
+        snprintf(path, sizeof(path), "/etc/localtime");
+    }
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return hash;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+        hash = schedcache_hash(hash, buf, len);
+    close(fd);
+    return hash;
+}
+
+static void unmap(schedule_t *schedule) {
+    if (mapping != NULL)
+        munmap(mapping, mapping_size);
+    mapping = NULL;
+    mapping_size = 0;
+    schedule_attach_cache(schedule, NULL, 0, 0);
+}
+
+/* Check a mapped file, returns its records or NULL */
+static const schedule_day_t *validate(const void *data, size_t size, uint64_t config_hash) {
+    const schedcache_header_t *header = (const schedcache_header_t *) data;
+    const schedule_day_t *days = (const schedule_day_t *) (header + 1);
+
+    if (size < sizeof(*header)
+            || header->magic != SCHEDCACHE_MAGIC
+            || header->version != SCHEDCACHE_VERSION
+            || header->record_size != sizeof(schedule_day_t)
+            || header->days > SCHEDCACHE_DAYS
+            || size < sizeof(*header) + header->days * sizeof(schedule_day_t))
+        return NULL;
+
+    if (header->config_hash != config_hash || header->tz_hash != tz_hash())
+        return NULL;
+
+    if (header->checksum != schedcache_hash(SCHEDCACHE_HASH_INIT, days,
+            header->days * sizeof(schedule_day_t)))
+        return NULL;
+
+    return days;
+}
+
+int schedcache_open(const char *path, uint64_t config_hash, schedule_t *schedule) {
+    struct stat st;
+    const schedule_day_t *days;
+    void *data;
+    int fd;
+
+    cache_path = path;
+    unmap(schedule);
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return 0;
+
+    days = validate(data, st.st_size, config_hash);
+    if (days == NULL) {
+        syslog(LOG_INFO, "Schedule cache %s is stale", path);
+        munmap(data, st.st_size);
+        return 0;
+    }
+
+    mapping = data;
+    mapping_size = st.st_size;
+    schedule_attach_cache(schedule, days, ((const schedcache_header_t *) data)->first_day,
+        ((const schedcache_header_t *) data)->days);
+    return 1;
+}
+
+static int store(schedule_t *schedule, uint64_t config_hash, long first) {
+    schedcache_header_t header;
+    schedule_day_t days[SCHEDCACHE_DAYS];
+    char tmp[PATH_MAX];
+    int fd, ok;
+
+    /* Compute before detaching, so today and tomorrow still come from the old file */
+    for (int i = 0; i < SCHEDCACHE_DAYS; i++)
+        schedule_fetch_day(schedule, first + i, &days[i]);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = SCHEDCACHE_MAGIC;
+    header.version = SCHEDCACHE_VERSION;
+    header.config_hash = config_hash;
+    header.tz_hash = tz_hash();
+    header.first_day = first;
+    header.days = SCHEDCACHE_DAYS;
+    header.record_size = sizeof(schedule_day_t);
+    header.checksum = schedcache_hash(SCHEDCACHE_HASH_INIT, days, sizeof(days));
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", cache_path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        syslog(LOG_WARNING, "Unable to write %s: %s", tmp, strerror(errno));
+        return -1;
+    }
+    ok = write(fd, &header, sizeof(header)) == (ssize_t) sizeof(header)
+        && write(fd, days, sizeof(days)) == (ssize_t) sizeof(days);
+    if (close(fd) != 0 || !ok || rename(tmp, cache_path) != 0) {
+        syslog(LOG_WARNING, "Unable to write %s: %s", cache_path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+void schedcache_maintain(schedule_t *schedule, uint64_t config_hash, time_t now) {
+    long today = schedule_local_day(now);
+
+    if (cache_path == NULL)
+        return;
+
+    /* The zone may have changed under the mapping too, e.g. with a tzdata update */
+    if (schedule->cache != NULL && mapping != NULL
+            && ((const schedcache_header_t *) mapping)->config_hash == config_hash
+            && ((const schedcache_header_t *) mapping)->tz_hash == tz_hash()
+            && schedule->cache_first + schedule->cache_days - today > SCHEDCACHE_DAYS / 2)
+        return;
+
+    if (store(schedule, config_hash, today) < 0)
+        return;
+
+    if (schedcache_open(cache_path, config_hash, schedule))
+        syslog(LOG_INFO, "Schedule cache %s written", cache_path);
+}
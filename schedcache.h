@@ -0,0 +1,65 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCHEDCACHE_H
+#define SCHEDCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "schedule.h"
+
+/*
+ * Persistent schedule cache (--cache-file). Holds the next SCHEDCACHE_DAYS
+ * days of the configured location so that a restarted daemon can arm its
+ * timers straight from a mapped file. The file is only used when it was
+ * written for the same configuration hash and time zone data; records are
+ * checksummed and the file is replaced atomically.
+ */
+
+#define SCHEDCACHE_MAGIC 0x43535450     /* "PTSC" */
+#define SCHEDCACHE_VERSION 1
+#define SCHEDCACHE_DAYS 62
+#define SCHEDCACHE_HASH_INIT 14695981039346656037ull
+
+typedef struct _schedcache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t config_hash;
+    uint64_t tz_hash;
+    int64_t first_day;
+    uint32_t days;
+    uint32_t record_size;       /* sizeof(schedule_day_t) */
+    uint64_t checksum;          /* of the records following the header */
+} schedcache_header_t;
+
+/* 64 bit FNV-1a, chain calls starting from SCHEDCACHE_HASH_INIT */
+uint64_t schedcache_hash(uint64_t hash, const void *data, size_t len);
+
+/*
+ * Map path and attach it to schedule when it matches config_hash and the
+ * current time zone data. Returns 1 when attached, 0 when the file has to
+ * be rewritten.
+ */
+int schedcache_open(const char *path, uint64_t config_hash, schedule_t *schedule);
+
+/*
+ * Rewrite the file from today on when the schedule has no valid cache
+ * attached or less than half of it is left, then attach the new file.
+ */
+void schedcache_maintain(schedule_t *schedule, uint64_t config_hash, time_t now);
+
+#endif /* SCHEDCACHE_H */
@@ -0,0 +1,177 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+#include "probes.h"
+#include "schedule.h"
+
+const char* TimeName[] =
+{
+	"Fajr",
+	"Sunrise",
+	"Dhuhr",
+	"Asr",
+	"Sunset",
+	"Maghrib",
+	"Isha",
+};
+
+const char* TimeKey[] =
+{
+    "fajr",
+    "sunrise",
+    "dhuhr",
+    "asr",
+    "sunset",
+    "maghrib",
+    "isha",
+};
+
+int schedule_is_prayer(int time_id) {
+    return time_id != PrayerTimes::Sunrise && time_id != PrayerTimes::Sunset;
+}
+
+long schedule_local_day(time_t t) {
+    struct tm *local = localtime(&t);
+    return PrayerTimes::days_from_civil(1900 + local->tm_year, local->tm_mon + 1,
+        local->tm_mday);
+}
+
+void schedule_init(schedule_t *schedule, const PrayerTimes *prayer_times,
+        double latitude, double longitude) {
+    schedule->prayer_times = *prayer_times;
+    schedule->latitude = latitude;
+    schedule->longitude = longitude;
+    for (int i = 0; i < SCHEDULE_DAYS; i++)
+        schedule->days[i].day = -1;
+    schedule->spare.day = -1;
+    schedule_attach_cache(schedule, NULL, 0, 0);
+}
+
+void schedule_attach_cache(schedule_t *schedule, const schedule_day_t *days, long first,
+        int count) {
+    schedule->cache = days;
+    schedule->cache_first = first;
+    schedule->cache_days = days ? count : 0;
+}
+
+/* Local noon of a day, days never have a time zone change at noon */
+static time_t local_noon(long day) {
+    struct tm noon;
+
+    memset(&noon, 0, sizeof(noon));
+    PrayerTimes::civil_from_days(day, noon.tm_year, noon.tm_mon, noon.tm_mday);
+    noon.tm_year -= 1900;
+    noon.tm_mon -= 1;
+    noon.tm_hour = 12;
+    noon.tm_isdst = -1;
+    return mktime(&noon);
+}
+
+double schedule_day_timezone(long day) {
+    return PrayerTimes::get_effective_timezone(local_noon(day));
+}
+
+void schedule_compute_day(schedule_t *schedule, long day, schedule_day_t *out) {
+    double times[PrayerTimes::TimesCount];
+    int64_t start = metrics_monotonic_ns();
+    time_t date = local_noon(day);
+
+    schedule->prayer_times.get_prayer_times(date, schedule->latitude, schedule->longitude,
+        PrayerTimes::get_effective_timezone(date), times);
+
+    out->day = day;
+    for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+        out->epoch[i] = PrayerTimes::float_time_to_epoch(times[i], date);
+        PrayerTimes::float_time_to_time24(times[i], out->time24[i]);
+    }
+
+    int64_t elapsed = metrics_monotonic_ns() - start;
+    metrics_record(METRIC_COMPUTE, elapsed);
+    PTIMES_PROBE(schedule_compute, day, elapsed);
+    metrics_count(METRIC_COMPUTES);
+}
+
+void schedule_fetch_day(schedule_t *schedule, long day, schedule_day_t *out) {
+    long i = day - schedule->cache_first;
+
+    if (i >= 0 && i < schedule->cache_days && schedule->cache[i].day == day) {
+        PrayerTimes::stats_count(PrayerTimes::StatCacheHits);
+        *out = schedule->cache[i];
+    } else {
+        PrayerTimes::stats_count(PrayerTimes::StatCacheMisses);
+        schedule_compute_day(schedule, day, out);
+    }
+}
+
+int schedule_update(schedule_t *schedule, time_t now) {
+    long today = schedule_local_day(now);
+
+    if (schedule->days[0].day == today)
+        return 0;
+
+    /* Yesterday's tomorrow is today, only compute what is missing */
+    for (int i = 0; i < SCHEDULE_DAYS; i++) {
+        long day = today + i;
+        int from = (int) (day - schedule->days[0].day);
+
+        if (schedule->days[0].day >= 0 && from > i && from < SCHEDULE_DAYS &&
+                schedule->days[from].day == day)
+            schedule->days[i] = schedule->days[from];
+        else if (schedule->spare.day == day)
+            schedule->days[i] = schedule->spare;
+        else
+            schedule_fetch_day(schedule, day, &schedule->days[i]);
+    }
+
+    return 1;
+}
+
+int schedule_precompute(schedule_t *schedule, time_t now) {
+    long day = schedule_local_day(now) + SCHEDULE_DAYS;
+
+    if (schedule->spare.day == day)
+        return 0;
+
+    schedule_fetch_day(schedule, day, &schedule->spare);
+    return 1;
+}
+
+int schedule_next(schedule_t *schedule, time_t from, int *time_id, time_t *epoch,
+        const char **time24) {
+    int found = 0;
+
+    schedule_update(schedule, from);
+
+    /* Late times wrap past midnight, so take the earliest one, not the first ID */
+    for (int d = 0; d < SCHEDULE_DAYS; d++) {
+        schedule_day_t *day = &schedule->days[d];
+        for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+            if (!schedule_is_prayer(i) || day->epoch[i] < from)
+                continue;
+            if (!found || day->epoch[i] < *epoch) {
+                found = 1;
+                *time_id = i;
+                *epoch = day->epoch[i];
+                if (time24)
+                    *time24 = day->time24[i];
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,88 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <time.h>
+
+#include "prayertimes.hpp"
+
+#define SCHEDULE_DAYS 2     /* today and tomorrow */
+
+typedef struct _schedule_day {
+    long day;                                       /* local days since 1970-01-01 */
+    time_t epoch[PrayerTimes::TimesCount];          /* -1 when undefined */
+    char time24[PrayerTimes::TimesCount][6];
+} schedule_day_t;
+
+/*
+ * The daemon's in-memory schedule of the configured location, kept at
+ * today and tomorrow so that alerts and local queries never recompute.
+ */
+typedef struct _schedule {
+    PrayerTimes prayer_times;
+    double latitude;
+    double longitude;
+    schedule_day_t days[SCHEDULE_DAYS];
+    schedule_day_t spare;               /* the day after days[], precomputed */
+    const schedule_day_t *cache;        /* precomputed days, e.g. from schedcache */
+    long cache_first;
+    int cache_days;
+} schedule_t;
+
+extern const char* TimeName[];
+extern const char* TimeKey[];       /* lower case names for JSON and CSV */
+
+/* Returns 1 for the prayers the daemon alerts for (not Sunrise/Sunset) */
+int schedule_is_prayer(int time_id);
+
+/* Local day number of an instant */
+long schedule_local_day(time_t t);
+
+/* UTC offset in hours of the host's time zone at local noon of a day */
+double schedule_day_timezone(long day);
+
+void schedule_init(schedule_t *schedule, const PrayerTimes *prayer_times,
+    double latitude, double longitude);
+
+/* Compute any single local day, independent of the cached days */
+void schedule_compute_day(schedule_t *schedule, long day, schedule_day_t *out);
+
+/* Take days from a precomputed table instead of computing them */
+void schedule_attach_cache(schedule_t *schedule, const schedule_day_t *days, long first,
+    int count);
+
+/* Like schedule_compute_day, but from the attached cache when possible */
+void schedule_fetch_day(schedule_t *schedule, long day, schedule_day_t *out);
+
+/* Make days[0] the local day of now, returns 1 when anything was recomputed */
+int schedule_update(schedule_t *schedule, time_t now);
+
+/*
+ * Compute the day that follows days[] ahead of time, off the alert path,
+ * so that the rollover at midnight only moves days; returns 1 when it
+ * computed anything.
+ */
+int schedule_precompute(schedule_t *schedule, time_t now);
+
+/*
+ * Find the first prayer at or after from within today and tomorrow,
+ * returns 0 when there is none.
+ */
+int schedule_next(schedule_t *schedule, time_t from, int *time_id, time_t *epoch,
+    const char **time24);
+
+#endif /* SCHEDULE_H */
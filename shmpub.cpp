@@ -0,0 +1,91 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ptimes_shm.h"
+#include "shmpub.h"
+
+static_assert(PTIMES_SHM_DAYS == SCHEDULE_DAYS, "shared memory layout out of sync");
+static_assert(PTIMES_SHM_TIMES == PrayerTimes::TimesCount, "shared memory layout out of sync");
+
+static struct ptimes_shm *shm = NULL;
+
+int shmpub_init(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd < 0 || ftruncate(fd, sizeof(struct ptimes_shm)) < 0) {
+        syslog(LOG_ERR, "Unable to create %s: %s", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    shm = (struct ptimes_shm *) mmap(NULL, sizeof(struct ptimes_shm),
+        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        shm = NULL;
+        return -1;
+    }
+
+    /* Readers check magic and version before trusting anything else */
+    memset(shm, 0, sizeof(*shm));
+    shm->version = PTIMES_SHM_VERSION;
+    __atomic_store_n(&shm->magic, PTIMES_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    syslog(LOG_INFO, "Publishing schedule in %s", path);
+    return 0;
+}
+
+static void fill_event(struct ptimes_shm_event *event, const schedule_day_t *day, int i) {
+    memset(event, 0, sizeof(*event));
+    event->epoch = day->epoch[i];
+    event->time_id = i;
+    event->is_prayer = schedule_is_prayer(i);
+    strncpy(event->name, TimeName[i], sizeof(event->name) - 1);
+    memcpy(event->time24, day->time24[i], sizeof(event->time24));
+}
+
+void shmpub_publish(const schedule_t *schedule, int next_id, time_t next_epoch) {
+    struct ptimes_shm_data data;
+    uint32_t seq;
+
+    if (shm == NULL)
+        return;
+
+    /* Build the new contents first to keep the write side short */
+    memset(&data, 0, sizeof(data));
+    data.updated = time(NULL);
+    for (int d = 0; d < PTIMES_SHM_DAYS; d++)
+        for (int i = 0; i < PTIMES_SHM_TIMES; i++)
+            fill_event(&data.days[d][i], &schedule->days[d], i);
+
+    data.next.epoch = -1;
+    for (int d = 0; d < PTIMES_SHM_DAYS && next_epoch >= 0; d++)
+        if (schedule->days[d].epoch[next_id] == next_epoch)
+            fill_event(&data.next, &schedule->days[d], next_id);
+
+    seq = shm->seq;
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&shm->data, &data, sizeof(data));
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,27 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHMPUB_H
+#define SHMPUB_H
+
+#include "schedule.h"
+
+/* Create the shared memory segment read by ptimes_shm.h clients */
+int shmpub_init(const char *path);
+
+/* Publish the schedule and the next prayer, a no-op without shmpub_init() */
+void shmpub_publish(const schedule_t *schedule, int next_id, time_t next_epoch);
+
+#endif /* SHMPUB_H */
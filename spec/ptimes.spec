@@ -6,6 +6,7 @@ Group: Shells
 Summary: Muslim prayer times alert program.
 Url: https://github.com/ilnli/Prayer-Times
 Source0: %{name}-%{version}.tar.gz
+BuildRequires: systemtap-sdt-devel
 Requires: alsa-utils
 %global debug_package %{nil}
 
@@ -17,29 +18,52 @@ and sounds Azan when it's time for it.
 %setup -q
 
 %build
-g++ -o ptimes ptimes.cpp prayertimes.hpp cmdline.c
+g++ -o ptimes ptimes.cpp actions.cpp announce.cpp arrowipc.cpp audio.cpp batch.cpp citydb.cpp eventloop.cpp httpd.cpp metrics.cpp querysock.cpp schedcache.cpp schedule.cpp shmpub.cpp supervise.cpp systemd.cpp timetable.cpp tzmap.cpp vclock.cpp prayertimes.hpp cmdline.c -pthread -ldl
+g++ -O2 -shared -fPIC -fvisibility=hidden -Wl,-soname,libprayertimes.so.1 -o libprayertimes.so.1 prayertimes_c.cpp -pthread
 
 %install
 mkdir -p $RPM_BUILD_ROOT/usr/bin/
 mkdir -p $RPM_BUILD_ROOT/etc/systemd/system/
 mkdir -p $RPM_BUILD_ROOT/etc/sysconfig/
 mkdir -p $RPM_BUILD_ROOT/usr/share/sounds/ptimes/
+mkdir -p $RPM_BUILD_ROOT/usr/include/
+mkdir -p $RPM_BUILD_ROOT%{_libdir}/
 
 install -m 755 ptimes $RPM_BUILD_ROOT/usr/bin/
 install -m 755 systemd/system/ptimes.service $RPM_BUILD_ROOT/etc/systemd/system/
+install -m 644 systemd/system/ptimes.socket $RPM_BUILD_ROOT/etc/systemd/system/
 install -m 644 sysconfig/ptimes $RPM_BUILD_ROOT/etc/sysconfig/
 install -m 644 audio/azan.wav $RPM_BUILD_ROOT/usr/share/sounds/ptimes/
+install -m 644 ptimes_announce.h $RPM_BUILD_ROOT/usr/include/
+install -m 644 ptimes_batch.h $RPM_BUILD_ROOT/usr/include/
+install -m 644 ptimes_query.h $RPM_BUILD_ROOT/usr/include/
+install -m 644 ptimes_shm.h $RPM_BUILD_ROOT/usr/include/
+install -m 644 prayertimes_c.h $RPM_BUILD_ROOT/usr/include/
+install -m 755 libprayertimes.so.1 $RPM_BUILD_ROOT%{_libdir}/
+ln -s libprayertimes.so.1 $RPM_BUILD_ROOT%{_libdir}/libprayertimes.so
 
 %post
 systemctl daemon-reload
-systemctl enable ptimes.service
+systemctl enable ptimes.service ptimes.socket
+/sbin/ldconfig
+
+%postun
+/sbin/ldconfig
 
 %files
 %doc README
 %{_bindir}/%{name}
 /etc/systemd/system/ptimes.service
+/etc/systemd/system/ptimes.socket
 /etc/sysconfig/ptimes
 /usr/share/sounds/ptimes/azan.wav
+/usr/include/ptimes_announce.h
+/usr/include/ptimes_batch.h
+/usr/include/ptimes_query.h
+/usr/include/ptimes_shm.h
+/usr/include/prayertimes_c.h
+%{_libdir}/libprayertimes.so.1
+%{_libdir}/libprayertimes.so
 
 %changelog
 * Sun Sep 8 2024 ilnli 1.2%{dist}
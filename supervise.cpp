@@ -0,0 +1,228 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+#include "eventloop.h"
+#include "metrics.h"
+#include "probes.h"
+#include "supervise.h"
+
+extern char **environ;
+
+typedef struct _action {
+    pid_t pid;                  /* 0 when the slot is free */
+    char tag[16];
+    int stopping;               /* signal we sent to end it, 0 if none */
+    int timeout;                /* seconds, 0 for no limit */
+    int64_t started_ns;
+    event_source_t exited;      /* pidfd, readable once the process ended */
+    event_source_t timer;       /* timerfd of the time limit */
+} action_t;
+
+static action_t actions[SUPERVISE_SLOTS];
+static int max_actions = 1;
+static int timeout_seconds = 0;
+
+/* glibc only wraps these from 2.36 on */
+static int pidfd_open(pid_t pid) {
+    return (int) syscall(SYS_pidfd_open, pid, 0);
+}
+
+static int pidfd_send_signal(int pidfd, int sig) {
+    return (int) syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+}
+
+static void release(action_t *action) {
+    event_loop_remove(&action->exited);
+    close(action->exited.fd);
+    if (action->timer.fd >= 0) {
+        event_loop_remove(&action->timer);
+        close(action->timer.fd);
+    }
+    action->pid = 0;
+}
+
+static void stop(action_t *action, int sig) {
+    if (pidfd_send_signal(action->exited.fd, sig) < 0 && errno != ESRCH)
+        syslog(LOG_ERR, "Unable to stop %s (pid %d): %s", action->tag, (int) action->pid,
+            strerror(errno));
+    action->stopping = sig;
+}
+
+/* ---------------------- Event Callbacks ----------------------- */
+
+static void exited_callback(event_source_t *source, uint32_t events) {
+    action_t *action = (action_t *) source->data;
+    siginfo_t info;
+
+    memset(&info, 0, sizeof(info));
+    /* A slot reused within the same batch has nothing to reap yet */
+    if (action->pid == 0 || waitid((idtype_t) P_PIDFD, source->fd, &info, WEXITED | WNOHANG) < 0
+            || info.si_pid == 0)
+        return;
+
+    PTIMES_PROBE(action_exit, (int) action->pid,
+        info.si_code == CLD_EXITED ? info.si_status : -info.si_status,
+        metrics_monotonic_ns() - action->started_ns);
+
+    if (action->stopping) {
+        syslog(LOG_DEBUG, "%s (pid %d) stopped", action->tag, (int) action->pid);
+    } else if (info.si_code == CLD_EXITED && info.si_status != 0) {
+        syslog(LOG_WARNING, "%s (pid %d) failed with status %d", action->tag,
+            (int) action->pid, info.si_status);
+        metrics_count(METRIC_ACTION_FAILURES);
+    } else if (info.si_code != CLD_EXITED) {
+        syslog(LOG_WARNING, "%s (pid %d) killed by signal %d", action->tag,
+            (int) action->pid, info.si_status);
+        metrics_count(METRIC_ACTION_FAILURES);
+    } else {
+        syslog(LOG_DEBUG, "%s (pid %d) done after %.1f s", action->tag, (int) action->pid,
+            (metrics_monotonic_ns() - action->started_ns) / 1e9);
+    }
+    release(action);
+}
+
+static void timer_callback(event_source_t *source, uint32_t events) {
+    action_t *action = (action_t *) source->data;
+    uint64_t expirations;
+
+    if (action->pid == 0 || read(source->fd, &expirations, sizeof(expirations)) <= 0)
+        return;
+
+    syslog(LOG_WARNING, "%s (pid %d) still running after %d seconds, killing it",
+        action->tag, (int) action->pid, action->timeout);
+    metrics_count(METRIC_ACTION_TIMEOUTS);
+    stop(action, SIGKILL);
+}
+
+/* ---------------------- Interface ----------------------- */
+
+int supervise_init(int max_running, int timeout) {
+    if (max_running < 1 || max_running > SUPERVISE_SLOTS) {
+        syslog(LOG_ERR, "Concurrent actions must be between 1 and %d", SUPERVISE_SLOTS);
+        return -1;
+    }
+    max_actions = max_running;
+    timeout_seconds = timeout > 0 ? timeout : 0;
+    return 0;
+}
+
+int supervise_running(void) {
+    int running = 0;
+
+    for (int i = 0; i < SUPERVISE_SLOTS; i++)
+        if (actions[i].pid != 0 && !actions[i].stopping)
+            running++;
+    return running;
+}
+
+void supervise_cancel(const char *tag) {
+    for (int i = 0; i < SUPERVISE_SLOTS; i++) {
+        action_t *action = &actions[i];
+        if (action->pid == 0 || action->stopping || strcmp(action->tag, tag) != 0)
+            continue;
+        syslog(LOG_INFO, "Stopping the previous %s (pid %d)", action->tag, (int) action->pid);
+        metrics_count(METRIC_ACTION_CANCELS);
+        stop(action, SIGTERM);
+    }
+}
+
+pid_t supervise_spawn(const char *tag, const char *path, char *const argv[], int timeout) {
+    action_t *action = NULL;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    pid_t pid;
+    int rc;
+
+    supervise_cancel(tag);
+
+    for (int i = 0; i < SUPERVISE_SLOTS && action == NULL; i++)
+        if (actions[i].pid == 0)
+            action = &actions[i];
+    if (action == NULL || supervise_running() >= max_actions) {
+        syslog(LOG_WARNING, "Too many actions running, not starting %s", tag);
+        metrics_count(METRIC_ACTION_REFUSALS);
+        return -1;
+    }
+
+    /* The child gets no blocked signals and default handlers; glibc spawns
+       with CLONE_VFORK, so posix_spawn returns once the exec happened */
+    posix_spawnattr_init(&attr);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigfillset(&mask);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    int64_t start = metrics_monotonic_ns();
+    rc = posix_spawn(&pid, path, NULL, &attr, argv, environ);
+    int64_t spawned = metrics_monotonic_ns();
+    posix_spawnattr_destroy(&attr);
+    if (rc != 0) {
+        syslog(LOG_ERR, "Unable to start %s: %s", path, strerror(rc));
+        metrics_count(METRIC_ACTION_FAILURES);
+        return -1;
+    }
+    metrics_record(METRIC_SPAWN_DELAY, spawned - start);
+
+    memset(action, 0, sizeof(*action));
+    strncpy(action->tag, tag, sizeof(action->tag) - 1);
+    action->started_ns = spawned;
+    action->timeout = timeout > 0 ? timeout : timeout_seconds;
+    action->exited.fd = pidfd_open(pid);
+    action->exited.callback = exited_callback;
+    action->exited.data = action;
+    action->timer.fd = -1;
+    action->timer.callback = timer_callback;
+    action->timer.data = action;
+    if (action->exited.fd < 0 || event_loop_add(&action->exited, EPOLLIN) < 0) {
+        /* Nothing would reap it, so it must not outlive the daemon's attention */
+        syslog(LOG_ERR, "Unable to watch %s (pid %d): %s", tag, (int) pid, strerror(errno));
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        if (action->exited.fd >= 0)
+            close(action->exited.fd);
+        return -1;
+    }
+    action->pid = pid;
+
+    if (action->timeout > 0) {
+        struct itimerspec its;
+
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = action->timeout;
+        action->timer.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (action->timer.fd < 0 || timerfd_settime(action->timer.fd, 0, &its, NULL) < 0
+                || event_loop_add(&action->timer, EPOLLIN) < 0) {
+            syslog(LOG_ERR, "Unable to limit the time of %s: %s", tag, strerror(errno));
+            if (action->timer.fd >= 0)
+                close(action->timer.fd);
+            action->timer.fd = -1;
+        }
+    }
+
+    syslog(LOG_INFO, "Started %s (pid %d) in %ld us", tag, (int) pid,
+        (long) ((spawned - start) / 1000));
+    return pid;
+}
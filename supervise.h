@@ -0,0 +1,48 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SUPERVISE_H
+#define SUPERVISE_H
+
+#include <sys/types.h>
+
+/*
+ * Supervisor of the external alert actions, e.g. the aplay azan player.
+ * Commands are started with posix_spawn, so the daemon's memory is never
+ * copied, and followed through pidfds in the event loop: their exit
+ * status is logged, a time limit and a limit on concurrent actions are
+ * enforced, and the time from spawn to exec goes into the metrics.
+ */
+
+#define SUPERVISE_SLOTS 16      /* most actions tracked at the same time */
+
+/* timeout in seconds per action, 0 for none; max_running actions at once */
+int supervise_init(int max_running, int timeout);
+
+/*
+ * Start path with argv. A running action with the same tag is stopped
+ * first, e.g. an azan that would overlap the next one. timeout overrides
+ * the time limit of supervise_init when positive. Returns the pid, or -1
+ * when the command could not start or too many actions run.
+ */
+pid_t supervise_spawn(const char *tag, const char *path, char *const argv[], int timeout);
+
+/* Stop every running action with this tag */
+void supervise_cancel(const char *tag);
+
+/* Actions currently running and not being stopped */
+int supervise_running(void);
+
+#endif /* SUPERVISE_H */
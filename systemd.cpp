@@ -0,0 +1,171 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#include "eventloop.h"
+#include "systemd.h"
+
+#define LISTEN_FDS_START 3
+#define MAX_LISTEN_FDS 16
+
+static event_source_t watchdog_timer;
+static int listen_fds[MAX_LISTEN_FDS];
+static int listen_count = -1;       /* -1: environment not read yet */
+
+/* Variables meant for this process only, LISTEN_PID/WATCHDOG_PID say who */
+static int for_this_process(const char *pid_variable) {
+    const char *pid = getenv(pid_variable);
+    return pid == NULL || atol(pid) == (long) getpid();
+}
+
+int systemd_notify_enabled(void) {
+    const char *path = getenv("NOTIFY_SOCKET");
+    return path != NULL && (path[0] == '/' || path[0] == '@');
+}
+
+int systemd_notify(const char *state) {
+    const char *path = getenv("NOTIFY_SOCKET");
+    struct sockaddr_un addr;
+    socklen_t len;
+    int fd, rc;
+
+    if (!systemd_notify_enabled())
+        return 0;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    len = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+    /* '@' stands for the abstract namespace */
+    if (addr.sun_path[0] == '@')
+        addr.sun_path[0] = '\0';
+    else
+        len++;
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    rc = sendto(fd, state, strlen(state), MSG_NOSIGNAL, (struct sockaddr *) &addr, len);
+    close(fd);
+    return rc < 0 ? -1 : 0;
+}
+
+static void watchdog_callback(event_source_t *source, uint32_t events) {
+    uint64_t expirations;
+
+    if (read(source->fd, &expirations, sizeof(expirations)) > 0)
+        systemd_notify("WATCHDOG=1");
+}
+
+int systemd_watchdog_init(void) {
+    const char *usec = getenv("WATCHDOG_USEC");
+    struct itimerspec its;
+    long long interval;
+
+    if (usec == NULL || !for_this_process("WATCHDOG_PID"))
+        return 0;
+    interval = atoll(usec) / 2;     /* ping twice per period */
+    if (interval <= 0)
+        return 0;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = interval / 1000000;
+    its.it_value.tv_nsec = (interval % 1000000) * 1000;
+    its.it_interval = its.it_value;
+
+    watchdog_timer.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    watchdog_timer.callback = watchdog_callback;
+    watchdog_timer.data = NULL;
+    if (watchdog_timer.fd < 0 || timerfd_settime(watchdog_timer.fd, 0, &its, NULL) < 0
+            || event_loop_add(&watchdog_timer, EPOLLIN) < 0) {
+        syslog(LOG_ERR, "Unable to create watchdog timer: %s", strerror(errno));
+        return -1;
+    }
+
+    syslog(LOG_INFO, "Pinging the systemd watchdog every %lld ms", interval / 1000);
+    return 0;
+}
+
+static void read_listen_fds(void) {
+    const char *fds = getenv("LISTEN_FDS");
+    int count;
+
+    listen_count = 0;
+    if (fds == NULL || getenv("LISTEN_PID") == NULL || !for_this_process("LISTEN_PID"))
+        return;
+
+    count = atoi(fds);
+    for (int i = 0; i < count && listen_count < MAX_LISTEN_FDS; i++) {
+        int fd = LISTEN_FDS_START + i;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        listen_fds[listen_count++] = fd;
+    }
+
+    /* Not for the azan player or any other child */
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+}
+
+static int same_address(const struct sockaddr *a, const struct sockaddr *b) {
+    if (a->sa_family != b->sa_family)
+        return 0;
+
+    if (a->sa_family == AF_UNIX)
+        return strcmp(((const struct sockaddr_un *) a)->sun_path,
+            ((const struct sockaddr_un *) b)->sun_path) == 0;
+
+    if (a->sa_family == AF_INET) {
+        const struct sockaddr_in *ia = (const struct sockaddr_in *) a;
+        const struct sockaddr_in *ib = (const struct sockaddr_in *) b;
+        return ia->sin_port == ib->sin_port && ia->sin_addr.s_addr == ib->sin_addr.s_addr;
+    }
+    return 0;
+}
+
+int systemd_listen_fd(const struct sockaddr *addr) {
+    if (listen_count < 0)
+        read_listen_fds();
+
+    for (int i = 0; i < listen_count; i++) {
+        struct sockaddr_storage bound;
+        socklen_t bound_len = sizeof(bound);
+        int fd = listen_fds[i];
+
+        memset(&bound, 0, sizeof(bound));
+        if (fd < 0 || getsockname(fd, (struct sockaddr *) &bound, &bound_len) < 0)
+            continue;
+        if (!same_address(addr, (struct sockaddr *) &bound))
+            continue;
+
+        listen_fds[i] = -1;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+    }
+    return -1;
+}
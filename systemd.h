@@ -0,0 +1,42 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SYSTEMD_H
+#define SYSTEMD_H
+
+#include <sys/socket.h>
+
+/*
+ * The parts of the systemd service protocol the daemon uses, implemented
+ * without libsystemd: readiness and watchdog notifications on
+ * $NOTIFY_SOCKET and listening sockets passed with $LISTEN_FDS.
+ */
+
+/* Returns 1 when started by systemd as a Type=notify service */
+int systemd_notify_enabled(void);
+
+/* Send a state string such as "READY=1", ignored outside of systemd */
+int systemd_notify(const char *state);
+
+/* Ping the watchdog from the event loop when WatchdogSec= is set */
+int systemd_watchdog_init(void);
+
+/*
+ * Take over a socket passed by a socket unit that listens on addr,
+ * returns the non-blocking descriptor or -1 when there is none.
+ */
+int systemd_listen_fd(const struct sockaddr *addr);
+
+#endif /* SYSTEMD_H */
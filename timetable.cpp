@@ -0,0 +1,284 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "arrowipc.h"
+#include "cmdline.h"
+#include "schedule.h"
+#include "timetable.h"
+
+#define CHUNK_SIZE 65536
+#define CHUNK_COUNT 16          /* written with a single writev */
+#define MAX_ROW 128             /* longest formatted day */
+#define BATCH_DAYS 256          /* days computed at once */
+#define TZ_PROBE_DAYS 7         /* assume at most one offset change per week */
+#define ARROW_ROWS 65536        /* days per record batch */
+
+typedef struct _out_buf {
+    int fd;
+    int chunk;
+    size_t len[CHUNK_COUNT];
+    char data[CHUNK_COUNT][CHUNK_SIZE];
+} out_buf_t;
+
+static out_buf_t out;
+
+/* ---------------------- Output Buffer ----------------------- */
+
+static int out_flush(void) {
+    struct iovec iov[CHUNK_COUNT];
+    int count = 0;
+
+    for (int i = 0; i <= out.chunk; i++) {
+        iov[count].iov_base = out.data[i];
+        iov[count].iov_len = out.len[i];
+        count += out.len[i] > 0;
+    }
+
+    struct iovec *p = iov;
+    while (count > 0) {
+        ssize_t n = writev(out.fd, p, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        /* Skip what was written, the last chunk may be partial */
+        while (count > 0 && (size_t) n >= p->iov_len) {
+            n -= p->iov_len;
+            p++;
+            count--;
+        }
+        if (count > 0) {
+            p->iov_base = (char *) p->iov_base + n;
+            p->iov_len -= n;
+        }
+    }
+
+    memset(out.len, 0, sizeof(out.len));
+    out.chunk = 0;
+    return 0;
+}
+
+/* Room for at least MAX_ROW bytes */
+static char *out_reserve(void) {
+    if (out.len[out.chunk] + MAX_ROW > CHUNK_SIZE) {
+        if (out.chunk + 1 == CHUNK_COUNT && out_flush() < 0)
+            return NULL;
+        if (out.len[out.chunk] > 0)
+            out.chunk++;
+    }
+    return out.data[out.chunk] + out.len[out.chunk];
+}
+
+static void out_commit(char *end) {
+    out.len[out.chunk] = end - out.data[out.chunk];
+}
+
+/* ---------------------- Formatting ----------------------- */
+
+static char *put_str(char *p, const char *s) {
+    while (*s)
+        *p++ = *s++;
+    return p;
+}
+
+static char *put_digits(char *p, int value, int width) {
+    for (int i = width - 1; i >= 0; i--, value /= 10)
+        p[i] = '0' + value % 10;
+    return p + width;
+}
+
+static char *put_date(char *p, long days) {
+    int year, month, day;
+
+    PrayerTimes::civil_from_days(days, year, month, day);
+    p = put_digits(p, year, 4);
+    *p++ = '-';
+    p = put_digits(p, month, 2);
+    *p++ = '-';
+    return put_digits(p, day, 2);
+}
+
+/* HH:MM, nothing for undefined times */
+static char *put_time(char *p, double time) {
+    char time24[6];
+
+    PrayerTimes::float_time_to_time24(time, time24);
+    memcpy(p, time24, 5);
+    return time24[0] ? p + 5 : p;
+}
+
+static char *format_day(char *p, int format, long day, const double *times, int first_row) {
+    if (format == TIMETABLE_JSON) {
+        /* Separators go first so that the last day needs no special case */
+        p = put_str(p, first_row ? "{\"date\":\"" : ",\n{\"date\":\"");
+        p = put_date(p, day);
+        *p++ = '"';
+        for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+            *p++ = ',';
+            *p++ = '"';
+            p = put_str(p, TimeKey[i]);
+            p = put_str(p, "\":\"");
+            p = put_time(p, times[i]);
+            *p++ = '"';
+        }
+        *p++ = '}';
+        return p;
+    } else {
+        char separator = format == TIMETABLE_TSV ? '\t' : ',';
+        p = put_date(p, day);
+        for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+            *p++ = separator;
+            p = put_time(p, times[i]);
+        }
+    }
+    *p++ = '\n';
+    return p;
+}
+
+/* ---------------------- Time Zone Offsets ----------------------- */
+
+/*
+ * Number of days from day on that share its UTC offset, at most limit.
+ * Probing once a week and bisecting at changes keeps localtime out of
+ * the per-day path.
+ */
+static long same_offset_days(long day, double timezone, long limit) {
+    long good = 0, step = TZ_PROBE_DAYS;
+
+    while (good + 1 < limit) {
+        long probe = good + step < limit ? good + step : limit - 1;
+        if (schedule_day_timezone(day + probe) == timezone) {
+            good = probe;
+            continue;
+        }
+        /* The change is in (good, probe], find its first day */
+        long bad = probe;
+        while (bad - good > 1) {
+            long middle = good + (bad - good) / 2;
+            if (schedule_day_timezone(day + middle) == timezone)
+                good = middle;
+            else
+                bad = middle;
+        }
+        return bad;
+    }
+    return limit;
+}
+
+/* Arrow output writes the computed days as record batches, no text at all */
+static int print_arrow(int fd, PrayerTimes *prayer_times, double latitude, double longitude,
+        long first, long days) {
+    static double times[BATCH_DAYS * PrayerTimes::TimesCount];
+    arrow_columns_t columns;
+    int method = prayer_times->get_calc_method();
+    int rc = -1;
+
+    if (arrow_columns_init(&columns, ARROW_ROWS) < 0)
+        return -1;
+    if (arrow_write_schema(fd) < 0)
+        goto out;
+
+    for (long day = first; day < first + days; ) {
+        double timezone = schedule_day_timezone(day);
+        long run = same_offset_days(day, timezone, first + days - day);
+
+        while (run > 0) {
+            int count = run < BATCH_DAYS ? run : BATCH_DAYS;
+            if (count > columns.capacity - columns.length)
+                count = columns.capacity - columns.length;
+
+            prayer_times->get_prayer_times_range(day, count, latitude, longitude, timezone, times);
+            for (int i = 0; i < count; i++)
+                arrow_columns_append(&columns, day + i, latitude, longitude, method,
+                    times + i * PrayerTimes::TimesCount);
+            if (columns.length == columns.capacity) {
+                if (arrow_write_batch(fd, &columns) < 0)
+                    goto out;
+                arrow_columns_clear(&columns);
+            }
+            day += count;
+            run -= count;
+        }
+    }
+
+    if (columns.length > 0 && arrow_write_batch(fd, &columns) < 0)
+        goto out;
+    rc = arrow_write_end(fd);
+out:
+    arrow_columns_free(&columns);
+    return rc;
+}
+
+int timetable_print(int fd, PrayerTimes *prayer_times, double latitude, double longitude,
+        long first, long days, int format) {
+    static double times[BATCH_DAYS * PrayerTimes::TimesCount];
+    char *p;
+
+    if (format == TIMETABLE_ARROW)
+        return print_arrow(fd, prayer_times, latitude, longitude, first, days);
+
+    out.fd = fd;
+    out.chunk = 0;
+    memset(out.len, 0, sizeof(out.len));
+
+    if ((p = out_reserve()) == NULL)
+        return -1;
+    if (format == TIMETABLE_JSON) {
+        p += snprintf(p, MAX_ROW, "{\"latitude\":%.6g,\"longitude\":%.6g,\"method\":\"%s\",\"times\":[\n",
+            latitude, longitude, cmdline_parser_calc_method_values[prayer_times->get_calc_method()]);
+    } else {
+        char separator = format == TIMETABLE_TSV ? '\t' : ',';
+        p = put_str(p, "date");
+        for (int i = 0; i < PrayerTimes::TimesCount; i++) {
+            *p++ = separator;
+            p = put_str(p, TimeKey[i]);
+        }
+        *p++ = '\n';
+    }
+    out_commit(p);
+
+    for (long day = first; day < first + days; ) {
+        double timezone = schedule_day_timezone(day);
+        long run = same_offset_days(day, timezone, first + days - day);
+
+        while (run > 0) {
+            int count = run < BATCH_DAYS ? run : BATCH_DAYS;
+
+            prayer_times->get_prayer_times_range(day, count, latitude, longitude, timezone, times);
+            for (int i = 0; i < count; i++) {
+                if ((p = out_reserve()) == NULL)
+                    return -1;
+                out_commit(format_day(p, format, day + i, times + i * PrayerTimes::TimesCount,
+                    day + i == first));
+            }
+            day += count;
+            run -= count;
+        }
+    }
+
+    if (format == TIMETABLE_JSON) {
+        if ((p = out_reserve()) == NULL)
+            return -1;
+        out_commit(put_str(p, "\n]}\n"));
+    }
+    return out_flush();
+}
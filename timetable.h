@@ -0,0 +1,36 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TIMETABLE_H
+#define TIMETABLE_H
+
+#include "prayertimes.hpp"
+
+/*
+ * Timetable output of --print: days consecutive days starting at first
+ * (days since 1970-01-01) in the host's time zone, written to fd.
+ */
+
+enum {
+    TIMETABLE_CSV,
+    TIMETABLE_JSON,
+    TIMETABLE_TSV,
+    TIMETABLE_ARROW,
+};
+
+int timetable_print(int fd, PrayerTimes *prayer_times, double latitude, double longitude,
+    long first, long days, int format);
+
+#endif /* TIMETABLE_H */
@@ -0,0 +1,533 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tzmap.h"
+
+#define NAUTICAL_ZONES 25
+#define SPLIT_EDGES 48          /* cells with more edges are subdivided */
+#define CENTER_NUDGE 1.234567e-7        /* keeps centers off axis-parallel borders */
+
+typedef struct _hit {
+    uint32_t cell;
+    uint32_t zone;
+    uint32_t edge;
+} hit_t;
+
+typedef struct _builder {
+    std::vector<tzmap_point_t> points;
+    std::vector<hit_t> hits;            /* edges by top level cell */
+    std::vector<hit_t> centers;         /* top level cell centers inside a polygon */
+    std::vector<tzmap_cell_t> cells;
+    std::vector<tzmap_entry_t> entries;
+    std::vector<uint32_t> edges;
+    std::vector<uint32_t> zones;
+    std::string strings;
+    std::map<std::string, uint32_t> zone_ids;
+} builder_t;
+
+/* ---------------------- Geometry ----------------------- */
+
+static int clamp(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+static void cell_center(int column, int row, int sub_column, int sub_row, double size,
+        double *x, double *y) {
+    *x = column - 180.0 + sub_column * size + size / 2 + CENTER_NUDGE;
+    *y = row - 90.0 + sub_row * size + size / 2 + CENTER_NUDGE;
+}
+
+static double orient(double ax, double ay, double bx, double by, double cx, double cy) {
+    return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+/* Does edge a-b cross the segment p-c? Endpoints count on one side only */
+static int crosses(double px, double py, double cx, double cy,
+        const tzmap_point_t *a, const tzmap_point_t *b) {
+    int sa = orient(px, py, cx, cy, a->longitude, a->latitude) > 0;
+    int sb = orient(px, py, cx, cy, b->longitude, b->latitude) > 0;
+
+    if (sa == sb)
+        return 0;
+    return (orient(a->longitude, a->latitude, b->longitude, b->latitude, px, py) > 0)
+        != (orient(a->longitude, a->latitude, b->longitude, b->latitude, cx, cy) > 0);
+}
+
+static int crossing_parity(const tzmap_point_t *points, const uint32_t *edges, uint32_t count,
+        double px, double py, double cx, double cy) {
+    int parity = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+        parity ^= crosses(px, py, cx, cy, &points[edges[i]], &points[edges[i] + 1]);
+    return parity;
+}
+
+/* ---------------------- Building ----------------------- */
+
+static uint32_t add_zone(builder_t *b, const std::string &name) {
+    std::map<std::string, uint32_t>::iterator it = b->zone_ids.find(name);
+
+    if (it != b->zone_ids.end())
+        return it->second;
+    uint32_t id = b->zones.size();
+    b->zones.push_back(b->strings.size());
+    b->strings.append(name.c_str(), name.size() + 1);
+    b->zone_ids[name] = id;
+    return id;
+}
+
+/* Edges of one polygon line go to the cells of their bounding boxes */
+static void add_edges(builder_t *b, uint32_t zone, const std::vector<uint32_t> &edges) {
+    std::vector<std::vector<double> > rows(TZMAP_ROWS);
+    int min_column = TZMAP_COLUMNS, max_column = -1, min_row = TZMAP_ROWS, max_row = -1;
+
+    for (size_t i = 0; i < edges.size(); i++) {
+        const tzmap_point_t *p = &b->points[edges[i]], *q = p + 1;
+        int c0 = clamp(floor(fmin(p->longitude, q->longitude) + 180), 0, TZMAP_COLUMNS - 1);
+        int c1 = clamp(floor(fmax(p->longitude, q->longitude) + 180), 0, TZMAP_COLUMNS - 1);
+        int r0 = clamp(floor(fmin(p->latitude, q->latitude) + 90), 0, TZMAP_ROWS - 1);
+        int r1 = clamp(floor(fmax(p->latitude, q->latitude) + 90), 0, TZMAP_ROWS - 1);
+
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++) {
+                hit_t hit = { (uint32_t) (r * TZMAP_COLUMNS + c), zone, edges[i] };
+                b->hits.push_back(hit);
+            }
+        min_column = std::min(min_column, c0);
+        max_column = std::max(max_column, c1);
+        min_row = std::min(min_row, r0);
+        max_row = std::max(max_row, r1);
+
+        /* Scanline crossings at the center latitudes of the rows spanned */
+        for (int r = r0; r <= r1; r++) {
+            double x, y;
+            cell_center(0, r, 0, 0, 1, &x, &y);
+            if ((p->latitude > y) != (q->latitude > y))
+                rows[r].push_back(p->longitude + (y - p->latitude)
+                    * (q->longitude - p->longitude) / (q->latitude - p->latitude));
+        }
+    }
+
+    for (int r = min_row; r <= max_row; r++) {
+        std::vector<double> &xs = rows[r];
+        size_t left = 0;
+
+        std::sort(xs.begin(), xs.end());
+        for (int c = min_column; c <= max_column; c++) {
+            double x, y;
+            cell_center(c, r, 0, 0, 1, &x, &y);
+            while (left < xs.size() && xs[left] < x)
+                left++;
+            if (left % 2) {
+                hit_t center = { (uint32_t) (r * TZMAP_COLUMNS + c), zone, 0 };
+                b->centers.push_back(center);
+            }
+        }
+    }
+}
+
+/*
+ * One CSV line: "POLYGON ((x y, ...), ...)" or "MULTIPOLYGON (...)" in
+ * quotes followed by the zone name. All rings of a line form one even-odd
+ * polygon, holes included.
+ */
+static int parse_line(builder_t *b, char *line) {
+    char *geometry = strstr(line, "POLYGON");
+    char *end = geometry ? strchr(geometry, '"') : NULL;
+    std::vector<uint32_t> edges;
+    size_t ring = b->points.size();
+
+    if (geometry == NULL || end == NULL || end[1] != ',')
+        return 0;
+    std::string name(end + 2, strcspn(end + 2, ",\r\n"));
+    name.erase(std::remove(name.begin(), name.end(), '"'), name.end());
+    if (name.empty())
+        return 0;
+    uint32_t zone = add_zone(b, name);
+
+    for (char *p = geometry; p < end; ) {
+        if (*p == ')') {
+            size_t count = b->points.size() - ring;
+            if (count > 0) {
+                /* Close the ring if the data did not */
+                const tzmap_point_t first = b->points[ring];
+                if (first.longitude != b->points.back().longitude
+                        || first.latitude != b->points.back().latitude)
+                    b->points.push_back(first);
+                for (size_t i = ring; i + 1 < b->points.size(); i++)
+                    edges.push_back(i);
+            }
+            ring = b->points.size();
+            p++;
+            continue;
+        }
+        if (*p != '-' && *p != '.' && (*p < '0' || *p > '9')) {
+            p++;
+            continue;
+        }
+        tzmap_point_t point;
+        point.longitude = strtod(p, &p);
+        point.latitude = strtod(p, &p);
+        b->points.push_back(point);
+    }
+
+    add_edges(b, zone, edges);
+    return 1;
+}
+
+static bool by_cell_zone(const hit_t &x, const hit_t &y) {
+    if (x.cell != y.cell)
+        return x.cell < y.cell;
+    if (x.zone != y.zone)
+        return x.zone < y.zone;
+    return x.edge < y.edge;
+}
+
+/* Entry with the edges touching the box, dropped when it cannot match */
+static void add_entry(builder_t *b, uint32_t zone, int inside, const uint32_t *edges,
+        uint32_t count, double x0, double y0, double x1, double y1) {
+    tzmap_entry_t entry = { zone, (uint32_t) b->edges.size(), 0 };
+
+    for (uint32_t i = 0; i < count; i++) {
+        const tzmap_point_t *p = &b->points[edges[i]], *q = p + 1;
+        if (fmax(p->longitude, q->longitude) < x0 || fmin(p->longitude, q->longitude) > x1
+                || fmax(p->latitude, q->latitude) < y0 || fmin(p->latitude, q->latitude) > y1)
+            continue;
+        b->edges.push_back(edges[i]);
+        entry.edge_count++;
+    }
+    if (entry.edge_count == 0 && !inside)
+        return;
+    if (inside)
+        entry.edge_count |= TZMAP_INSIDE;
+    b->entries.push_back(entry);
+}
+
+typedef struct _pending {
+    uint32_t zone;
+    int inside;
+    std::vector<uint32_t> edges;
+} pending_t;
+
+/* Entries of top level cell, subdivided when they hold too many edges */
+static void add_cell(builder_t *b, int column, int row, std::vector<pending_t> &zones) {
+    tzmap_cell_t *cell = &b->cells[row * TZMAP_COLUMNS + column];
+    size_t edge_total = 0;
+    double cx, cy;
+
+    for (size_t i = 0; i < zones.size(); i++)
+        edge_total += zones[i].edges.size();
+    cell_center(column, row, 0, 0, 1, &cx, &cy);
+
+    if (edge_total <= SPLIT_EDGES) {
+        cell->first = b->entries.size();
+        for (size_t i = 0; i < zones.size(); i++)
+            add_entry(b, zones[i].zone, zones[i].inside, zones[i].edges.data(),
+                zones[i].edges.size(), -INFINITY, -INFINITY, INFINITY, INFINITY);
+        cell->count = b->entries.size() - cell->first;
+        return;
+    }
+
+    /* A subcell center is inside when the parent center is and the path between crosses evenly */
+    double size = 1.0 / TZMAP_SUBDIVISION;
+    uint32_t block = b->cells.size();
+    cell->first = block;
+    cell->count = TZMAP_SPLIT;
+    b->cells.resize(block + TZMAP_SUBDIVISION * TZMAP_SUBDIVISION);
+    for (int sr = 0; sr < TZMAP_SUBDIVISION; sr++)
+        for (int sc = 0; sc < TZMAP_SUBDIVISION; sc++) {
+            tzmap_cell_t *sub = &b->cells[block + sr * TZMAP_SUBDIVISION + sc];
+            double x, y, x0 = column - 180.0 + sc * size, y0 = row - 90.0 + sr * size;
+
+            cell_center(column, row, sc, sr, size, &x, &y);
+            sub->first = b->entries.size();
+            for (size_t i = 0; i < zones.size(); i++) {
+                const pending_t &z = zones[i];
+                int inside = z.inside ^ crossing_parity(b->points.data(), z.edges.data(),
+                    z.edges.size(), cx, cy, x, y);
+                add_entry(b, z.zone, inside, z.edges.data(), z.edges.size(),
+                    x0, y0, x0 + size, y0 + size);
+            }
+            sub->count = b->entries.size() - sub->first;
+        }
+}
+
+static void build_cells(builder_t *b) {
+    size_t h = 0, c = 0;
+
+    std::sort(b->hits.begin(), b->hits.end(), by_cell_zone);
+    std::sort(b->centers.begin(), b->centers.end(), by_cell_zone);
+    b->cells.assign(TZMAP_COLUMNS * TZMAP_ROWS, tzmap_cell_t());
+
+    for (uint32_t cell = 0; cell < TZMAP_COLUMNS * TZMAP_ROWS; cell++) {
+        std::vector<pending_t> zones;
+
+        /* Merge edges and center flags by zone, polygons of a zone are disjoint */
+        while ((h < b->hits.size() && b->hits[h].cell == cell)
+                || (c < b->centers.size() && b->centers[c].cell == cell)) {
+            uint32_t zone = UINT32_MAX;
+            if (h < b->hits.size() && b->hits[h].cell == cell)
+                zone = b->hits[h].zone;
+            if (c < b->centers.size() && b->centers[c].cell == cell)
+                zone = std::min(zone, b->centers[c].zone);
+
+            pending_t pending;
+            pending.zone = zone;
+            pending.inside = 0;
+            for (; h < b->hits.size() && b->hits[h].cell == cell && b->hits[h].zone == zone; h++)
+                pending.edges.push_back(b->hits[h].edge);
+            for (; c < b->centers.size() && b->centers[c].cell == cell && b->centers[c].zone == zone; c++)
+                pending.inside ^= 1;
+            zones.push_back(pending);
+        }
+        add_cell(b, cell % TZMAP_COLUMNS, cell / TZMAP_COLUMNS, zones);
+    }
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = (const char *) data;
+
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t) 7;
+}
+
+static int write_file(const char *path, builder_t *b) {
+    tzmap_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = TZMAP_MAGIC;
+    header.version = TZMAP_VERSION;
+    header.zones = b->zones.size();
+    header.cells = b->cells.size();
+    header.entries = b->entries.size();
+    header.edges = b->edges.size();
+    header.points = b->points.size();
+    header.strings_size = b->strings.size();
+    header.zones_offset = align8(sizeof(header));
+    header.cells_offset = align8(header.zones_offset + header.zones * sizeof(uint32_t));
+    header.entries_offset = align8(header.cells_offset + header.cells * sizeof(tzmap_cell_t));
+    header.edges_offset = align8(header.entries_offset + header.entries * sizeof(tzmap_entry_t));
+    header.points_offset = align8(header.edges_offset + header.edges * sizeof(uint32_t));
+    header.strings_offset = align8(header.points_offset + header.points * sizeof(tzmap_point_t));
+
+    struct {
+        uint64_t offset;
+        const void *data;
+        size_t len;
+    } sections[] = {
+        { 0, &header, sizeof(header) },
+        { header.zones_offset, b->zones.data(), header.zones * sizeof(uint32_t) },
+        { header.cells_offset, b->cells.data(), header.cells * sizeof(tzmap_cell_t) },
+        { header.entries_offset, b->entries.data(), header.entries * sizeof(tzmap_entry_t) },
+        { header.edges_offset, b->edges.data(), header.edges * sizeof(uint32_t) },
+        { header.points_offset, b->points.data(), header.points * sizeof(tzmap_point_t) },
+        { header.strings_offset, b->strings.data(), header.strings_size },
+    };
+    static const char zeros[8] = { 0 };
+    char tmp[PATH_MAX];
+    uint64_t written = 0;
+    int fd, ok = 1;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    for (size_t i = 0; ok && i < sizeof(sections) / sizeof(sections[0]); i++) {
+        ok = write_all(fd, zeros, sections[i].offset - written) == 0
+            && write_all(fd, sections[i].data, sections[i].len) == 0;
+        written = sections[i].offset + sections[i].len;
+    }
+    if (close(fd) != 0 || !ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+long tzmap_build(const char *csv, const char *path) {
+    builder_t b;
+    char *line = NULL;
+    size_t line_size = 0;
+    FILE *in;
+
+    if ((in = fopen(csv, "r")) == NULL) {
+        perror(csv);
+        return -1;
+    }
+
+    /* Nautical zones first so that their ids follow from the longitude */
+    for (int offset = -12; offset <= 12; offset++) {
+        char name[16];
+        if (offset == 0)
+            snprintf(name, sizeof(name), "Etc/GMT");
+        else
+            snprintf(name, sizeof(name), "Etc/GMT%+d", -offset);
+        add_zone(&b, name);
+    }
+
+    while (getline(&line, &line_size, in) > 0)
+        parse_line(&b, line);
+    free(line);
+    fclose(in);
+
+    if (b.zones.size() == NAUTICAL_ZONES) {
+        fprintf(stderr, "%s: no zone polygons found\n", csv);
+        return -1;
+    }
+    if (b.points.size() >= UINT32_MAX) {
+        fprintf(stderr, "%s: too many points\n", csv);
+        return -1;
+    }
+
+    build_cells(&b);
+    if (write_file(path, &b) < 0) {
+        perror(path);
+        return -1;
+    }
+    return b.zones.size() - NAUTICAL_ZONES;
+}
+
+/* ---------------------- Lookups ----------------------- */
+
+int tzmap_open(tzmap_t *map, const char *path) {
+    struct stat st;
+    int fd;
+
+    memset(map, 0, sizeof(*map));
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(tzmap_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return -1;
+
+    const tzmap_header_t *h = (const tzmap_header_t *) data;
+    const char *base = (const char *) data;
+    uint64_t size = st.st_size;
+
+    /* Sections must lie inside the file; the records are checked as they are used */
+    if (h->magic != TZMAP_MAGIC || h->version != TZMAP_VERSION
+            || h->zones < NAUTICAL_ZONES || h->cells < TZMAP_COLUMNS * TZMAP_ROWS
+            || h->strings_size == 0
+            || h->zones_offset + (uint64_t) h->zones * sizeof(uint32_t) > size
+            || h->cells_offset + (uint64_t) h->cells * sizeof(tzmap_cell_t) > size
+            || h->entries_offset + (uint64_t) h->entries * sizeof(tzmap_entry_t) > size
+            || h->edges_offset + (uint64_t) h->edges * sizeof(uint32_t) > size
+            || h->points_offset + (uint64_t) h->points * sizeof(tzmap_point_t) > size
+            || h->strings_offset + h->strings_size > size
+            || base[h->strings_offset + h->strings_size - 1] != '\0'
+            || (h->zones_offset | h->cells_offset | h->entries_offset | h->edges_offset
+                | h->points_offset) % 8) {
+        munmap(data, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    map->map = data;
+    map->size = st.st_size;
+    map->header = h;
+    map->zones = (const uint32_t *) (base + h->zones_offset);
+    map->cells = (const tzmap_cell_t *) (base + h->cells_offset);
+    map->entries = (const tzmap_entry_t *) (base + h->entries_offset);
+    map->edges = (const uint32_t *) (base + h->edges_offset);
+    map->points = (const tzmap_point_t *) (base + h->points_offset);
+    map->strings = base + h->strings_offset;
+    return 0;
+}
+
+void tzmap_close(tzmap_t *map) {
+    if (map->map)
+        munmap((void *) map->map, map->size);
+    memset(map, 0, sizeof(*map));
+}
+
+uint32_t tzmap_zone(const tzmap_t *map, double latitude, double longitude) {
+    const tzmap_header_t *h = map->header;
+    int column = clamp(floor(longitude + 180), 0, TZMAP_COLUMNS - 1);
+    int row = clamp(floor(latitude + 90), 0, TZMAP_ROWS - 1);
+    const tzmap_cell_t *cell = &map->cells[row * TZMAP_COLUMNS + column];
+    int sub_column = 0, sub_row = 0;
+    double size = 1, x, y;
+
+    if (cell->count == TZMAP_SPLIT) {
+        size = 1.0 / TZMAP_SUBDIVISION;
+        sub_column = clamp(floor((longitude + 180 - column) * TZMAP_SUBDIVISION), 0, TZMAP_SUBDIVISION - 1);
+        sub_row = clamp(floor((latitude + 90 - row) * TZMAP_SUBDIVISION), 0, TZMAP_SUBDIVISION - 1);
+        if (cell->first + sub_row * TZMAP_SUBDIVISION + sub_column >= h->cells)
+            goto nautical;
+        cell = &map->cells[cell->first + sub_row * TZMAP_SUBDIVISION + sub_column];
+    }
+    if (cell->count == TZMAP_SPLIT || (uint64_t) cell->first + cell->count > h->entries)
+        goto nautical;
+    cell_center(column, row, sub_column, sub_row, size, &x, &y);
+
+    for (uint32_t i = 0; i < cell->count; i++) {
+        const tzmap_entry_t *entry = &map->entries[cell->first + i];
+        uint32_t count = entry->edge_count & ~TZMAP_INSIDE;
+        int inside = (entry->edge_count & TZMAP_INSIDE) != 0;
+
+        if ((uint64_t) entry->first_edge + count > h->edges || entry->zone >= h->zones)
+            continue;
+        for (uint32_t e = 0; e < count; e++) {
+            uint32_t edge = map->edges[entry->first_edge + e];
+            if (edge + 1 < h->points)
+                inside ^= crosses(longitude, latitude, x, y, &map->points[edge], &map->points[edge + 1]);
+        }
+        if (inside)
+            return entry->zone;
+    }
+
+nautical:
+    return clamp(lround(longitude / 15), -12, 12) + 12;
+}
+
+const char *tzmap_name(const tzmap_t *map, uint32_t zone) {
+    if (zone >= map->header->zones || map->zones[zone] >= map->header->strings_size)
+        return "UTC";
+    return map->strings + map->zones[zone];
+}
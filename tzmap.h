@@ -0,0 +1,100 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TZMAP_H
+#define TZMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Offline time zone resolver (--tzmap). Built once from zone boundary
+ * polygons, e.g. timezone-boundary-builder converted to WKT CSV:
+ *
+ *   ogr2ogr -f CSV -lco GEOMETRY=AS_WKT zones.csv combined.json
+ *
+ * and used from a read-only mapping. A 1 degree grid, with dense cells
+ * split again into TZMAP_SUBDIVISION^2 subcells, keeps for every cell the
+ * zones touching it, whether the cell center lies inside each zone and
+ * the zone edges crossing the cell. A point is inside a zone when the
+ * center is and the segment between them crosses an even number of those
+ * edges, so a lookup never looks beyond its cell. Points outside every
+ * polygon get the nautical Etc/GMT zone of their longitude.
+ */
+
+#define TZMAP_MAGIC 0x5a545450          /* "PTTZ" */
+#define TZMAP_VERSION 1
+#define TZMAP_COLUMNS 360
+#define TZMAP_ROWS 180
+#define TZMAP_SUBDIVISION 8
+#define TZMAP_SPLIT 0xffffffffu         /* cell count of a subdivided cell */
+#define TZMAP_INSIDE 0x80000000u        /* entry flag: the cell center is inside */
+
+typedef struct _tzmap_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t zones;                     /* the first 25 are Etc/GMT+12 .. Etc/GMT-12 */
+    uint32_t cells;                     /* top level cells, then subcell blocks */
+    uint32_t entries;
+    uint32_t edges;
+    uint32_t points;
+    uint32_t strings_size;
+    uint64_t zones_offset;
+    uint64_t cells_offset;
+    uint64_t entries_offset;
+    uint64_t edges_offset;
+    uint64_t points_offset;
+    uint64_t strings_offset;
+} tzmap_header_t;
+
+typedef struct _tzmap_cell {
+    uint32_t first;                     /* entry, or subcell for TZMAP_SPLIT */
+    uint32_t count;
+} tzmap_cell_t;
+
+typedef struct _tzmap_entry {
+    uint32_t zone;
+    uint32_t first_edge;
+    uint32_t edge_count;                /* | TZMAP_INSIDE */
+} tzmap_entry_t;
+
+typedef struct _tzmap_point {
+    float longitude;
+    float latitude;
+} tzmap_point_t;
+
+typedef struct _tzmap {
+    const void *map;
+    size_t size;
+    const tzmap_header_t *header;
+    const uint32_t *zones;              /* name offsets into strings */
+    const tzmap_cell_t *cells;
+    const tzmap_entry_t *entries;
+    const uint32_t *edges;              /* edge i runs from points[i] to points[i + 1] */
+    const tzmap_point_t *points;
+    const char *strings;
+} tzmap_t;
+
+/* Build path from a WKT CSV of zone polygons, returns the number of zones or -1 */
+long tzmap_build(const char *csv, const char *path);
+
+int tzmap_open(tzmap_t *map, const char *path);
+void tzmap_close(tzmap_t *map);
+
+/* Zone id of a location, always valid */
+uint32_t tzmap_zone(const tzmap_t *map, double latitude, double longitude);
+const char *tzmap_name(const tzmap_t *map, uint32_t zone);
+
+#endif /* TZMAP_H */
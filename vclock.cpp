@@ -0,0 +1,46 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "vclock.h"
+
+static int simulated = 0;
+static time_t simulated_now;
+
+time_t vclock_now(void) {
+    return simulated ? simulated_now : time(NULL);
+}
+
+int64_t vclock_now_ns(void) {
+    struct timespec ts;
+
+    if (simulated)
+        return (int64_t) simulated_now * 1000000000;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void vclock_simulate(time_t start) {
+    simulated = 1;
+    simulated_now = start;
+}
+
+int vclock_simulated(void) {
+    return simulated;
+}
+
+void vclock_advance(time_t t) {
+    if (t > simulated_now)
+        simulated_now = t;
+}
@@ -0,0 +1,38 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VCLOCK_H
+#define VCLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * The wall clock the daemon schedules by. It is the system clock, or with
+ * --simulate a virtual clock that the simulation moves from one armed
+ * deadline to the next, so a year of events runs in seconds.
+ */
+
+time_t vclock_now(void);
+int64_t vclock_now_ns(void);
+
+/* Switch to simulated time starting at start */
+void vclock_simulate(time_t start);
+int vclock_simulated(void);
+
+/* Move the simulated clock forward to t, it never goes back */
+void vclock_advance(time_t t);
+
+#endif /* VCLOCK_H */